@@ -0,0 +1,780 @@
+// This is for the CI compiler
+#define _POSIX_C_SOURCE 200809L
+
+#include "../lib/arena.h"
+#include "../lib/map.h"
+#include "../lib/profile.h"
+#include "../lifp/environment.h"
+#include "../lifp/evaluate.h"
+#include "../lifp/node.h"
+#include "../lifp/parse.h"
+#include "../lifp/tokenize.h"
+
+#include <fcntl.h> // open
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Ahead-of-time compiler
+// ---
+//
+// Translates a script to a C program linking against the runtime. Top-level
+// definitions of functions on integers, like
+//
+// ```lisp
+// (def! fib (fn (a) (cond ((< a 2) a) (+ (fib (- a 1)) (fib (- a 2))))))
+// ```
+//
+// are compiled to C functions, and bound as builtins in their place. Their
+// bodies can hold integer and boolean literals, arguments, let, cond, the
+// arithmetic and comparison builtins, and calls to themselves and to the
+// functions compiled before them. The rest of the script is evaluated by the
+// interpreter, in order, when the program runs.
+//
+// Compiled functions only take integers: calls with other values are runtime
+// errors. Names defined more than once, and builtins redefined by the script,
+// are never assumed to be known.
+//
+// ```sh
+// make BUILD_TYPE=release bin/compile liblifp.a
+// bin/compile script.lifp > script.c
+// clang -std=c23 -O2 -I. script.c liblifp.a -o script
+// ```
+
+// Memory allocated for AST parsing
+constexpr size_t AST_MEMORY = (size_t)(1024 * 64);
+
+// Memory allocated for the bookkeeping of the compiler
+constexpr size_t COMPILER_MEMORY = (size_t)(1024 * 256);
+
+// Size of the code of a compiled function
+constexpr size_t BUFFER_SIZE = (size_t)(1024 * 64);
+
+constexpr size_t FUNCTIONS_CAPACITY = 256;
+constexpr size_t STEPS_CAPACITY = 4096;
+
+typedef enum {
+  TYPE_INTEGER,
+  TYPE_BOOLEAN,
+} type_t;
+
+typedef struct {
+  char symbol[SYMBOL_SIZE];
+  size_t arity;
+  type_t type;
+} function_t;
+
+// Top-level forms, in order: either compiled functions to bind, or sources to
+// evaluate
+typedef struct {
+  const function_t *function;
+  const char *source;
+  size_t length;
+  position_t position;
+} step_t;
+
+typedef struct {
+  char text[BUFFER_SIZE];
+  size_t size;
+  bool overflow;
+} buffer_t;
+
+typedef struct {
+  // Times each name is bound by def! anywhere in the script
+  Map(size_t) * definitions;
+  environment_t *builtins;
+  function_t functions[FUNCTIONS_CAPACITY];
+  size_t functions_count;
+  step_t steps[STEPS_CAPACITY];
+  size_t steps_count;
+} compiler_t;
+
+// Symbols bound by the arguments and the let forms of a body
+typedef struct scope_t {
+  const char *symbol;
+  size_t variable;
+  type_t type;
+  const struct scope_t *parent;
+} scope_t;
+
+// Every value of a body is held by a variable of its own, vN
+typedef struct {
+  const compiler_t *compiler;
+  buffer_t *buffer;
+  // Functions up to this one can be called
+  size_t index;
+  size_t variables;
+  size_t depth;
+} translation_t;
+
+#define error(Fmt, ...)                                                        \
+  {                                                                            \
+    fprintf(stderr, "lifp: ");                                                 \
+    fprintf(stderr, Fmt __VA_OPT__(, ) __VA_ARGS__);                           \
+    fprintf(stderr, "\n");                                                     \
+  }
+
+#define tryCLI(Action, Destination, ErrorMessage)                              \
+  auto _concat(result, __LINE__) = Action;                                     \
+  if (_concat(result, __LINE__).code != RESULT_OK) {                           \
+    error("%s", ErrorMessage);                                                 \
+    return 1;                                                                  \
+  }                                                                            \
+  (Destination) = _concat(result, __LINE__).value;
+
+static void append(buffer_t *self, const char *format, ...) {
+  if (self->overflow)
+    return;
+
+  va_list arguments;
+  va_start(arguments, format);
+  const int written = vsnprintf(&self->text[self->size],
+                                BUFFER_SIZE - self->size, format, arguments);
+  va_end(arguments);
+
+  if (written < 0 || (size_t)written >= BUFFER_SIZE - self->size) {
+    self->overflow = true;
+    return;
+  }
+  self->size += (size_t)written;
+}
+
+// Appends an indented line of the body
+#define line(Translation, ...)                                                 \
+  append((Translation)->buffer, "%*s", (int)(2 * (Translation)->depth), "");   \
+  append((Translation)->buffer, __VA_ARGS__);                                  \
+  append((Translation)->buffer, "\n")
+
+static bool isSymbol(const node_t *node, const char *symbol) {
+  return node->type == NODE_TYPE_SYMBOL &&
+         strcmp(node->value.symbol, symbol) == 0;
+}
+
+static size_t definitionsOf(const compiler_t *compiler, const char *symbol) {
+  const size_t *count = mapGet(size_t, compiler->definitions, symbol);
+  return count ? *count : 0;
+}
+
+static result_void_t countDefinitions(compiler_t *compiler,
+                                      const node_t *node) {
+  if (node->type != NODE_TYPE_LIST)
+    return ok(result_void_t);
+
+  const node_list_t *list = &node->value.list;
+  if (list->count > 1 && isSymbol(&list->data[0], DEFINE) &&
+      list->data[1].type == NODE_TYPE_SYMBOL) {
+    size_t count = definitionsOf(compiler, list->data[1].value.symbol) + 1;
+    try(result_void_t,
+        mapSet(compiler->definitions, list->data[1].value.symbol, &count));
+  }
+
+  for (size_t i = 0; i < list->count; i++) {
+    try(result_void_t, countDefinitions(compiler, &list->data[i]));
+  }
+  return ok(result_void_t);
+}
+
+// C operators of the builtins on integers, which wrap around like them
+typedef struct {
+  builtin_t builtin;
+  type_t type;
+  const char *format;
+} operation_t;
+
+static const operation_t OPERATIONS[] = {
+    {sum, TYPE_INTEGER, "(int32_t)((uint32_t)v%zu + (uint32_t)v%zu)"},
+    {subtract, TYPE_INTEGER, "(int32_t)((uint32_t)v%zu - (uint32_t)v%zu)"},
+    {multiply, TYPE_INTEGER, "(int32_t)((uint32_t)v%zu * (uint32_t)v%zu)"},
+    {equal, TYPE_BOOLEAN, "v%zu == v%zu"},
+    {lessThan, TYPE_BOOLEAN, "v%zu < v%zu"},
+    {greaterThan, TYPE_BOOLEAN, "v%zu > v%zu"},
+    {lessEqual, TYPE_BOOLEAN, "v%zu <= v%zu"},
+    {greaterEqual, TYPE_BOOLEAN, "v%zu >= v%zu"},
+};
+
+static const scope_t *lookupScope(const scope_t *scope, const char *symbol) {
+  for (; scope; scope = scope->parent) {
+    if (strcmp(scope->symbol, symbol) == 0)
+      return scope;
+  }
+  return nullptr;
+}
+
+static bool translateNode(translation_t *translation, const node_t *node,
+                          const scope_t *scope, size_t *variable,
+                          type_t *type);
+
+static bool translateOperation(translation_t *translation,
+                               const node_list_t *list,
+                               const operation_t *operation,
+                               const scope_t *scope, size_t *variable,
+                               type_t *type) {
+  size_t left;
+  size_t right;
+  type_t left_type;
+  type_t right_type;
+  if (list->count != 3 ||
+      !translateNode(translation, &list->data[1], scope, &left, &left_type) ||
+      !translateNode(translation, &list->data[2], scope, &right,
+                     &right_type) ||
+      left_type != TYPE_INTEGER || right_type != TYPE_INTEGER)
+    return false;
+
+  char expression[128];
+  snprintf(expression, sizeof(expression), operation->format, left, right);
+  *variable = translation->variables++;
+  *type = operation->type;
+  line(translation, "const int32_t v%zu = %s;", *variable, expression);
+  return true;
+}
+
+static bool translateCall(translation_t *translation, const node_list_t *list,
+                          size_t index, const scope_t *scope,
+                          size_t *variable, type_t *type) {
+  const function_t *callee = &translation->compiler->functions[index];
+  if (list->count - 1 != callee->arity || list->count - 1 > 16)
+    return false;
+
+  size_t arguments[16];
+  for (size_t i = 1; i < list->count; i++) {
+    type_t argument;
+    if (!translateNode(translation, &list->data[i], scope, &arguments[i - 1],
+                       &argument) ||
+        argument != TYPE_INTEGER)
+      return false;
+  }
+
+  *variable = translation->variables++;
+  *type = callee->type;
+  append(translation->buffer, "%*sconst int32_t v%zu = lifp_%zu(",
+         (int)(2 * translation->depth), "", *variable, index);
+  for (size_t i = 0; i < callee->arity; i++) {
+    append(translation->buffer, i == 0 ? "v%zu" : ", v%zu", arguments[i]);
+  }
+  append(translation->buffer, ");\n");
+  return true;
+}
+
+// Clauses nest in the else branch of the ones before them
+static bool translateCond(translation_t *translation, const node_list_t *list,
+                          const scope_t *scope, size_t *variable,
+                          type_t *type) {
+  if (list->count < 2)
+    return false;
+
+  *variable = translation->variables++;
+  line(translation, "int32_t v%zu;", *variable);
+
+  const size_t depth = translation->depth;
+  bool typed = false;
+  for (size_t i = 1; i < list->count; i++) {
+    const bool fallback = i == list->count - 1;
+    const node_t *clause = &list->data[i];
+    const node_t *branch = clause;
+
+    if (!fallback) {
+      if (clause->type != NODE_TYPE_LIST || clause->value.list.count != 2)
+        return false;
+
+      size_t test;
+      type_t test_type;
+      if (!translateNode(translation, &clause->value.list.data[0], scope,
+                         &test, &test_type) ||
+          test_type != TYPE_BOOLEAN)
+        return false;
+
+      line(translation, "if (v%zu) {", test);
+      translation->depth++;
+      branch = &clause->value.list.data[1];
+    }
+
+    size_t value;
+    type_t value_type;
+    if (!translateNode(translation, branch, scope, &value, &value_type) ||
+        (typed && value_type != *type))
+      return false;
+
+    *type = value_type;
+    typed = true;
+    line(translation, "v%zu = v%zu;", *variable, value);
+
+    if (!fallback) {
+      translation->depth--;
+      line(translation, "} else {");
+      translation->depth++;
+    }
+  }
+
+  while (translation->depth > depth) {
+    translation->depth--;
+    line(translation, "}");
+  }
+  return true;
+}
+
+static bool translateBindings(translation_t *translation,
+                              const node_list_t *couples, size_t index,
+                              const node_t *body, const scope_t *scope,
+                              size_t *variable, type_t *type) {
+  if (index == couples->count)
+    return translateNode(translation, body, scope, variable, type);
+
+  const node_t *couple = &couples->data[index];
+  if (couple->type != NODE_TYPE_LIST || couple->value.list.count != 2 ||
+      couple->value.list.data[0].type != NODE_TYPE_SYMBOL)
+    return false;
+
+  scope_t binding = {.symbol = couple->value.list.data[0].value.symbol,
+                     .parent = scope};
+  if (!translateNode(translation, &couple->value.list.data[1], scope,
+                     &binding.variable, &binding.type))
+    return false;
+
+  return translateBindings(translation, couples, index + 1, body, &binding,
+                           variable, type);
+}
+
+static bool translateList(translation_t *translation, const node_list_t *list,
+                          const scope_t *scope, size_t *variable,
+                          type_t *type) {
+  if (list->count == 0 || list->data[0].type != NODE_TYPE_SYMBOL)
+    return false;
+
+  const char *symbol = list->data[0].value.symbol;
+  if (strcmp(symbol, DEFINE) == 0 || strcmp(symbol, FUNCTION) == 0)
+    return false;
+
+  if (strcmp(symbol, LET) == 0) {
+    if (list->count != 3 || list->data[1].type != NODE_TYPE_LIST)
+      return false;
+    return translateBindings(translation, &list->data[1].value.list, 0,
+                             &list->data[2], scope, variable, type);
+  }
+
+  if (strcmp(symbol, COND) == 0)
+    return translateCond(translation, list, scope, variable, type);
+
+  const compiler_t *compiler = translation->compiler;
+  if (lookupScope(scope, symbol))
+    return false;
+
+  // Functions only see the ones compiled before them, and themselves
+  for (size_t i = 0; i <= translation->index; i++) {
+    if (strcmp(compiler->functions[i].symbol, symbol) == 0)
+      return translateCall(translation, list, i, scope, variable, type);
+  }
+
+  if (definitionsOf(compiler, symbol) > 0)
+    return false;
+
+  const value_t *callee = environmentResolveSymbol(compiler->builtins, symbol);
+  if (!callee || callee->type != VALUE_TYPE_BUILTIN)
+    return false;
+
+  const size_t count = sizeof(OPERATIONS) / sizeof(operation_t);
+  for (size_t i = 0; i < count; i++) {
+    if (OPERATIONS[i].builtin == callee->value.builtin)
+      return translateOperation(translation, list, &OPERATIONS[i], scope,
+                                variable, type);
+  }
+  return false;
+}
+
+static bool translateNode(translation_t *translation, const node_t *node,
+                          const scope_t *scope, size_t *variable,
+                          type_t *type) {
+  switch (node->type) {
+  case NODE_TYPE_INTEGER:
+    *variable = translation->variables++;
+    *type = TYPE_INTEGER;
+    line(translation, "const int32_t v%zu = %d;", *variable,
+         node->value.integer);
+    return true;
+  case NODE_TYPE_BOOLEAN:
+    *variable = translation->variables++;
+    *type = TYPE_BOOLEAN;
+    line(translation, "const int32_t v%zu = %d;", *variable,
+         node->value.boolean ? 1 : 0);
+    return true;
+  case NODE_TYPE_SYMBOL: {
+    const scope_t *slot = lookupScope(scope, node->value.symbol);
+    if (!slot)
+      return false;
+    *variable = slot->variable;
+    *type = slot->type;
+    return true;
+  }
+  case NODE_TYPE_LIST:
+    return translateList(translation, &node->value.list, scope, variable,
+                         type);
+  case NODE_TYPE_NIL:
+  default:
+    return false;
+  }
+}
+
+// Definitions of functions on integers, bound once in the whole script
+static bool isCompilable(const compiler_t *compiler, const node_t *node) {
+  if (node->type != NODE_TYPE_LIST || node->value.list.count != 3)
+    return false;
+
+  const node_t *nodes = node->value.list.data;
+  if (!isSymbol(&nodes[0], DEFINE) || nodes[1].type != NODE_TYPE_SYMBOL ||
+      definitionsOf(compiler, nodes[1].value.symbol) != 1 ||
+      nodes[2].type != NODE_TYPE_LIST || nodes[2].value.list.count != 3)
+    return false;
+
+  const node_t *function = nodes[2].value.list.data;
+  if (!isSymbol(&function[0], FUNCTION) ||
+      function[1].type != NODE_TYPE_LIST ||
+      function[1].value.list.count > 16)
+    return false;
+
+  for (size_t i = 0; i < function[1].value.list.count; i++) {
+    if (function[1].value.list.data[i].type != NODE_TYPE_SYMBOL)
+      return false;
+  }
+  return true;
+}
+
+// Calls of a function to itself are assumed to return integers first, then
+// booleans: the assumption holds if the body returns the same type
+static bool compileFunction(compiler_t *compiler, const node_t *node,
+                            buffer_t *buffer) {
+  if (!isCompilable(compiler, node) ||
+      compiler->functions_count == FUNCTIONS_CAPACITY)
+    return false;
+
+  const node_t *nodes = node->value.list.data;
+  const node_list_t *arguments = &nodes[2].value.list.data[1].value.list;
+  const node_t *body = &nodes[2].value.list.data[2];
+
+  const size_t index = compiler->functions_count;
+  function_t *function = &compiler->functions[index];
+  strcpy(function->symbol, nodes[1].value.symbol);
+  function->arity = arguments->count;
+
+  scope_t slots[16];
+  const scope_t *scope = nullptr;
+  for (size_t i = 0; i < arguments->count; i++) {
+    slots[i] = (scope_t){.symbol = arguments->data[i].value.symbol,
+                         .variable = i,
+                         .type = TYPE_INTEGER,
+                         .parent = scope};
+    scope = &slots[i];
+  }
+
+  const type_t types[] = {TYPE_INTEGER, TYPE_BOOLEAN};
+  for (size_t i = 0; i < sizeof(types) / sizeof(type_t); i++) {
+    function->type = types[i];
+    buffer->size = 0;
+    buffer->overflow = false;
+
+    translation_t translation = {.compiler = compiler,
+                                 .buffer = buffer,
+                                 .index = index,
+                                 .variables = arguments->count,
+                                 .depth = 1};
+
+    append(buffer, "// %s, at %zu:%zu\n", function->symbol,
+           node->position.line, node->position.column);
+    append(buffer, "static int32_t lifp_%zu(", index);
+    for (size_t j = 0; j < arguments->count; j++) {
+      append(buffer, j == 0 ? "int32_t v%zu" : ", int32_t v%zu", j);
+    }
+    append(buffer, arguments->count == 0 ? "void) {\n" : ") {\n");
+
+    size_t result;
+    type_t type;
+    if (!translateNode(&translation, body, scope, &result, &type) ||
+        type != types[i])
+      continue;
+
+    line(&translation, "return v%zu;", result);
+    append(buffer, "}\n\n");
+
+    // Arguments are checked at run time
+    append(buffer,
+           "static result_void_position_t\n"
+           "builtin_%zu(value_t *result, value_list_t *values) {\n",
+           index);
+    append(buffer,
+           "  if (values->count != %zu) {\n"
+           "    throw(result_void_position_t, "
+           "ERROR_CODE_TYPE_UNEXPECTED_ARITY,\n"
+           "          result->position,\n"
+           "          \"Unexpected arity. Expected %zu arguments, got "
+           "%%zu.\",\n"
+           "          values->count);\n"
+           "  }\n",
+           arguments->count, arguments->count);
+    append(buffer,
+           "  for (size_t i = 0; i < values->count; i++) {\n"
+           "    if (values->data[i].type != VALUE_TYPE_INTEGER) {\n"
+           "      throw(result_void_position_t, ERROR_CODE_RUNTIME_ERROR,\n"
+           "            values->data[i].position,\n"
+           "            \"%%s requires integers. Got type %%u\", \"%s\",\n"
+           "            values->data[i].type);\n"
+           "    }\n"
+           "  }\n\n",
+           function->symbol);
+    append(buffer, "  const int32_t value = lifp_%zu(", index);
+    for (size_t j = 0; j < arguments->count; j++) {
+      append(buffer, j == 0 ? "values->data[%zu].value.integer"
+                            : ",\n      values->data[%zu].value.integer",
+             j);
+    }
+    append(buffer, ");\n");
+    append(buffer, type == TYPE_INTEGER
+                       ? "  result->type = VALUE_TYPE_INTEGER;\n"
+                         "  result->value.integer = value;\n"
+                       : "  result->type = VALUE_TYPE_BOOLEAN;\n"
+                         "  result->value.boolean = value != 0;\n");
+    append(buffer, "  return ok(result_void_position_t);\n}\n\n");
+
+    if (buffer->overflow)
+      return false;
+
+    compiler->functions_count++;
+    return true;
+  }
+  return false;
+}
+
+static void printString(const char *source, size_t length) {
+  printf("\"");
+  for (size_t i = 0; i < length; i++) {
+    const unsigned char current = (unsigned char)source[i];
+    if (current == '\n' && i + 1 < length) {
+      printf("\\n\"\n    \"");
+    } else if (current == '\n') {
+      printf("\\n");
+    } else if (current == '"' || current == '\\') {
+      printf("\\%c", current);
+    } else if (current < ' ' || current == 0x7F) {
+      printf("\\%03o", current);
+    } else {
+      putchar(current);
+    }
+  }
+  printf("\"");
+}
+
+static const char *PRELUDE =
+    "// Generated by bin/compile from %s\n"
+    "#include \"lifp/environment.h\"\n"
+    "#include \"lifp/error.h\"\n"
+    "#include \"lifp/evaluate.h\"\n"
+    "#include \"lifp/gc.h\"\n"
+    "#include \"lifp/parse.h\"\n"
+    "#include \"lifp/tokenize.h\"\n"
+    "#include <stdint.h>\n"
+    "#include <stdio.h>\n"
+    "#include <string.h>\n\n";
+
+static const char *RUNTIME =
+    "int main(void) {\n"
+    "  const auto ast = arenaCreate((size_t)(1024 * 64));\n"
+    "  const auto temp = arenaCreate((size_t)(1024 * 64));\n"
+    "  const auto globals = environmentCreate(nullptr);\n"
+    "  if (ast.code != RESULT_OK || temp.code != RESULT_OK ||\n"
+    "      globals.code != RESULT_OK) {\n"
+    "    fprintf(stderr, \"lifp: unable to allocate memory\\n\");\n"
+    "    return 1;\n"
+    "  }\n\n"
+    "  arena_t *ast_arena = ast.value;\n"
+    "  arena_t *temp_arena = temp.value;\n"
+    "  environment_t *environment = globals.value;\n"
+    "  gc_t gc;\n"
+    "  gcInit(&gc, (size_t)(1024 * 16), 2.0);\n\n"
+    "  for (size_t i = 0; i < sizeof(STEPS) / sizeof(step_t); i++) {\n"
+    "    const step_t *step = &STEPS[i];\n"
+    "    if (step->builtin) {\n"
+    "      value_t value = {.type = VALUE_TYPE_BUILTIN,\n"
+    "                       .value.builtin = step->builtin};\n"
+    "      if (mapSet(environment->values, step->symbol, &value).code !=\n"
+    "          RESULT_OK) {\n"
+    "        fprintf(stderr, \"lifp: unable to define %s\\n\", "
+    "step->symbol);\n"
+    "        return 1;\n"
+    "      }\n"
+    "      environment->version++;\n"
+    "      continue;\n"
+    "    }\n\n"
+    "    lexer_t lexer;\n"
+    "    lexerInit(&lexer, strlen(step->source), step->source);\n"
+    "    lexer.cursor = step->position;\n"
+    "    const auto parsed = parseNext(ast_arena, &lexer);\n"
+    "    if (parsed.code != RESULT_OK) {\n"
+    "      fprintf(stderr, \"lifp: %s\\n\", parsed.message);\n"
+    "      return 1;\n"
+    "    }\n"
+    "    if (!parsed.value)\n"
+    "      continue;\n\n"
+    "    const auto optimized = optimize(ast_arena, parsed.value, "
+    "environment);\n"
+    "    if (optimized.code != RESULT_OK) {\n"
+    "      fprintf(stderr, \"lifp: %s\\n\", optimized.message);\n"
+    "      return 1;\n"
+    "    }\n"
+    "    escapeAnalyze(parsed.value);\n\n"
+    "    const auto evaluated = evaluate(temp_arena, parsed.value, "
+    "environment);\n"
+    "    if (evaluated.code != RESULT_OK) {\n"
+    "      fprintf(stderr, \"lifp: %s\\n\", evaluated.message);\n"
+    "      return 1;\n"
+    "    }\n\n"
+    "    arenaReset(temp_arena);\n"
+    "    arenaReset(ast_arena);\n"
+    "    if (gcMaybeCollect(&gc, &environment).code != RESULT_OK) {\n"
+    "      fprintf(stderr, \"lifp: unable to collect memory\\n\");\n"
+    "      return 1;\n"
+    "    }\n"
+    "  }\n\n"
+    "  environmentDestroy(&environment);\n"
+    "  arenaDestroy(&temp_arena);\n"
+    "  arenaDestroy(&ast_arena);\n"
+    "  return 0;\n"
+    "}\n";
+
+static void printProgram(const compiler_t *compiler) {
+  printf("typedef struct {\n"
+         "  const char *symbol;\n"
+         "  builtin_t builtin;\n"
+         "  const char *source;\n"
+         "  position_t position;\n"
+         "} step_t;\n\n");
+
+  printf("static const step_t STEPS[] = {\n");
+  for (size_t i = 0; i < compiler->steps_count; i++) {
+    const step_t *step = &compiler->steps[i];
+    if (step->function) {
+      printf("    {.symbol = \"%s\", .builtin = builtin_%zu},\n",
+             step->function->symbol,
+             (size_t)(step->function - compiler->functions));
+      continue;
+    }
+
+    printf("    {.source = ");
+    printString(step->source, step->length);
+    printf(",\n     .position = {%zu, %zu}},\n", step->position.line,
+           step->position.column);
+  }
+  // Empty scripts still make a valid array
+  if (compiler->steps_count == 0) {
+    printf("    {.source = \"\"},\n");
+  }
+  printf("};\n\n");
+  fputs(RUNTIME, stdout);
+}
+
+// Reads the forms of the script, counting definitions first, so that the
+// ones bound more than once are never compiled
+static int compile(compiler_t *compiler, arena_t *ast_arena, const char *source,
+                   size_t size, const char *file_name) {
+  lexer_t lexer;
+  lexerInit(&lexer, size, source);
+  while (true) {
+    node_t *syntax_tree = nullptr;
+    tryCLI(parseNext(ast_arena, &lexer), syntax_tree, "unable to parse");
+    if (!syntax_tree)
+      break;
+
+    const auto counted = countDefinitions(compiler, syntax_tree);
+    if (counted.code != RESULT_OK) {
+      error("%s", counted.message);
+      return 1;
+    }
+    arenaReset(ast_arena);
+  }
+
+  buffer_t buffer = {};
+  printf(PRELUDE, file_name);
+
+  lexerInit(&lexer, size, source);
+  while (true) {
+    if (compiler->steps_count == STEPS_CAPACITY) {
+      error("script exceeds %lu forms", STEPS_CAPACITY);
+      return 1;
+    }
+
+    step_t *step = &compiler->steps[compiler->steps_count];
+    step->source = &source[lexer.offset];
+    step->position = lexer.cursor;
+
+    node_t *syntax_tree = nullptr;
+    tryCLI(parseNext(ast_arena, &lexer), syntax_tree, "unable to parse");
+    if (!syntax_tree)
+      break;
+
+    step->length = (size_t)(&source[lexer.offset] - step->source);
+    if (compileFunction(compiler, syntax_tree, &buffer)) {
+      step->function = &compiler->functions[compiler->functions_count - 1];
+      fwrite(buffer.text, 1, buffer.size, stdout);
+    }
+
+    compiler->steps_count++;
+    arenaReset(ast_arena);
+  }
+
+  printProgram(compiler);
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  if (argc != 2) {
+    error("'compile' takes one argument");
+    return 1;
+  }
+
+  const char *file_name = argv[1];
+  int file_descriptor = open(file_name, O_RDONLY, 0644);
+  if (file_descriptor < 0) {
+    error("cannot open '%s'", file_name);
+    return 1;
+  }
+
+  struct stat file_stat;
+  if (fstat(file_descriptor, &file_stat) < 0 || file_stat.st_size == 0) {
+    error("cannot read '%s'", file_name);
+    return 1;
+  }
+
+  const size_t size = (size_t)file_stat.st_size;
+  char *source =
+      mmap(nullptr, size, PROT_READ, MAP_PRIVATE, file_descriptor, 0);
+  close(file_descriptor);
+  if (source == MAP_FAILED) {
+    error("cannot map '%s'", file_name);
+    return 1;
+  }
+
+  arena_t *ast_arena = nullptr;
+  tryCLI(arenaCreate(AST_MEMORY), ast_arena, "unable to allocate memory");
+
+  arena_t *compiler_arena = nullptr;
+  tryCLI(arenaCreate(COMPILER_MEMORY), compiler_arena,
+         "unable to allocate memory");
+
+  compiler_t compiler = {};
+  tryCLI(mapCreate(size_t, compiler_arena, 64), compiler.definitions,
+         "unable to allocate memory");
+  tryCLI(environmentCreate(nullptr), compiler.builtins,
+         "unable to allocate memory");
+
+  const int status = compile(&compiler, ast_arena, source, size, file_name);
+
+  environmentDestroy(&compiler.builtins);
+  arenaDestroy(&compiler_arena);
+  arenaDestroy(&ast_arena);
+  munmap(source, size);
+  return status;
+}
+
+#undef tryCLI
+#undef error
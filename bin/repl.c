@@ -3,6 +3,7 @@
 #include "../lifp/environment.h"
 #include "../lifp/evaluate.h"
 #include "../lifp/fmt.h"
+#include "../lifp/gc.h"
 #include "../lifp/node.h"
 #include "../lifp/parse.h"
 #include "../lifp/tokenize.h"
@@ -10,8 +11,6 @@
 #include <stdio.h>
 #include <string.h>
 
-allocMetricsInit();
-
 // Size of the output buffer
 constexpr size_t BUFFER_SIZE = 4096;
 
@@ -21,6 +20,12 @@ constexpr size_t AST_MEMORY = (size_t)(1024 * 64);
 // Memory allocated for storing transient values across environments
 constexpr size_t TEMP_MEMORY = (size_t)(1024 * 64);
 
+// Environment memory in use before the first garbage collection
+constexpr size_t GC_THRESHOLD = (size_t)(1024 * 16);
+
+// Environment memory is kept at least this many times the live data
+constexpr double GC_GROWTH = 2.0;
+
 #define printError(Result, InputBuffer, Size, OutputBuffer)                    \
   int _concat(offset_, __LINE__) = 0;                                          \
   formatErrorMessage((Result)->message, (Result)->meta, "repl", InputBuffer,   \
@@ -58,6 +63,9 @@ int main(void) {
   tryCLI(environmentCreate(nullptr), global_environment,
          "unable to allocate virtual machine memory");
 
+  gc_t gc;
+  gcInit(&gc, GC_THRESHOLD, GC_GROWTH);
+
   linenoiseSetMultiLine(1);
 
   profileInit();
@@ -73,16 +81,21 @@ int main(void) {
     if (strlen(input) == 0)
       continue;
 
-    token_list_t *tokens = nullptr;
-    tryREPL(tokenize(ast_arena, input), tokens);
+    lexer_t lexer;
+    lexerInit(&lexer, strlen(input), input);
 
-    // Add to history only if the string can be tokenized
+    node_t *syntax_tree = nullptr;
+    tryREPL(parse(ast_arena, &lexer), syntax_tree);
+
+    // Add to history only if the string can be parsed
     linenoiseHistoryAdd(input);
 
-    size_t offset = 0;
-    size_t depth = 0;
-    node_t *syntax_tree = nullptr;
-    tryREPL(parse(ast_arena, tokens, &offset, &depth), syntax_tree);
+    auto optimization = optimize(ast_arena, syntax_tree, global_environment);
+    if (optimization.code != RESULT_OK) {
+      fprintf(stderr, "lifp: %s\n", optimization.message);
+      continue;
+    }
+    escapeAnalyze(syntax_tree);
 
     value_t *reduced = nullptr;
     tryREPL(evaluate(temp_arena, syntax_tree, global_environment), reduced);
@@ -92,7 +105,14 @@ int main(void) {
     printf("~> %s\n", buffer);
 
     memset(buffer, 0, BUFFER_SIZE);
+
+    // The value has been printed: bindings are the only live values left
+    auto collection = gcMaybeCollect(&gc, &global_environment);
+    if (collection.code != RESULT_OK) {
+      fprintf(stderr, "lifp: %s\n", collection.message);
+    }
   }
+  shapesReport();
   profileEnd();
   environmentDestroy(&global_environment);
   arenaDestroy(&temp_arena);
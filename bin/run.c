@@ -1,26 +1,56 @@
+// This is for the CI compiler
+#define _POSIX_C_SOURCE 200809L
+
+#include "../lifp/cache.h"
 #include "../lifp/environment.h"
 #include "../lifp/evaluate.h"
+#include "../lifp/gc.h"
+#include "../lifp/image.h"
+#include "../lifp/intern.h"
 #include "../lifp/parse.h"
 #include "../lifp/tokenize.h"
 
 #include "../lib/profile.h"
 
+#include <errno.h>
 #include <fcntl.h> // open
 #include <stddef.h>
 #include <stdio.h> // sprint
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
-// Size of the output buffer
-constexpr size_t FILE_BUFFER_SIZE = (size_t)1024 * 1024;
-
 // Memory allocated for AST parsing
 constexpr size_t AST_MEMORY = (size_t)(1024 * 64);
 
 // Memory allocated for storing transient values across environments
 constexpr size_t TEMP_MEMORY = (size_t)(1024 * 64);
 
+// Memory allocated for buffering streamed input; caps the size of a form
+constexpr size_t STREAM_BUFFER_SIZE = (size_t)(1024 * 64);
+
+// Distinct lists of a form sharing their elements with equal ones
+constexpr size_t INTERN_CAPACITY = 1024;
+
+// Environment memory in use before the first garbage collection
+constexpr size_t GC_THRESHOLD = (size_t)(1024 * 16);
+
+// Environment memory is kept at least this many times the live data
+constexpr double GC_GROWTH = 2.0;
+
+// Memory the interpreter runs with
+typedef struct {
+  arena_t *ast_arena;
+  arena_t *temp_arena;
+  intern_t *intern;
+  environment_t *environment;
+  gc_t gc;
+  // Receives the parsed forms, when they are being cached
+  cache_writer_t *writer;
+} runtime_t;
+
 #define error(Fmt, ...)                                                        \
   {                                                                            \
     fprintf(stderr, "lifp: ");                                                 \
@@ -45,115 +75,348 @@ constexpr size_t TEMP_MEMORY = (size_t)(1024 * 64);
   }                                                                            \
   (Destination) = _concat(result, __LINE__).value;
 
-void readLine(ssize_t size, char line_buffer[static size],
-              const char input_buffer[static size], ssize_t *offset) {
-  size_t line_buffer_offset = 0;
-  bool skip_current_line = false;
-  int depth = 0;
+// Evaluates a top-level form. Each form lives in its own region: whatever
+// has to outlive it is promoted to the environment by `def!`, so the arenas
+// are reclaimed right after evaluation. In between forms the environment holds
+// the only live values, so it's safe to collect it.
+static int evaluateForm(node_t *syntax_tree, runtime_t *runtime) {
+  const auto optimization =
+      optimize(runtime->ast_arena, syntax_tree, runtime->environment);
+  if (optimization.code != RESULT_OK) {
+    error("%s", optimization.message);
+    return 1;
+  }
+  escapeAnalyze(syntax_tree);
 
-  for (; *offset < size; (*offset)++) {
-    const char current = input_buffer[(*offset)];
+  value_t *reduced = nullptr;
+  tryRun(evaluate(runtime->temp_arena, syntax_tree, runtime->environment),
+         reduced);
 
-    // FIXME: the lexer should know about comments, instead of hanling it here
-    if (current == ';') {
-      skip_current_line = true;
-      continue;
+  arenaReset(runtime->temp_arena);
+  arenaReset(runtime->ast_arena);
+  internReset(runtime->intern);
+
+  const auto collection = gcMaybeCollect(&runtime->gc, &runtime->environment);
+  if (collection.code != RESULT_OK) {
+    error("%s", collection.message);
+    return 1;
+  }
+  return 0;
+}
+
+// Evaluates all the forms the lexer can read
+static int evaluateForms(lexer_t *lexer, runtime_t *runtime) {
+  while (true) {
+    node_t *syntax_tree = nullptr;
+    tryRun(parseNextInterned(runtime->ast_arena, lexer, runtime->intern),
+           syntax_tree);
+
+    if (!syntax_tree)
+      return 0;
+
+    // Forms are cached as parsed: optimization depends on the environment
+    if (runtime->writer &&
+        cacheWrite(runtime->writer, syntax_tree).code != RESULT_OK) {
+      cacheAbort(&runtime->writer);
+    }
+
+    if (evaluateForm(syntax_tree, runtime) != 0)
+      return 1;
+  }
+}
+
+// Evaluates the forms of a cache, skipping the parser altogether
+static int evaluateCache(cache_t *cache, runtime_t *runtime) {
+  while (true) {
+    node_t *syntax_tree = nullptr;
+    tryRun(cacheNext(cache, runtime->ast_arena, runtime->intern), syntax_tree);
+
+    if (!syntax_tree)
+      return 0;
+
+    if (evaluateForm(syntax_tree, runtime) != 0)
+      return 1;
+  }
+}
+
+// Input read incrementally from a file descriptor (stdin, pipes, FIFOs...)
+// into a fixed-size buffer. Each form is evaluated as soon as it's complete,
+// and its bytes are reclaimed, so memory does not grow with the stream.
+typedef struct {
+  int file_descriptor;
+  char *buffer;
+  size_t size;    // Capacity of the buffer
+  size_t filled;  // Bytes read into the buffer
+  size_t start;   // Offset of the pending form
+  size_t scanned; // Offset of the next byte to be scanned
+  int depth;
+  bool comment;
+  bool atom;
+  position_t position; // Position before the pending form
+  position_t cursor;   // Position of the last scanned byte
+} stream_t;
+
+static inline bool isStreamDelimiter(char current) {
+  return current == LPAREN || current == RPAREN || current == COMMENT ||
+         current == ' ' || (current >= '\t' && current <= '\r');
+}
+
+// Scans the buffered bytes, tracking just enough state to tell where the
+// pending top-level form ends. Returns true when the form is complete.
+static bool streamScan(stream_t *self) {
+  for (; self->scanned < self->filled; self->scanned++) {
+    const char current = self->buffer[self->scanned];
+
+    if (self->comment) {
+      self->comment = current != '\n';
+    } else if (isStreamDelimiter(current)) {
+      // Top-level atoms end at the delimiter, which is left for the next form
+      if (self->atom && self->depth == 0) {
+        self->atom = false;
+        return true;
+      }
+      self->atom = false;
+
+      if (current == COMMENT) {
+        self->comment = true;
+      } else if (current == LPAREN) {
+        self->depth++;
+      } else if (current == RPAREN && --self->depth <= 0) {
+        // Unbalanced right parens are left for the parser to report
+        self->depth = 0;
+        self->scanned++;
+        self->cursor.column++;
+        return true;
+      }
+    } else {
+      self->atom = true;
     }
 
     if (current == '\n') {
-      skip_current_line = false;
-      continue;
+      self->cursor.line++;
+      self->cursor.column = 0;
+    } else {
+      self->cursor.column++;
     }
+  }
+
+  return false;
+}
+
+static int evaluateStream(stream_t *self, runtime_t *runtime) {
+  while (true) {
+    if (streamScan(self)) {
+      lexer_t lexer;
+      lexerInit(&lexer, self->scanned - self->start,
+                &self->buffer[self->start]);
+      lexer.cursor = self->position;
 
-    if (skip_current_line)
+      if (evaluateForms(&lexer, runtime) != 0)
+        return 1;
+
+      self->start = self->scanned;
+      self->position = self->cursor;
       continue;
+    }
+
+    // Only the pending form is kept: move it to the front to make room
+    if (self->start > 0) {
+      memmove(self->buffer, &self->buffer[self->start],
+              self->filled - self->start);
+      self->filled -= self->start;
+      self->scanned -= self->start;
+      self->start = 0;
+    }
 
-    line_buffer[line_buffer_offset++] = current;
+    if (self->filled == self->size) {
+      error("form exceeds the stream buffer size of %lu bytes", self->size);
+      return 1;
+    }
+
+    const ssize_t bytes_read = read(self->file_descriptor,
+                                    &self->buffer[self->filled],
+                                    self->size - self->filled);
+    if (bytes_read < 0 && errno == EINTR)
+      continue;
 
-    if (current == LPAREN) {
-      depth++;
-    } else if (current == RPAREN) {
-      depth--;
+    if (bytes_read < 0) {
+      error("cannot read from input");
+      return 1;
     }
 
-    // FIXME: this does not allow having top-level atoms
-    if (depth == 0) {
-      (*offset)++;
-      return;
+    // End of stream: whatever is left is either blanks, or a broken form the
+    // parser will report on
+    if (bytes_read == 0) {
+      lexer_t lexer;
+      lexerInit(&lexer, self->filled, self->buffer);
+      lexer.cursor = self->position;
+      return evaluateForms(&lexer, runtime);
     }
+
+    self->filled += (size_t)bytes_read;
   }
 }
 
-allocMetricsInit();
-
 int main(int argc, char **argv) {
-  if (argc != 2) {
-    error("'run' takes one argument");
+  // Images snapshot the global environment: they're loaded before the script
+  // runs, and dumped after it ran to completion
+  const char *load_image = nullptr;
+  const char *dump_image = nullptr;
+  int argument = 1;
+  for (; argument + 1 < argc; argument += 2) {
+    if (strcmp(argv[argument], "--load-image") == 0) {
+      load_image = argv[argument + 1];
+    } else if (strcmp(argv[argument], "--dump-image") == 0) {
+      dump_image = argv[argument + 1];
+    } else {
+      break;
+    }
+  }
+
+  if (argument != argc - 1) {
+    error("usage: run [--load-image <image>] [--dump-image <image>] <file>");
     return 1;
   }
 
-  const char *file_name = argv[1];
-  int file_descriptor = open(file_name, O_RDONLY, 0644);
+  const char *file_name = argv[argument];
+  const bool from_stdin = strcmp(file_name, "-") == 0;
+  int file_descriptor =
+      from_stdin ? STDIN_FILENO : open(file_name, O_RDONLY, 0644);
   if (file_descriptor < 0) {
     error("cannot open '%s'", file_name);
     return 1;
   }
 
-  char *file_buffer = malloc(sizeof(char) * FILE_BUFFER_SIZE);
-  if (!file_buffer) {
-    error("cannot allocate file buffer");
+  struct stat file_stat;
+  if (fstat(file_descriptor, &file_stat) < 0) {
+    error("cannot read '%s'", file_name);
     return 1;
   }
-  ssize_t len = read(file_descriptor, file_buffer, FILE_BUFFER_SIZE);
-  if (len == 0) {
+
+  // Anything but a regular file (stdin, pipes, FIFOs...) is streamed
+  const bool is_stream = !S_ISREG(file_stat.st_mode);
+  const size_t size = is_stream ? 0 : (size_t)file_stat.st_size;
+  if (!is_stream && size == 0) {
     error("provided file is empty");
     return 1;
   }
 
-  ssize_t file_offset = 0;
-  char *line_buffer = malloc(sizeof(char) * FILE_BUFFER_SIZE);
-  if (!line_buffer) {
-    error("cannot allocate file buffer");
-    return 1;
+  char *source = nullptr;
+  if (is_stream) {
+    source = malloc(STREAM_BUFFER_SIZE);
+    if (!source) {
+      error("cannot allocate stream buffer");
+      return 1;
+    }
+  } else {
+    // The source is read straight from the page cache: it's never copied, and
+    // its size is only bound by the address space
+    source = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, file_descriptor, 0);
+    close(file_descriptor);
+    if (source == MAP_FAILED) {
+      error("cannot map '%s'", file_name);
+      return 1;
+    }
+    posix_madvise(source, size, POSIX_MADV_SEQUENTIAL);
   }
 
   profileInit();
-  arena_t *ast_arena = nullptr;
-  tryCLI(arenaCreate(AST_MEMORY), ast_arena,
+  runtime_t runtime;
+  tryCLI(arenaCreate(AST_MEMORY), runtime.ast_arena,
          "unable to allocate interpreter memory");
 
-  arena_t *temp_arena = nullptr;
-  tryCLI(arenaCreate(TEMP_MEMORY), temp_arena,
+  tryCLI(arenaCreate(TEMP_MEMORY), runtime.temp_arena,
          "unable to allocate transient memory");
 
-  environment_t *global_environment = nullptr;
-  tryCLI(environmentCreate(nullptr), global_environment,
+  tryCLI(internCreate(INTERN_CAPACITY), runtime.intern,
+         "unable to allocate interpreter memory");
+
+  tryCLI(environmentCreate(nullptr), runtime.environment,
          "unable to allocate virtual machine memory");
 
-  do {
-    memset(line_buffer, 0, (size_t)len);
-    readLine(len, line_buffer, file_buffer, &file_offset);
+  gcInit(&runtime.gc, GC_THRESHOLD, GC_GROWTH);
+  runtime.writer = nullptr;
 
-    if (strlen(line_buffer) == 0)
-      continue;
+  if (load_image) {
+    const auto loading =
+        imageLoad(load_image, &runtime.gc, &runtime.environment);
+    if (loading.code != RESULT_OK) {
+      error("%s", loading.message);
+      return 1;
+    }
+  }
 
-    token_list_t *tokens = nullptr;
-    tryRun(tokenize(ast_arena, line_buffer), tokens);
+  int status = 0;
+  if (is_stream) {
+    stream_t stream = {
+        .file_descriptor = file_descriptor,
+        .buffer = source,
+        .size = STREAM_BUFFER_SIZE,
+        .position = {.line = 1, .column = 0},
+        .cursor = {.line = 1, .column = 0},
+    };
+    status = evaluateStream(&stream, &runtime);
+  } else {
+    // Scripts are parsed once per version: later runs read the forms from the
+    // cache directory, unless there's none (see cacheDirectory)
+    char cache_directory[CACHE_PATH_SIZE];
+    const bool caching = cacheDirectory(cache_directory);
+    const uint64_t key = caching ? cacheKey(&file_stat) : 0;
+    char cache_path[CACHE_PATH_SIZE];
+    if (caching)
+      cachePath(cache_path, key, cache_directory);
+
+    cache_t *cache = caching ? cacheLoad(cache_path, key, size) : nullptr;
+    if (cache) {
+      status = evaluateCache(cache, &runtime);
+      cacheClose(&cache);
+    } else {
+      // Caching is best effort: scripts run all the same when it fails
+      if (caching && cacheSettled(&file_stat)) {
+        const auto writer = cacheWriterCreate(cache_path, key, size);
+        runtime.writer = writer.code == RESULT_OK ? writer.value : nullptr;
+      }
+
+      // A single lexer walks the whole file, so each form is read exactly once
+      lexer_t lexer;
+      lexerInit(&lexer, size, source);
+      status = evaluateForms(&lexer, &runtime);
+
+      if (status == 0 && runtime.writer) {
+        (void)cacheCommit(&runtime.writer);
+      } else {
+        cacheAbort(&runtime.writer);
+      }
+    }
+  }
 
-    size_t line_offset = 0;
-    size_t depth = 0;
-    node_t *syntax_tree = nullptr;
-    tryRun(parse(ast_arena, tokens, &line_offset, &depth), syntax_tree);
+  if (status != 0)
+    return status;
 
-    value_t *reduced = nullptr;
-    tryRun(evaluate(temp_arena, syntax_tree, global_environment), reduced);
-  } while (strlen(line_buffer) > 0);
+  if (dump_image) {
+    const auto dumping = imageDump(runtime.environment, dump_image);
+    if (dumping.code != RESULT_OK) {
+      error("%s", dumping.message);
+      return 1;
+    }
+  }
 
   profileReport();
-
-  environmentDestroy(&global_environment);
-  arenaDestroy(&temp_arena);
-  arenaDestroy(&ast_arena);
+  shapesReport();
+  gcReport(&runtime.gc);
+  internReport(runtime.intern);
+
+  environmentDestroy(&runtime.environment);
+  internDestroy(&runtime.intern);
+  arenaDestroy(&runtime.temp_arena);
+  arenaDestroy(&runtime.ast_arena);
+  if (is_stream) {
+    if (!from_stdin)
+      close(file_descriptor);
+    free(source);
+  } else {
+    munmap(source, size);
+  }
   return 0;
 }
 
@@ -0,0 +1,432 @@
+// This is for the CI compiler
+#define _POSIX_C_SOURCE 200809L
+
+#include "../lifp/environment.h"
+#include "../lifp/evaluate.h"
+#include "../lifp/fmt.h"
+#include "../lifp/gc.h"
+#include "../lifp/intern.h"
+#include "../lifp/jit.h"
+#include "../lifp/parse.h"
+#include "../lifp/tokenize.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// Memory allocated for AST parsing
+constexpr size_t AST_MEMORY = (size_t)(1024 * 64);
+
+// Memory allocated for storing transient values across environments
+constexpr size_t TEMP_MEMORY = (size_t)(1024 * 64);
+
+// Distinct lists of a form sharing their elements with equal ones
+constexpr size_t INTERN_CAPACITY = 1024;
+
+// Environment memory in use before the first garbage collection
+constexpr size_t GC_THRESHOLD = (size_t)(1024 * 16);
+
+// Environment memory is kept at least this many times the live data
+constexpr double GC_GROWTH = 2.0;
+
+// Largest script a request can carry
+constexpr size_t REQUEST_SIZE = (size_t)(1024 * 64);
+
+// Largest formatted result: longer ones are truncated
+constexpr size_t RESPONSE_SIZE = (size_t)(1024 * 4);
+
+// Requests evaluated at once, unless told otherwise
+constexpr size_t DEFAULT_WORKERS = 4;
+
+// Requests waiting for a worker, past which clients are refused
+constexpr int CONNECTION_BACKLOG = 256;
+
+// Prefork server
+// ---
+//
+// The standard library and the prelude are set up once, in the server. Then
+// workers are forked: they share the resulting memory copy-on-write, and only
+// pay for the pages they write to. Workers are the concurrency limit: each one
+// serves a request at a time, and the rest wait in the socket backlog.
+//
+// Clients send a script and shut down their side of the connection. They get
+// back whatever the script printed, followed by the formatted value of its
+// last form, or by its error.
+//
+// Requests are isolated: they run on a copy of the global environment left by
+// the prelude, and whatever they allocate is reclaimed right after, closure
+// bodies included. Each copy has a version no previous request used, so that
+// bindings cached by quickened or compiled prelude code are checked again.
+typedef struct {
+  arena_t *ast_arena;
+  arena_t *temp_arena;
+  intern_t *intern;
+  // Global environment the prelude left, which requests copy
+  environment_t *prelude;
+  // Code region offset past the prelude closure bodies
+  size_t code_offset;
+  // Version of the environment of the next request
+  size_t version;
+  char *request;
+  char response[RESPONSE_SIZE];
+} server_t;
+
+#define error(Fmt, ...)                                                        \
+  {                                                                            \
+    fprintf(stderr, "lifp: ");                                                 \
+    fprintf(stderr, Fmt __VA_OPT__(, ) __VA_ARGS__);                           \
+    fprintf(stderr, "\n");                                                     \
+  }
+
+#define tryCLI(Action, Destination, ErrorMessage)                              \
+  auto _concat(result, __LINE__) = Action;                                     \
+  if (_concat(result, __LINE__).code != RESULT_OK) {                           \
+    error("%s", ErrorMessage);                                                 \
+    return 1;                                                                  \
+  }                                                                            \
+  (Destination) = _concat(result, __LINE__).value;
+
+// Leaves the error in the response, and bails out of the evaluation
+#define tryRespond(Action, Destination)                                        \
+  auto _concat(result, __LINE__) = Action;                                     \
+  if (_concat(result, __LINE__).code != RESULT_OK) {                           \
+    snprintf(self->response, RESPONSE_SIZE, "lifp: %s",                        \
+             _concat(result, __LINE__).message);                               \
+    return false;                                                              \
+  }                                                                            \
+  (Destination) = _concat(result, __LINE__).value;
+
+// Evaluates all the forms of `source`, like `run` does. The response holds
+// the formatted value of the last one, or the error that stopped evaluation.
+static bool evaluateSource(server_t *self, size_t size, const char *source,
+                           gc_t *gc, environment_t **environment) {
+  snprintf(self->response, RESPONSE_SIZE, "nil");
+
+  lexer_t lexer;
+  lexerInit(&lexer, size, source);
+  while (true) {
+    node_t *syntax_tree = nullptr;
+    tryRespond(parseNextInterned(self->ast_arena, &lexer, self->intern),
+               syntax_tree);
+
+    if (!syntax_tree)
+      return true;
+
+    const auto optimization =
+        optimize(self->ast_arena, syntax_tree, *environment);
+    if (optimization.code != RESULT_OK) {
+      snprintf(self->response, RESPONSE_SIZE, "lifp: %s",
+               optimization.message);
+      return false;
+    }
+    escapeAnalyze(syntax_tree);
+
+    value_t *reduced = nullptr;
+    tryRespond(evaluate(self->temp_arena, syntax_tree, *environment),
+               reduced);
+
+    int offset = 0;
+    formatValue(reduced, RESPONSE_SIZE, self->response, &offset);
+
+    arenaReset(self->temp_arena);
+    arenaReset(self->ast_arena);
+    internReset(self->intern);
+
+    const auto collection = gcMaybeCollect(gc, environment);
+    if (collection.code != RESULT_OK) {
+      snprintf(self->response, RESPONSE_SIZE, "lifp: %s", collection.message);
+      return false;
+    }
+  }
+}
+
+// Reads the script of a request, up to the end of the client's stream
+static bool readRequest(server_t *self, int client, size_t *size) {
+  *size = 0;
+  while (true) {
+    // Once the buffer is full, the request only fits if nothing is left
+    char overflow;
+    const bool full = *size == REQUEST_SIZE;
+    const ssize_t bytes_read =
+        full ? read(client, &overflow, 1)
+             : read(client, &self->request[*size], REQUEST_SIZE - *size);
+    if (bytes_read < 0 && errno == EINTR)
+      continue;
+
+    if (bytes_read < 0) {
+      snprintf(self->response, RESPONSE_SIZE, "lifp: cannot read request");
+      return false;
+    }
+
+    if (bytes_read == 0)
+      return true;
+
+    if (full) {
+      snprintf(self->response, RESPONSE_SIZE,
+               "lifp: request exceeds %lu bytes", REQUEST_SIZE);
+      return false;
+    }
+
+    *size += (size_t)bytes_read;
+  }
+}
+
+static void writeAll(int client, const char *buffer, size_t size) {
+  while (size > 0) {
+    const ssize_t written = write(client, buffer, size);
+    if (written < 0 && errno == EINTR)
+      continue;
+    if (written <= 0)
+      return;
+    buffer += written;
+    size -= (size_t)written;
+  }
+}
+
+static void serve(server_t *self, int client) {
+  size_t size = 0;
+  if (readRequest(self, client, &size)) {
+    environment_t *environment = nullptr;
+    const auto copy = gcCopy(self->prelude);
+    if (copy.code == RESULT_OK) {
+      environment = copy.value;
+      environment->version = self->version;
+
+      gc_t gc;
+      gcInit(&gc, GC_THRESHOLD, GC_GROWTH);
+
+      // Scripts print to the client, right before their result
+      fflush(stdout);
+      const int output = dup(STDOUT_FILENO);
+      dup2(client, STDOUT_FILENO);
+      evaluateSource(self, size, self->request, &gc, &environment);
+      fflush(stdout);
+      dup2(output, STDOUT_FILENO);
+      close(output);
+
+      self->version = environment->version + 1;
+      gcRelease(&environment);
+    } else {
+      snprintf(self->response, RESPONSE_SIZE, "lifp: %s", copy.message);
+    }
+  }
+
+  // Nothing the request allocated outlives it, code compiled from its bodies
+  // included
+  arenaRewind(self->prelude->code, self->code_offset);
+#ifdef JIT
+  jitForget(self->prelude->jit, self->prelude->code);
+#endif
+  arenaReset(self->temp_arena);
+  arenaReset(self->ast_arena);
+  internReset(self->intern);
+
+  writeAll(client, self->response, strlen(self->response));
+  writeAll(client, "\n", 1);
+  close(client);
+}
+
+static void work(server_t *self, int listener) {
+  // Clients hanging up early only fail their own writes
+  signal(SIGPIPE, SIG_IGN);
+  signal(SIGINT, SIG_DFL);
+  signal(SIGTERM, SIG_DFL);
+
+  while (true) {
+    const int client = accept(listener, nullptr, nullptr);
+    if (client < 0 && errno == EINTR)
+      continue;
+
+    if (client < 0) {
+      error("cannot accept connections");
+      _exit(1);
+    }
+
+    serve(self, client);
+  }
+}
+
+static volatile sig_atomic_t stopping = 0;
+
+static void stop(int signal_number) {
+  (void)signal_number;
+  stopping = 1;
+}
+
+static pid_t spawn(server_t *self, int listener) {
+  const pid_t pid = fork();
+  if (pid == 0)
+    work(self, listener);
+  return pid;
+}
+
+static int listenOn(const char *path) {
+  struct sockaddr_un address = {.sun_family = AF_UNIX};
+  if (strlen(path) >= sizeof(address.sun_path)) {
+    error("socket path '%s' is too long", path);
+    return -1;
+  }
+  strcpy(address.sun_path, path);
+
+  const int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (listener < 0) {
+    error("cannot create socket");
+    return -1;
+  }
+
+  unlink(path);
+  if (bind(listener, (struct sockaddr *)&address, sizeof(address)) < 0 ||
+      listen(listener, CONNECTION_BACKLOG) < 0) {
+    error("cannot listen on '%s'", path);
+    close(listener);
+    return -1;
+  }
+  return listener;
+}
+
+// Reads the whole prelude: it's evaluated once, so it's not worth mapping
+static char *readPrelude(const char *path, size_t *size) {
+  const int file_descriptor = open(path, O_RDONLY);
+  struct stat file_stat;
+  if (file_descriptor < 0 || fstat(file_descriptor, &file_stat) < 0) {
+    if (file_descriptor >= 0)
+      close(file_descriptor);
+    return nullptr;
+  }
+
+  *size = (size_t)file_stat.st_size;
+  char *source = malloc(*size);
+  size_t filled = 0;
+  while (source && filled < *size) {
+    const ssize_t bytes_read = read(file_descriptor, &source[filled],
+                                    *size - filled);
+    if (bytes_read <= 0) {
+      free(source);
+      source = nullptr;
+      break;
+    }
+    filled += (size_t)bytes_read;
+  }
+  close(file_descriptor);
+  return source;
+}
+
+int main(int argc, char **argv) {
+  size_t workers = DEFAULT_WORKERS;
+  int argument = 1;
+  if (argument + 1 < argc && strcmp(argv[argument], "--workers") == 0) {
+    const long parsed = strtol(argv[argument + 1], nullptr, 10);
+    workers = parsed > 0 ? (size_t)parsed : 0;
+    argument += 2;
+  }
+
+  if (workers == 0 || argc - argument < 1 || argc - argument > 2) {
+    error("usage: server [--workers <count>] <socket> [<prelude>]");
+    return 1;
+  }
+
+  const char *socket_path = argv[argument];
+  const char *prelude_path =
+      argc - argument == 2 ? argv[argument + 1] : nullptr;
+
+  server_t server = {};
+  tryCLI(arenaCreate(AST_MEMORY), server.ast_arena,
+         "unable to allocate interpreter memory");
+
+  tryCLI(arenaCreate(TEMP_MEMORY), server.temp_arena,
+         "unable to allocate transient memory");
+
+  tryCLI(internCreate(INTERN_CAPACITY), server.intern,
+         "unable to allocate interpreter memory");
+
+  tryCLI(environmentCreate(nullptr), server.prelude,
+         "unable to allocate virtual machine memory");
+
+  server.request = malloc(REQUEST_SIZE);
+  if (!server.request) {
+    error("unable to allocate request memory");
+    return 1;
+  }
+
+  if (prelude_path) {
+    size_t size = 0;
+    char *source = readPrelude(prelude_path, &size);
+    if (!source) {
+      error("cannot read '%s'", prelude_path);
+      return 1;
+    }
+
+    gc_t gc;
+    gcInit(&gc, GC_THRESHOLD, GC_GROWTH);
+    const bool evaluated =
+        evaluateSource(&server, size, source, &gc, &server.prelude);
+    free(source);
+    if (!evaluated) {
+      fprintf(stderr, "%s\n", server.response);
+      return 1;
+    }
+  }
+  server.code_offset = arenaOffset(server.prelude->code);
+  server.version = server.prelude->version + 1;
+
+  const int listener = listenOn(socket_path);
+  if (listener < 0)
+    return 1;
+
+  const struct sigaction action = {.sa_handler = stop};
+  sigaction(SIGINT, &action, nullptr);
+  sigaction(SIGTERM, &action, nullptr);
+
+  pid_t *pids = calloc(workers, sizeof(pid_t));
+  if (!pids) {
+    error("unable to allocate workers");
+    return 1;
+  }
+
+  for (size_t i = 0; i < workers; i++) {
+    pids[i] = spawn(&server, listener);
+  }
+
+  // Workers dying, whatever the reason, are replaced by fresh ones
+  while (!stopping) {
+    const pid_t pid = waitpid(-1, nullptr, 0);
+    if (pid <= 0)
+      continue;
+
+    for (size_t i = 0; i < workers && !stopping; i++) {
+      if (pids[i] == pid) {
+        pids[i] = spawn(&server, listener);
+      }
+    }
+  }
+
+  for (size_t i = 0; i < workers; i++) {
+    if (pids[i] > 0)
+      kill(pids[i], SIGTERM);
+  }
+  while (waitpid(-1, nullptr, 0) > 0)
+    ;
+
+  close(listener);
+  unlink(socket_path);
+  free(pids);
+  free(server.request);
+  environmentDestroy(&server.prelude);
+  internDestroy(&server.intern);
+  arenaDestroy(&server.temp_arena);
+  arenaDestroy(&server.ast_arena);
+  return 0;
+}
+
+#undef tryRespond
+#undef tryCLI
+#undef error
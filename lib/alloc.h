@@ -14,36 +14,39 @@ typedef struct {
   bool freed[MAX_SEGMENTS];
 } safe_alloc_metrics_t;
 
-extern safe_alloc_metrics_t safe_alloc_metrics;
+// Metrics of the profile in use on the calling thread (see profile.h)
+safe_alloc_metrics_t *allocMetrics(void);
 
 #define allocProfileStart(Pointer, Size)                                       \
-  if (safe_alloc_metrics.segments_count < MAX_SEGMENTS) {                      \
-    safe_alloc_metrics.pointers[safe_alloc_metrics.segments_count] = Pointer;  \
-    safe_alloc_metrics.sizes[safe_alloc_metrics.segments_count] = Size;        \
-    safe_alloc_metrics.freed[safe_alloc_metrics.segments_count] = false;       \
-    safe_alloc_metrics.segments_count++;                                       \
-    safe_alloc_metrics.bytes += (Size);                                        \
+  {                                                                            \
+    safe_alloc_metrics_t *_metrics = allocMetrics();                           \
+    if (_metrics->segments_count < MAX_SEGMENTS) {                             \
+      _metrics->pointers[_metrics->segments_count] = Pointer;                  \
+      _metrics->sizes[_metrics->segments_count] = Size;                        \
+      _metrics->freed[_metrics->segments_count] = false;                       \
+      _metrics->segments_count++;                                              \
+      _metrics->bytes += (Size);                                               \
+    }                                                                          \
   }
 
 #define allocProfileEnd(DoublePointer)                                         \
-  for (unsigned long i = 0; i < safe_alloc_metrics.segments_count; i++) {      \
-    if (*(DoublePointer) == safe_alloc_metrics.pointers[i] &&                  \
-        !safe_alloc_metrics.freed[i]) {                                        \
-      safe_alloc_metrics.bytes -= safe_alloc_metrics.sizes[i];                 \
-      safe_alloc_metrics.freed[i] = true;                                      \
+  {                                                                            \
+    safe_alloc_metrics_t *_metrics = allocMetrics();                           \
+    for (unsigned long i = 0; i < _metrics->segments_count; i++) {             \
+      if (*(DoublePointer) == _metrics->pointers[i] && !_metrics->freed[i]) {  \
+        _metrics->bytes -= _metrics->sizes[i];                                 \
+        _metrics->freed[i] = true;                                             \
+      }                                                                        \
     }                                                                          \
   }
 
-#define allocGetMetrics() safe_alloc_metrics
-
-#define allocMetricsInit() safe_alloc_metrics_t safe_alloc_metrics = {}
+#define allocGetMetrics() (*allocMetrics())
 
 #else
 
 #define allocProfileStart(Pointer, Size)
 #define allocProfileEnd(DoublePointer)
 #define allocGetMetrics()
-#define allocMetricsInit()
 
 #endif
 
@@ -1,30 +1,42 @@
 #include "arena.h"
 #include "alloc.h"
 #include "result.h"
+#include <assert.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 #ifdef MEMORY_PROFILE
-arena_metrics_t arena_metrics = {};
-
+// Arenas past MAX_PROFILED_ARENAS (e.g., collected environments) are untracked
 #define arenaProfileStart(Arena)                                               \
-  arena_metrics.arenas[arena_metrics.arenas_count] = Arena;                    \
-  arena_metrics.freed[arena_metrics.arenas_count] = false;                     \
-  arena_metrics.arenas_count++;
+  {                                                                            \
+    arena_metrics_t *_metrics = arenaMetrics();                                \
+    if (_metrics->arenas_count < MAX_PROFILED_ARENAS) {                        \
+      _metrics->arenas[_metrics->arenas_count] = Arena;                        \
+      _metrics->freed[_metrics->arenas_count] = false;                         \
+      _metrics->arenas_count++;                                                \
+    }                                                                          \
+  }
 
 #define arenaProfileEnd(Arena)                                                 \
-  for (size_t i = 0; i < arena_metrics.arenas_count; i++) {                    \
-    if (arena_metrics.arenas[i] == Arena) {                                    \
-      arena_metrics.freed[i] = true;                                           \
-      break;                                                                   \
+  {                                                                            \
+    arena_metrics_t *_metrics = arenaMetrics();                                \
+    for (size_t i = 0; i < _metrics->arenas_count; i++) {                      \
+      if (_metrics->arenas[i] == Arena) {                                      \
+        _metrics->freed[i] = true;                                             \
+        break;                                                                 \
+      }                                                                        \
     }                                                                          \
   }
 
+#define arenaProfileAllocate(Size) arenaMetrics()->allocated += Size;
+
 #else
 
 #define arenaProfileStart(Arena)
 #define arenaProfileEnd(Arena)
+#define arenaProfileAllocate(Size)
 
 #endif
 
@@ -33,16 +45,39 @@ result_ref_t arenaCreate(size_t size) {
   try(result_ref_t, allocSafe(sizeof(arena_t) + size), arena);
   arena->size = size;
   arena->offset = 0;
+  arena->grows = false;
+  arena->next = nullptr;
 
   arenaProfileStart(arena);
 
   return ok(result_ref_t, arena);
 }
 
+result_ref_t arenaCreateGrowable(size_t size) {
+  arena_t *arena = nullptr;
+  try(result_ref_t, arenaCreate(size), arena);
+  arena->grows = true;
+  return ok(result_ref_t, arena);
+}
+
 result_ref_t arenaAllocate(arena_t *self, size_t size) {
+  // Chunks are only ever grown when full: allocations go to the last one
+  if (self->next)
+    return arenaAllocate(self->next, size);
+
   const size_t aligned_offset = (self->offset + 7U) & ~7U;
   const size_t aligned_size = (size + 7U) & ~7U;
 
+  if (aligned_offset + aligned_size > self->size && self->grows) {
+    size_t chunk_size = self->size * 2;
+    while (chunk_size < aligned_size) {
+      chunk_size *= 2;
+    }
+
+    try(result_ref_t, arenaCreateGrowable(chunk_size), self->next);
+    return arenaAllocate(self->next, size);
+  }
+
   if (aligned_offset + aligned_size > self->size) {
     throw(result_ref_t, ARENA_ERROR_OUT_OF_SPACE, nullptr,
           "Arena out of memory. Available %lu, requested %lu",
@@ -52,12 +87,46 @@ result_ref_t arenaAllocate(arena_t *self, size_t size) {
   byte_t *pointer = &self->memory[aligned_offset];
   memset(pointer, 0, aligned_size);
   self->offset = aligned_offset + aligned_size;
+
+  arenaProfileAllocate(aligned_size);
   return ok(result_ref_t, pointer);
 }
 
 void arenaDestroy(arena_t **self) {
+  if ((*self)->next)
+    arenaDestroy(&(*self)->next);
+
   arenaProfileEnd(*self);
   deallocSafe(self);
 }
 
-void arenaReset(arena_t *self) { self->offset = 0; }
+// Offsets past the first chunk count the whole size of the chunks before
+size_t arenaOffset(const arena_t *self) {
+  return self->next ? self->size + arenaOffset(self->next) : self->offset;
+}
+
+void arenaReset(arena_t *self) {
+  if (self->next)
+    arenaDestroy(&self->next);
+  self->offset = 0;
+}
+
+void arenaRewind(arena_t *self, size_t offset) {
+  if (self->next && offset >= self->size) {
+    arenaRewind(self->next, offset - self->size);
+    return;
+  }
+
+  assert(offset <= self->offset);
+  if (self->next)
+    arenaDestroy(&self->next);
+  self->offset = offset;
+}
+
+bool arenaOwns(const arena_t *self, const void *pointer) {
+  const uintptr_t address = (uintptr_t)pointer;
+  const uintptr_t start = (uintptr_t)self->memory;
+  if (address >= start && address < start + self->offset)
+    return true;
+  return self->next && arenaOwns(self->next, pointer);
+}
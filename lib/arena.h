@@ -51,9 +51,13 @@ typedef enum {
  * Arena allocator structure.
  * @name arena_t
  */
-typedef struct {
-  size_t size;     // Total size of the arena memory buffer
-  size_t offset;   // Current allocation offset within the buffer
+typedef struct arena_t {
+  size_t size;   // Total size of the arena memory buffer
+  size_t offset; // Current allocation offset within the buffer
+  // Growable arenas chain the chunks they grew by, which hold the allocations
+  // that didn't fit
+  bool grows;
+  struct arena_t *next;
   byte_t memory[]; // Flexible array member containing the actual memory buffer
 } arena_t;
 
@@ -64,9 +68,11 @@ typedef struct {
   arena_t *arenas[MAX_PROFILED_ARENAS];
   bool freed[MAX_PROFILED_ARENAS];
   size_t arenas_count;
+  size_t allocated; // Bytes handed out by all arenas
 } arena_metrics_t;
 
-extern arena_metrics_t arena_metrics;
+// Metrics of the profile in use on the calling thread (see profile.h)
+arena_metrics_t *arenaMetrics(void);
 #endif
 
 /**
@@ -85,6 +91,23 @@ extern arena_metrics_t arena_metrics;
  */
 result_ref_t arenaCreate(size_t size);
 
+/**
+ * Create a new arena that grows instead of running out of space: once full,
+ * allocations go to a new chunk twice as big. Allocated memory never moves.
+ * @name arenaCreateGrowable
+ * @param {size_t} size - The size in bytes of the arena's first chunk
+ * @returns {result_ref_t} Result containing the arena pointer on success, or
+ * an allocation error
+ * @example
+ *   result_ref_t result = arenaCreateGrowable(1024);
+ *   if (result.ok) {
+ *       arena_t *arena = result.value;
+ *       arenaAllocate(arena, 4096);  // Succeeds, on a chunk of 4096 bytes
+ *       arenaDestroy(arena);
+ *   }
+ */
+result_ref_t arenaCreateGrowable(size_t size);
+
 /**
  * Allocate memory from the arena.
  * @name arenaAllocate
@@ -110,6 +133,19 @@ result_ref_t arenaAllocate(arena_t *self, size_t size);
  */
 void arenaDestroy(arena_t **self);
 
+/**
+ * Get the offset past the last allocation, across all the chunks of the arena.
+ * Same as `self->offset` on arenas that never grew.
+ * @name arenaOffset
+ * @param {arena_t*} self - Pointer to the arena
+ * @returns {size_t} Offset to rewind the arena to later
+ * @example
+ *   size_t offset = arenaOffset(arena);
+ *   arenaAllocate(arena, 200);
+ *   arenaRewind(arena, offset);  // Releases the chunks grown since, if any
+ */
+size_t arenaOffset(const arena_t *self);
+
 /**
  * Reset the arena to empty state.
  * @name arenaReset
@@ -120,3 +156,30 @@ void arenaDestroy(arena_t **self);
  *   arenaReset(arena);  // All memory now available again
  */
 void arenaReset(arena_t *self);
+
+/**
+ * Rewind the arena to a previous offset, releasing all the memory allocated
+ * after it.
+ * @name arenaRewind
+ * @param {arena_t*} self - Pointer to the arena to rewind
+ * @param {size_t} offset - Offset to rewind to, as read from `self->offset`,
+ * or from arenaOffset on growable arenas
+ * @example
+ *   arenaAllocate(arena, 100);
+ *   size_t offset = arena->offset;
+ *   arenaAllocate(arena, 200);
+ *   arenaRewind(arena, offset);  // Only the last 200 bytes are available again
+ */
+void arenaRewind(arena_t *self, size_t offset);
+
+/**
+ * Check whether a pointer references memory allocated on the arena.
+ * @name arenaOwns
+ * @param {arena_t*} self - Pointer to the arena
+ * @param {void*} pointer - Pointer to check
+ * @returns {bool} True if the pointer is within the allocated memory
+ * @example
+ *   result_ref_t result = arenaAllocate(arena, 100);
+ *   arenaOwns(arena, result.value);  // true
+ */
+bool arenaOwns(const arena_t *self, const void *pointer);
@@ -87,6 +87,7 @@ result_void_t genericMapSet(generic_map_t *self, const char *key, void *value) {
       auto used = self->used;
       auto keys = self->keys;
       auto values = self->values;
+      const size_t previous_capacity = self->capacity;
       size_t capacity = self->capacity * 2;
 
       try(result_void_t, arenaAllocate(self->arena, sizeof(bool) * capacity),
@@ -97,13 +98,15 @@ result_void_t genericMapSet(generic_map_t *self, const char *key, void *value) {
       try(result_void_t, arenaAllocate(self->arena, self->item_size * capacity),
           self->values);
 
-      for (size_t i = 0; i < self->capacity; i++) {
+      // Entries are placed by the new capacity, or lookups would miss them
+      self->capacity = capacity;
+      self->count = 0;
+      for (size_t i = 0; i < previous_capacity; i++) {
         if (used[i]) {
           byte_t *destination = (byte_t *)values + (i * self->item_size);
-          genericMapSet(self, keys[i], destination);
+          try(result_void_t, genericMapSet(self, keys[i], destination));
         }
       }
-      self->capacity = capacity;
       return genericMapSet(self, key, value);
     }
   }
@@ -9,11 +9,24 @@
 #include <stdio.h>
 #include <string.h>
 
-span_t *CURRENT_SAFE_ALLOC_SPAN = nullptr;
-span_t *ROOT_SAFE_ALLOC_SPAN = nullptr;
+// Threads profile on their own, so that code running concurrently doesn't
+// race on the metrics
+static thread_local profile_t thread_profile = {};
+static thread_local profile_t *current_profile = nullptr;
 
-span_t *CURRENT_ARENA_SPAN = nullptr;
-span_t *ROOT_ARENA_SPAN = nullptr;
+static profile_t *profile(void) {
+  return current_profile ? current_profile : &thread_profile;
+}
+
+profile_t *profileUse(profile_t *next) {
+  profile_t *previous = current_profile;
+  current_profile = next;
+  return previous;
+}
+
+safe_alloc_metrics_t *allocMetrics(void) { return &profile()->safe_alloc; }
+
+arena_metrics_t *arenaMetrics(void) { return &profile()->arena; }
 
 static unsigned long getAllocatedBytes(void) { return allocGetMetrics().bytes; }
 
@@ -58,23 +71,26 @@ static void spanFree(span_t **span) {
 }
 
 void profileInit(void) {
-  CURRENT_SAFE_ALLOC_SPAN = spanCreate("root");
-  ROOT_SAFE_ALLOC_SPAN = CURRENT_SAFE_ALLOC_SPAN;
+  profile_t *self = profile();
+  self->current_safe_alloc_span = spanCreate("root");
+  self->root_safe_alloc_span = self->current_safe_alloc_span;
 
-  CURRENT_ARENA_SPAN = spanCreate("root");
-  ROOT_ARENA_SPAN = CURRENT_ARENA_SPAN;
+  self->current_arena_span = spanCreate("root");
+  self->root_arena_span = self->current_arena_span;
 
-  ROOT_SAFE_ALLOC_SPAN->hits = 1; // prevent division by zero
-  ROOT_ARENA_SPAN->hits = 1;      // prevent division by zero
+  self->root_safe_alloc_span->hits = 1; // prevent division by zero
+  self->root_arena_span->hits = 1;      // prevent division by zero
 }
 
 span_t *safeAllocSpanStart(const char *label) {
-  assert(CURRENT_SAFE_ALLOC_SPAN);
+  profile_t *self = profile();
+  span_t *current = self->current_safe_alloc_span;
+  assert(current);
   const unsigned long span_id = hash(label);
 
   span_t *span = nullptr;
-  for (unsigned long i = 0; i < CURRENT_SAFE_ALLOC_SPAN->subspans_count; i++) {
-    span_t *subspan = CURRENT_SAFE_ALLOC_SPAN->subspans[i];
+  for (unsigned long i = 0; i < current->subspans_count; i++) {
+    span_t *subspan = current->subspans[i];
     if (subspan->span_id == span_id && strcmp(label, subspan->label) == 0) {
       span = subspan;
     }
@@ -82,31 +98,32 @@ span_t *safeAllocSpanStart(const char *label) {
 
   if (!span) {
     span = spanCreate(label);
-    if (CURRENT_SAFE_ALLOC_SPAN->subspans_count < MAX_SUBSPAN) {
-      CURRENT_SAFE_ALLOC_SPAN
-          ->subspans[CURRENT_SAFE_ALLOC_SPAN->subspans_count] = span;
-      CURRENT_SAFE_ALLOC_SPAN->subspans_count++;
+    if (current->subspans_count < MAX_SUBSPAN) {
+      current->subspans[current->subspans_count] = span;
+      current->subspans_count++;
     } else {
       printf("Profiling error: Maximum subspans (%lu) reached for span '%s'\n",
-             MAX_SUBSPAN, CURRENT_SAFE_ALLOC_SPAN->label);
+             MAX_SUBSPAN, current->label);
       return nullptr;
     }
   }
 
   span->hits++;
   span->last = getAllocatedBytes();
-  span->parent = CURRENT_SAFE_ALLOC_SPAN;
-  CURRENT_SAFE_ALLOC_SPAN = span;
+  span->parent = current;
+  self->current_safe_alloc_span = span;
   return span;
 }
 
 span_t *arenaSpanStart(arena_t *arena, const char *label) {
-  assert(CURRENT_ARENA_SPAN);
+  profile_t *self = profile();
+  span_t *current = self->current_arena_span;
+  assert(current);
   const unsigned long span_id = hash(label);
 
   span_t *span = nullptr;
-  for (unsigned long i = 0; i < CURRENT_ARENA_SPAN->subspans_count; i++) {
-    span_t *subspan = CURRENT_ARENA_SPAN->subspans[i];
+  for (unsigned long i = 0; i < current->subspans_count; i++) {
+    span_t *subspan = current->subspans[i];
     if (subspan->span_id == span_id && strcmp(label, subspan->label) == 0) {
       span = subspan;
     }
@@ -114,21 +131,21 @@ span_t *arenaSpanStart(arena_t *arena, const char *label) {
 
   if (!span) {
     span = spanCreate(label);
-    if (CURRENT_ARENA_SPAN->subspans_count < MAX_SUBSPAN) {
-      CURRENT_ARENA_SPAN->subspans[CURRENT_ARENA_SPAN->subspans_count] = span;
-      CURRENT_ARENA_SPAN->subspans_count++;
+    if (current->subspans_count < MAX_SUBSPAN) {
+      current->subspans[current->subspans_count] = span;
+      current->subspans_count++;
     } else {
       printf("Profiling error: Maximum subspans (%lu) reached for span '%s'\n",
-             MAX_SUBSPAN, CURRENT_ARENA_SPAN->label);
+             MAX_SUBSPAN, current->label);
       return nullptr;
     }
   }
 
   span->hits++;
   span->last = arena->offset;
-  span->parent = CURRENT_ARENA_SPAN;
+  span->parent = current;
   span->payload = arena;
-  CURRENT_ARENA_SPAN = span;
+  self->current_arena_span = span;
   return span;
 }
 
@@ -141,7 +158,7 @@ void safeAllocSpanEnd(span_t **span_double_ref) {
     span->parent->total += delta;
   }
 
-  CURRENT_SAFE_ALLOC_SPAN = span->parent;
+  profile()->current_safe_alloc_span = span->parent;
 }
 
 void arenaSpanEnd(span_t **span_double_ref) {
@@ -154,7 +171,21 @@ void arenaSpanEnd(span_t **span_double_ref) {
     span->parent->total += delta;
   }
 
-  CURRENT_ARENA_SPAN = span->parent;
+  profile()->current_arena_span = span->parent;
+}
+
+void profileNursery(unsigned long allocated, unsigned long promoted) {
+  profile_t *self = profile();
+  self->nursery.evacuations++;
+  self->nursery.allocated += allocated;
+  self->nursery.promoted += promoted;
+}
+
+void profileEscape(unsigned long avoided, unsigned long reclaimed) {
+  profile_t *self = profile();
+  self->escape.values++;
+  self->escape.avoided += avoided;
+  self->escape.reclaimed += reclaimed;
 }
 
 void printSpan(const span_t *span, int indentation) {
@@ -169,11 +200,11 @@ void printSpan(const span_t *span, int indentation) {
   }
 }
 
-void printArenas(void) {
+void printArenas(const arena_metrics_t *metrics) {
   size_t freed = 0;
-  for (size_t i = 0; i < arena_metrics.arenas_count; i++) {
-    arena_t *arena = arena_metrics.arenas[i];
-    if (arena_metrics.freed[i]) {
+  for (size_t i = 0; i < metrics->arenas_count; i++) {
+    arena_t *arena = metrics->arenas[i];
+    if (metrics->freed[i]) {
       freed++;
     } else {
       printf("    arena[%lu]: %lu/%lu bytes (%0.2f%%)\n", i, arena->offset,
@@ -186,28 +217,58 @@ void printArenas(void) {
          "    Stats:\n"
          "      tracked:   %lu arenas\n"
          "      destroyed: %lu arenas\n",
-         arena_metrics.arenas_count, freed);
+         metrics->arenas_count, freed);
 }
 
 void profileReport(void) {
-  if (ROOT_SAFE_ALLOC_SPAN) {
+  const profile_t *self = profile();
+  if (self->root_safe_alloc_span) {
     printf("\n === Memory Metrics: Leaked safeAlloc ===\n");
-    printSpan(ROOT_SAFE_ALLOC_SPAN, 0);
+    printSpan(self->root_safe_alloc_span, 0);
   }
 
-  if (ROOT_ARENA_SPAN) {
+  if (self->root_arena_span) {
     printf("\n === Memory Metrics: Arena Allocations ===\n");
-    printSpan(ROOT_ARENA_SPAN, 0);
+    printSpan(self->root_arena_span, 0);
 
     printf("\n === Memory Metrics: Arena Saturation ===\n");
-    printArenas();
+    printArenas(&self->arena);
+  }
+
+  if (self->nursery.evacuations > 0) {
+    const double evacuations = (double)self->nursery.evacuations;
+    const double allocated = (double)self->nursery.allocated;
+    printf("\n === Memory Metrics: Nursery ===\n"
+           "    evacuations: %lu\n"
+           "    allocated:   %lu bytes (%0.2f bytes/evacuation)\n"
+           "    promoted:    %lu bytes (%0.2f%%)\n",
+           self->nursery.evacuations, self->nursery.allocated,
+           allocated / evacuations, self->nursery.promoted,
+           allocated > 0 ? (double)self->nursery.promoted * 100 / allocated
+                         : 0);
+  }
+
+  if (self->escape.values > 0) {
+    // Avoided bytes would have been allocated on top of the tracked ones
+    const unsigned long eliminated =
+        self->escape.avoided + self->escape.reclaimed;
+    const unsigned long requested =
+        self->arena.allocated + self->escape.avoided;
+    printf("\n === Memory Metrics: Escape Analysis ===\n"
+           "    frame-local: %lu values\n"
+           "    avoided:     %lu bytes\n"
+           "    reclaimed:   %lu bytes\n"
+           "    eliminated:  %0.2f%% of arena allocations\n",
+           self->escape.values, self->escape.avoided, self->escape.reclaimed,
+           requested > 0 ? (double)eliminated * 100 / (double)requested : 0);
   }
 }
 
 void profileEnd(void) {
-  spanFree(&ROOT_SAFE_ALLOC_SPAN);
-  CURRENT_SAFE_ALLOC_SPAN = nullptr;
-  spanFree(&ROOT_ARENA_SPAN);
-  CURRENT_ARENA_SPAN = nullptr;
+  profile_t *self = profile();
+  spanFree(&self->root_safe_alloc_span);
+  self->current_safe_alloc_span = nullptr;
+  spanFree(&self->root_arena_span);
+  self->current_arena_span = nullptr;
 }
 #endif
@@ -43,8 +43,40 @@
 // }
 // ```
 //
+// Alongside spans, `nursery` counts how much of the memory allocated in a
+// short-lived region survives it, when the region is evacuated
+//
+// ```c
+// size_t frame = arena->offset;
+//   // allocate temporaries, evacuate survivors
+// profileNursery(allocated_bytes, survived_bytes);
+// ```
+//
+// `escape` counts the arena memory that values proven not to escape their
+// frame didn't need: either it was never allocated, or it was released
+// right after use. It is reported against all arena allocations.
+//
+// ```c
+// profileEscape(avoided_bytes, reclaimed_bytes);
+// ```
+//
+// All of the above is recorded in a profile. Each thread has its own, which
+// owners of other profiles (e.g., interpreters embedded in a host) swap in
+// while they run, so that their metrics are kept apart.
+//
+// ```c
+// profile_t profile = {};
+// profile_t *previous = profileUse(&profile);
+// profileInit();
+//   // profiled code
+// profileReport();
+// profileEnd();
+// profileUse(previous);
+// ```
+//
 
 #ifdef MEMORY_PROFILE
+#include "alloc.h"
 #include "arena.h"
 #include "result.h"
 
@@ -63,6 +95,32 @@ typedef struct span_t {
   void *payload;
 } span_t;
 
+typedef struct profile_t {
+  safe_alloc_metrics_t safe_alloc;
+  arena_metrics_t arena;
+
+  span_t *current_safe_alloc_span;
+  span_t *root_safe_alloc_span;
+  span_t *current_arena_span;
+  span_t *root_arena_span;
+
+  struct {
+    unsigned long evacuations;
+    unsigned long allocated;
+    unsigned long promoted;
+  } nursery;
+
+  struct {
+    unsigned long values;
+    unsigned long avoided;
+    unsigned long reclaimed;
+  } escape;
+} profile_t;
+
+// Records the calling thread's metrics in `profile` from now on, or in its own
+// profile when null. Returns the profile in use before.
+profile_t *profileUse(profile_t *profile);
+
 void profileInit(void);
 void profileReport(void);
 void profileEnd(void);
@@ -71,6 +129,8 @@ span_t *safeAllocSpanStart(const char *label);
 void safeAllocSpanEnd(span_t **span_double_ref);
 span_t *arenaSpanStart(arena_t *arena, const char *label);
 void arenaSpanEnd(span_t **span_double_ref);
+void profileNursery(unsigned long allocated, unsigned long promoted);
+void profileEscape(unsigned long avoided, unsigned long reclaimed);
 
 #define profileSafeAlloc()                                                     \
   span_t *_concat(metrics_, __LINE__)                                          \
@@ -94,5 +154,7 @@ void arenaSpanEnd(span_t **span_double_ref);
 
 #define profileSafeAlloc()
 #define profileArena(Arena)
+#define profileNursery(Allocated, Promoted)
+#define profileEscape(Avoided, Reclaimed)
 
 #endif
@@ -0,0 +1,343 @@
+// This is for the CI compiler
+#define _POSIX_C_SOURCE 200809L
+
+#include "cache.h"
+#include "../lib/alloc.h"
+#include "../lib/list.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+constexpr char CACHE_MAGIC[8] = "lifpc";
+
+// Bumped whenever records, or what the parser makes of a source, change
+constexpr uint64_t CACHE_FORMAT_VERSION = 1;
+
+typedef struct {
+  char magic[8];
+  uint64_t format; // See cacheFormat
+  uint64_t key;   // See cacheKey
+  uint64_t size; // Of the source
+} header_t;
+
+typedef struct {
+  uint32_t line;
+  uint32_t column;
+  uint32_t type;
+  // Elements of lists, or value of integers and booleans
+  uint32_t value;
+  char symbol[SYMBOL_SIZE];
+} record_t;
+
+static constexpr uint64_t FNV_OFFSET = 0xcbf29ce484222325;
+static constexpr uint64_t FNV_PRIME = 0x100000001b3;
+
+uint64_t cacheHash(size_t size, const char source[static size]) {
+  uint64_t hash = FNV_OFFSET;
+  for (size_t i = 0; i < size; i++) {
+    hash = (hash ^ (unsigned char)source[i]) * FNV_PRIME;
+  }
+  return hash;
+}
+
+// Forms are only as good as the format and the node layout that made them:
+// caches written by interpreters that differ in either are stale
+static uint64_t cacheFormat(void) {
+  const uint64_t layout[] = {CACHE_FORMAT_VERSION, sizeof(header_t),
+                             sizeof(record_t), sizeof(node_t), SYMBOL_SIZE};
+  return cacheHash(sizeof(layout), (const char *)layout);
+}
+
+uint64_t cacheKey(const struct stat *file_stat) {
+  const uint64_t metadata[] = {(uint64_t)file_stat->st_dev,
+                               (uint64_t)file_stat->st_ino,
+                               (uint64_t)file_stat->st_size,
+                               (uint64_t)file_stat->st_mtim.tv_sec,
+                               (uint64_t)file_stat->st_mtim.tv_nsec,
+                               (uint64_t)file_stat->st_ctim.tv_sec,
+                               (uint64_t)file_stat->st_ctim.tv_nsec};
+  return cacheHash(sizeof(metadata), (const char *)metadata);
+}
+
+bool cacheSettled(const struct stat *file_stat) {
+  struct timespec now;
+  if (clock_gettime(CLOCK_REALTIME, &now) != 0)
+    return false;
+  return file_stat->st_mtim.tv_sec + CACHE_SETTLE_SECONDS < now.tv_sec &&
+         file_stat->st_ctim.tv_sec + CACHE_SETTLE_SECONDS < now.tv_sec;
+}
+
+bool cacheDirectory(char directory[static CACHE_PATH_SIZE]) {
+  const char *configured = getenv("LIFP_CACHE_DIR");
+  const char *cache_home = getenv("XDG_CACHE_HOME");
+  const char *home = getenv("HOME");
+
+  if (configured) {
+    if (configured[0] == 0)
+      return false;
+    snprintf(directory, CACHE_PATH_SIZE, "%s", configured);
+  } else if (cache_home && cache_home[0] != 0) {
+    snprintf(directory, CACHE_PATH_SIZE, "%s/lifp", cache_home);
+  } else if (home && home[0] != 0) {
+    // ~/.cache may not be there yet either
+    snprintf(directory, CACHE_PATH_SIZE, "%s/.cache", home);
+    if (mkdir(directory, 0755) != 0 && errno != EEXIST)
+      return false;
+    snprintf(directory, CACHE_PATH_SIZE, "%s/.cache/lifp", home);
+  } else {
+    return false;
+  }
+
+  return mkdir(directory, 0755) == 0 || errno == EEXIST;
+}
+
+void cachePath(char path[static CACHE_PATH_SIZE], uint64_t key,
+               const char *directory) {
+  snprintf(path, CACHE_PATH_SIZE, "%s/%016" PRIx64 ".lifpc", directory, key);
+}
+
+// Records hold whole forms, lists never claim more elements than there are
+// records left, and symbols are terminated
+static bool isWellFormed(const record_t *records, size_t count) {
+  size_t pending = 0;
+  for (size_t i = 0; i < count; i++) {
+    const record_t *record = &records[i];
+    pending = pending ? pending - 1 : 0;
+
+    switch ((node_type_t)record->type) {
+    case NODE_TYPE_LIST:
+      if (record->value > count - i - 1)
+        return false;
+      pending += record->value;
+      break;
+    case NODE_TYPE_SYMBOL:
+      if (!memchr(record->symbol, 0, SYMBOL_SIZE))
+        return false;
+      break;
+    case NODE_TYPE_INTEGER:
+    case NODE_TYPE_BOOLEAN:
+    case NODE_TYPE_NIL:
+      break;
+    default:
+      return false;
+    }
+  }
+  return pending == 0;
+}
+
+cache_t *cacheLoad(const char *path, uint64_t key, size_t size) {
+  const int file_descriptor = open(path, O_RDONLY);
+  if (file_descriptor < 0)
+    return nullptr;
+
+  struct stat file_stat;
+  if (fstat(file_descriptor, &file_stat) < 0 ||
+      (size_t)file_stat.st_size < sizeof(header_t) ||
+      ((size_t)file_stat.st_size - sizeof(header_t)) % sizeof(record_t)) {
+    close(file_descriptor);
+    return nullptr;
+  }
+
+  const size_t length = (size_t)file_stat.st_size;
+  void *memory =
+      mmap(nullptr, length, PROT_READ, MAP_PRIVATE, file_descriptor, 0);
+  close(file_descriptor);
+  if (memory == MAP_FAILED)
+    return nullptr;
+
+  const header_t *header = memory;
+  const record_t *records = (const void *)&header[1];
+  const size_t count = (length - sizeof(header_t)) / sizeof(record_t);
+  if (memcmp(header->magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0 ||
+      header->format != cacheFormat() ||
+      header->key != key ||
+      header->size != size || !isWellFormed(records, count)) {
+    munmap(memory, length);
+    return nullptr;
+  }
+
+  const auto allocation = allocSafe(sizeof(cache_t));
+  if (allocation.code != RESULT_OK) {
+    munmap(memory, length);
+    return nullptr;
+  }
+
+  cache_t *cache = allocation.value;
+  cache->memory = memory;
+  cache->size = length;
+  cache->records = records;
+  cache->count = count;
+  cache->next = 0;
+  return cache;
+}
+
+void cacheClose(cache_t **self) {
+  if (!self || !*self)
+    return;
+
+  munmap((*self)->memory, (*self)->size);
+  deallocSafe(self);
+}
+
+static result_node_ref_t readNode(cache_t *self, arena_t *arena,
+                                  intern_t *intern, node_t *node) {
+  const record_t *records = self->records;
+  const record_t *record = &records[self->next++];
+
+  node->position.line = record->line;
+  node->position.column = record->column;
+  node->type = (node_type_t)record->type;
+
+  switch (node->type) {
+  case NODE_TYPE_INTEGER:
+    node->value.integer = (int32_t)record->value;
+    return ok(result_node_ref_t, node);
+  case NODE_TYPE_BOOLEAN:
+    node->value.boolean = record->value != 0;
+    return ok(result_node_ref_t, node);
+  case NODE_TYPE_SYMBOL:
+    memcpy(node->value.symbol, record->symbol, SYMBOL_SIZE);
+    return ok(result_node_ref_t, node);
+  case NODE_TYPE_NIL:
+    node->value.nil = nullptr;
+    return ok(result_node_ref_t, node);
+  case NODE_TYPE_LIST:
+  default:
+    break;
+  }
+
+  const size_t start = arena->offset;
+  const size_t count = record->value;
+
+  node_list_t *list = nullptr;
+  tryWithMeta(result_node_ref_t,
+              listCreate(node_t, arena, count ? count : 1), node->position,
+              list);
+
+  for (size_t i = 0; i < count; i++) {
+    node_t element = {};
+    try(result_node_ref_t, readNode(self, arena, intern, &element));
+    tryWithMeta(result_node_ref_t, listAppend(node_t, list, &element),
+                element.position);
+  }
+  bytewiseCopy(&node->value.list, list, sizeof(node_list_t));
+
+  if (!intern)
+    return ok(result_node_ref_t, node);
+
+  // Interned like the parser does (see parse.c)
+  node_t *elements = internList(intern, &node->value.list);
+  if (elements != node->value.list.data) {
+    intern->reclaimed += arena->offset - start;
+    arenaRewind(arena, start);
+    node->value.list.capacity = node->value.list.count;
+    node->value.list.data = elements;
+  }
+
+  return ok(result_node_ref_t, node);
+}
+
+result_node_ref_t cacheNext(cache_t *self, arena_t *arena, intern_t *intern) {
+  if (self->next == self->count)
+    return ok(result_node_ref_t, nullptr);
+
+  const record_t *records = self->records;
+  const position_t position = {.line = records[self->next].line,
+                               .column = records[self->next].column};
+
+  node_t *node = nullptr;
+  tryWithMeta(result_node_ref_t, nodeCreate(arena, NODE_TYPE_NIL), position,
+              node);
+  return readNode(self, arena, intern, node);
+}
+
+result_ref_t cacheWriterCreate(const char *path, uint64_t key, size_t size) {
+  cache_writer_t *writer = nullptr;
+  try(result_ref_t, allocSafe(sizeof(cache_writer_t)), writer);
+
+  snprintf(writer->path, CACHE_PATH_SIZE, "%s", path);
+  snprintf(writer->temporary, CACHE_PATH_SIZE, "%s.%d", path, getpid());
+
+  writer->file = fopen(writer->temporary, "wb");
+  if (!writer->file) {
+    deallocSafe(&writer);
+    throw(result_ref_t, CACHE_ERROR_IO, nullptr, "cannot write '%s'", path);
+  }
+
+  header_t header = {.format = cacheFormat(), .key = key, .size = size};
+  memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+  if (fwrite(&header, sizeof(header_t), 1, writer->file) != 1) {
+    cacheAbort(&writer);
+    throw(result_ref_t, CACHE_ERROR_IO, nullptr, "cannot write '%s'", path);
+  }
+
+  return ok(result_ref_t, writer);
+}
+
+result_void_t cacheWrite(cache_writer_t *self, const node_t *form) {
+  record_t record = {.line = (uint32_t)form->position.line,
+                     .column = (uint32_t)form->position.column,
+                     .type = (uint32_t)form->type};
+
+  switch (form->type) {
+  case NODE_TYPE_LIST:
+    record.value = (uint32_t)form->value.list.count;
+    break;
+  case NODE_TYPE_INTEGER:
+    record.value = (uint32_t)form->value.integer;
+    break;
+  case NODE_TYPE_BOOLEAN:
+    record.value = form->value.boolean;
+    break;
+  case NODE_TYPE_SYMBOL:
+    memcpy(record.symbol, form->value.symbol, SYMBOL_SIZE);
+    break;
+  case NODE_TYPE_NIL:
+  default:
+    break;
+  }
+
+  if (fwrite(&record, sizeof(record_t), 1, self->file) != 1) {
+    throw(result_void_t, CACHE_ERROR_IO, nullptr, "cannot write '%s'",
+          self->temporary);
+  }
+
+  if (form->type == NODE_TYPE_LIST) {
+    for (size_t i = 0; i < form->value.list.count; i++) {
+      try(result_void_t, cacheWrite(self, &form->value.list.data[i]));
+    }
+  }
+  return ok(result_void_t);
+}
+
+// The cache is swapped in at once: readers never see it half written
+result_void_t cacheCommit(cache_writer_t **self) {
+  cache_writer_t *writer = *self;
+  const bool closed = fclose(writer->file) == 0;
+  writer->file = nullptr;
+
+  if (!closed || rename(writer->temporary, writer->path) != 0) {
+    cacheAbort(self);
+    throw(result_void_t, CACHE_ERROR_IO, nullptr, "cannot write cache");
+  }
+
+  deallocSafe(self);
+  return ok(result_void_t);
+}
+
+void cacheAbort(cache_writer_t **self) {
+  if (!self || !*self)
+    return;
+
+  if ((*self)->file) {
+    fclose((*self)->file);
+  }
+  remove((*self)->temporary);
+  deallocSafe(self);
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include "../lib/arena.h"
+#include "../lib/result.h"
+#include "error.h"
+#include "intern.h"
+#include "node.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/stat.h>
+
+// On-disk cache of parsed forms.
+//
+// Forms are stored as a flat array of fixed-size records in preorder, lists
+// followed by their elements, and nothing in the file is an address: it is
+// mapped read-only and walked in place, without fixups. Reading a form back
+// only takes copying its records to nodes, with no tokenizing or parsing.
+//
+// Files start with the key of the source they were made from, its size, and
+// the version of the format and node layout that wrote them: any mismatch
+// makes them stale. Keys come from the metadata of the source, like make
+// does, so that looking a cache up never reads the source itself.
+typedef enum {
+  CACHE_ERROR_IO = ERROR_CODE_RUNTIME_ERROR + 1,
+} cache_error_t;
+
+constexpr size_t CACHE_PATH_SIZE = 4096;
+// Sources modified more recently than this may be modified again without their
+// timestamps changing, which would go unnoticed by their key
+constexpr time_t CACHE_SETTLE_SECONDS = 1;
+
+typedef struct {
+  void *memory;
+  size_t size;
+  const void *records;
+  size_t count;
+  // Index of the next record to read
+  size_t next;
+} cache_t;
+
+typedef struct {
+  FILE *file;
+  // Records are written to a temporary file, renamed when complete
+  char path[CACHE_PATH_SIZE];
+  char temporary[CACHE_PATH_SIZE];
+} cache_writer_t;
+
+uint64_t cacheHash(size_t size, const char source[static size]);
+
+// Key of the cache of a file: its device, inode, size, and modification and
+// change times, any of which changes when the file is edited or replaced
+uint64_t cacheKey(const struct stat *file_stat);
+
+// Whether a file has been left alone long enough for its key to be trusted
+bool cacheSettled(const struct stat *file_stat);
+
+// Directory caches go in, created when missing: LIFP_CACHE_DIR, otherwise
+// $XDG_CACHE_HOME/lifp or ~/.cache/lifp. It's false when there is none, or
+// LIFP_CACHE_DIR is empty, which turns caching off.
+bool cacheDirectory(char directory[static CACHE_PATH_SIZE]);
+
+// Path of the cache of a source in `directory`, named after its key
+void cachePath(char path[static CACHE_PATH_SIZE], uint64_t key,
+               const char *directory);
+
+// Maps the cache at `path`. It's null when missing, stale, or corrupt.
+cache_t *cacheLoad(const char *path, uint64_t key, size_t size);
+void cacheClose(cache_t **self);
+
+// Copies the next form to `arena`. Returns nullptr after the last one.
+result_node_ref_t cacheNext(cache_t *self, arena_t *arena, intern_t *intern);
+
+result_ref_t cacheWriterCreate(const char *path, uint64_t key, size_t size);
+result_void_t cacheWrite(cache_writer_t *self, const node_t *form);
+// Publishes the forms written so far, and destroys the writer
+result_void_t cacheCommit(cache_writer_t **self);
+// Drops the forms written so far, and destroys the writer
+void cacheAbort(cache_writer_t **self);
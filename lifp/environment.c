@@ -2,6 +2,7 @@
 #define _POSIX_C_SOURCE 200809L
 
 #include "environment.h"
+#include "jit.h"
 
 // NOLINTBEGIN
 #include "std/core.c"
@@ -13,8 +14,39 @@
 
 #include "value.h"
 #include <assert.h>
+#include <string.h>
 
 constexpr size_t ENVIRONMENT_MAX_SIZE = (long)32 * 1024;
+// Closure bodies are never collected: the code region grows as they're defined
+constexpr size_t CODE_SIZE = (long)64 * 1024;
+
+// Labels are pointers to the symbols, which are not constant expressions
+static const struct {
+  const char **label;
+  builtin_t builtin;
+} BUILTINS[] = {
+    {&SUM, sum},
+    {&SUB, subtract},
+    {&MUL, multiply},
+    {&DIV, divide},
+    {&MOD, modulo},
+    {&EQUAL, equal},
+    {&LESS_THAN, lessThan},
+    {&GREATER_THAN, greaterThan},
+    {&NEQ, notEqual},
+    {&LEQ, lessEqual},
+    {&GEQ, greaterEqual},
+    {&LOGICAL_AND, logicalAnd},
+    {&LOGICAL_OR, logicalOr},
+    {&FLOW_SLEEP, flowSleep},
+    {&LIST_COUNT, listCount},
+    {&LIST_FROM, listFrom},
+    {&LIST_NTH, listNth},
+    {&MATH_MAX, mathMax},
+    {&MATH_MIN, mathMin},
+    {&MATH_RANDOM, mathRandom},
+    {&IO_PRINT, ioPrint},
+};
 
 result_ref_t environmentCreate(environment_t *parent) {
   arena_t *arena = nullptr;
@@ -26,44 +58,84 @@ result_ref_t environmentCreate(environment_t *parent) {
   environment->arena = arena;
   environment->parent = parent;
 
+  if (parent) {
+    environment->code = parent->code;
+  } else {
+    tryWithCleanup(result_ref_t, arenaCreateGrowable(CODE_SIZE),
+                   arenaDestroy(&arena), environment->code);
+#ifdef JIT
+    tryWithCleanup(
+        result_ref_t, jitCreate(),
+        (arenaDestroy(&environment->code), arenaDestroy(&arena)),
+        environment->jit);
+#endif
+  }
+
   try(result_ref_t, mapCreate(value_t, arena, 32), environment->values);
 
-#define setBuiltin(Label, Builtin)                                             \
-  builtin.type = VALUE_TYPE_BUILTIN;                                           \
-  builtin.value.builtin = (Builtin);                                           \
-  try(result_ref_t, mapSet(environment->values, (Label), &builtin));
-
-  value_t builtin;
-  setBuiltin(SUM, sum);
-  setBuiltin(SUB, subtract);
-  setBuiltin(MUL, multiply);
-  setBuiltin(DIV, divide);
-  setBuiltin(MOD, modulo);
-  setBuiltin(EQUAL, equal);
-  setBuiltin(LESS_THAN, lessThan);
-  setBuiltin(GREATER_THAN, greaterThan);
-  setBuiltin(NEQ, notEqual);
-  setBuiltin(LEQ, lessEqual);
-  setBuiltin(GEQ, greaterEqual);
-  setBuiltin(LOGICAL_AND, logicalAnd);
-  setBuiltin(LOGICAL_OR, logicalOr);
-  setBuiltin(FLOW_SLEEP, flowSleep);
-  setBuiltin(LIST_COUNT, listCount);
-  setBuiltin(LIST_FROM, listFrom);
-  setBuiltin(LIST_NTH, listNth);
-  setBuiltin(MATH_MAX, mathMax);
-  setBuiltin(MATH_MIN, mathMin);
-  setBuiltin(MATH_RANDOM, mathRandom);
-  setBuiltin(IO_PRINT, ioPrint);
-#undef setBuiltin
+  // Builtins are global bindings: nested environments resolve them through
+  // their parent, unless they shadow them
+  if (parent) {
+    return ok(result_ref_t, environment);
+  }
+
+  for (size_t i = 0; i < sizeof(BUILTINS) / sizeof(BUILTINS[0]); i++) {
+    value_t builtin = {.type = VALUE_TYPE_BUILTIN,
+                       .value.builtin = BUILTINS[i].builtin};
+    try(result_ref_t,
+        mapSet(environment->values, *BUILTINS[i].label, &builtin));
+  }
 
   return ok(result_ref_t, environment);
 }
 
+// Builtins whose result only depends on their arguments, and which have no
+// side effects: calls to these can be evaluated ahead of time
+static const builtin_t PURE_BUILTINS[] = {
+    sum,          subtract,   multiply,     divide,    modulo,
+    equal,        lessThan,   greaterThan,  notEqual,  lessEqual,
+    greaterEqual, logicalAnd, logicalOr,    listCount, listFrom,
+    listNth,      mathMax,    mathMin,
+};
+
+bool environmentIsPure(builtin_t builtin) {
+  for (size_t i = 0; i < sizeof(PURE_BUILTINS) / sizeof(builtin_t); i++) {
+    if (PURE_BUILTINS[i] == builtin)
+      return true;
+  }
+  return false;
+}
+
+const char *environmentBuiltinName(builtin_t builtin) {
+  for (size_t i = 0; i < sizeof(BUILTINS) / sizeof(BUILTINS[0]); i++) {
+    if (BUILTINS[i].builtin == builtin)
+      return *BUILTINS[i].label;
+  }
+  return nullptr;
+}
+
+builtin_t environmentBuiltin(const char *name) {
+  for (size_t i = 0; i < sizeof(BUILTINS) / sizeof(BUILTINS[0]); i++) {
+    if (strcmp(*BUILTINS[i].label, name) == 0)
+      return BUILTINS[i].builtin;
+  }
+  return nullptr;
+}
+
 void environmentDestroy(environment_t **self) {
   if (!self || !*self)
     return;
 
+  if (!(*self)->parent && (*self)->code) {
+    arenaDestroy(&(*self)->code);
+  }
+
+#ifdef JIT
+  if (!(*self)->parent) {
+    jitDestroy(&(*self)->jit);
+  }
+#endif
+
   arena_t *arena = (*self)->arena;
   // The environment is allocated on its own arena. This frees all the resources
   arenaDestroy(&arena);
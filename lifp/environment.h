@@ -6,13 +6,39 @@
 
 typedef struct environment_t {
   arena_t *arena;
+  // Closure bodies outliving their form. It's owned by the global environment
+  // and shared with the rest of the chain.
+  arena_t *code;
   Map(value_t) * values;
   struct environment_t *parent;
+  // Bumped when global bindings may have moved: it invalidates the bindings
+  // cached by quickened nodes
+  size_t version;
+#ifdef JIT
+  // Native code of hot closures. It's owned by the global environment.
+  struct jit_t *jit;
+#endif
 } environment_t;
 
 result_void_position_t sum(value_t *result, value_list_t *values);
+result_void_position_t subtract(value_t *result, value_list_t *values);
+result_void_position_t multiply(value_t *result, value_list_t *values);
+result_void_position_t equal(value_t *result, value_list_t *values);
+result_void_position_t lessThan(value_t *result, value_list_t *values);
+result_void_position_t greaterThan(value_t *result, value_list_t *values);
+result_void_position_t lessEqual(value_t *result, value_list_t *values);
+result_void_position_t greaterEqual(value_t *result, value_list_t *values);
 
 result_ref_t environmentCreate(environment_t *parent);
 void environmentDestroy(environment_t **self_ref);
 
 value_t *environmentResolveSymbol(environment_t *self, const char *symbol);
+
+// Pure builtins have no side effects, unlike io.print!, flow.sleep or
+// math.random, and their result only depends on their arguments
+bool environmentIsPure(builtin_t builtin);
+
+// Names builtins, so that they can be referenced outside of the process. It's
+// null for builtins the environment does not provide.
+const char *environmentBuiltinName(builtin_t builtin);
+builtin_t environmentBuiltin(const char *name);
@@ -14,6 +14,7 @@ typedef enum {
   // Syntax Errors
   ERROR_CODE_SYNTAX_UNEXPECTED_TOKEN,
   ERROR_CODE_SYNTAX_UNBALANCED_PARENTHESES,
+  ERROR_CODE_SYNTAX_INTEGER_OVERFLOW,
 
   // Runtime Error
   ERROR_CODE_RUNTIME_ERROR,
@@ -0,0 +1,79 @@
+#include "evaluate.h"
+#include "node.h"
+#include <stddef.h>
+#include <string.h>
+
+// Escape analysis
+// ---
+//
+// A value escapes its frame when it's returned from it: the value of the
+// form itself, of a closure body, or of the branch of a let or cond in return
+// position. Any other value (call arguments, conditions, bindings) is copied
+// by its consumer right away, so it is flagged as local. The evaluator writes
+// local values straight into their consumer and releases the memory used to
+// compute them as soon as they are copied.
+
+static bool isForm(const node_list_t *list, const char *name) {
+  const node_t *first = &list->data[0];
+  return first->type == NODE_TYPE_SYMBOL &&
+         strcmp(first->value.symbol, name) == 0;
+}
+
+static void analyze(node_t *node, bool escapes) {
+  node->local = !escapes;
+
+  if (node->type != NODE_TYPE_LIST || node->value.list.count == 0)
+    return;
+
+  node_list_t *list = &node->value.list;
+
+  // Malformed special forms are reported by the evaluator, so they're skipped
+  if (isForm(list, FUNCTION)) {
+    // The body is evaluated when the closure is called: its value is returned
+    if (list->count == 3)
+      analyze(&list->data[2], true);
+    return;
+  }
+
+  if (isForm(list, DEFINE)) {
+    // Definitions are promoted with a deep copy
+    if (list->count == 3)
+      analyze(&list->data[2], false);
+    return;
+  }
+
+  if (isForm(list, LET)) {
+    if (list->count != 3)
+      return;
+
+    node_t *couples = &list->data[1];
+    if (couples->type == NODE_TYPE_LIST) {
+      for (size_t i = 0; i < couples->value.list.count; i++) {
+        node_t *couple = &couples->value.list.data[i];
+        if (couple->type == NODE_TYPE_LIST && couple->value.list.count == 2)
+          analyze(&couple->value.list.data[1], false);
+      }
+    }
+    analyze(&list->data[2], escapes);
+    return;
+  }
+
+  if (isForm(list, COND)) {
+    for (size_t i = 1; i < list->count - 1; i++) {
+      node_t *clause = &list->data[i];
+      if (clause->type == NODE_TYPE_LIST && clause->value.list.count == 2) {
+        analyze(&clause->value.list.data[0], false);
+        analyze(&clause->value.list.data[1], escapes);
+      }
+    }
+    if (list->count > 1)
+      analyze(&list->data[list->count - 1], escapes);
+    return;
+  }
+
+  for (size_t i = 0; i < list->count; i++) {
+    analyze(&list->data[i], false);
+  }
+}
+
+void escapeAnalyze(node_t *syntax_tree) { analyze(syntax_tree, true); }
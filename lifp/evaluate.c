@@ -2,28 +2,34 @@
 #include "../lib/profile.h"
 #include "environment.h"
 #include "error.h"
+#include "jit.h"
 #include "node.h"
 #include "value.h"
 
-// NOLINTNEXTLINE
+static result_value_ref_t evaluateLocal(arena_t *arena, node_t *syntax_tree,
+                                        environment_t *environment,
+                                        value_t *destination);
+static bool fuseBinaryInteger(node_t *syntax_tree, environment_t *environment,
+                              value_t *result);
+#ifdef REGISTER_VM
+static void vmCompile(arena_t *code, environment_t *environment,
+                      closure_t *closure);
+#endif
+
+// NOLINTBEGIN
+#include "shapes.c"
 #include "specials.c"
+#include "escape.c"
+#include "optimize.c"
+#include "quicken.c"
+#include "vm.c"
+// NOLINTEND
 
 #include <assert.h>
 #include <stddef.h>
 #include <stdio.h>
 #include <string.h>
 
-static bool isSpecialFormNode(const node_t FIRST_NODE) {
-  if (FIRST_NODE.type != NODE_TYPE_SYMBOL)
-    return false;
-
-  size_t len = strlen(FIRST_NODE.value.symbol);
-  return ((strncmp(FIRST_NODE.value.symbol, DEFINE, 4) == 0 && len == 4) ||
-          (strncmp(FIRST_NODE.value.symbol, FUNCTION, 2) == 0 && len == 2) ||
-          (strncmp(FIRST_NODE.value.symbol, LET, 3) == 0 && len == 3) != 0 ||
-          (strncmp(FIRST_NODE.value.symbol, COND, 4) == 0 && len == 4)) != 0;
-}
-
 static result_value_ref_t invokeBuiltin(value_t *result, value_t builtin_value,
                                         arena_t *arena) {
   assert(builtin_value.type == VALUE_TYPE_BUILTIN);
@@ -45,28 +51,91 @@ static result_value_ref_t invokeBuiltin(value_t *result, value_t builtin_value,
   return ok(result_value_ref_t, result);
 }
 
+// The call frame is a young region of the arena: temporaries allocated there
+// die when the call returns, except for its result. The result is evacuated
+// to scratch memory, the frame is released, and the result is copied back at
+// its start, so that recursion doesn't pile up dead temporaries. Values that
+// outlive the form are promoted to the environment by def! instead.
+static value_t *evacuate(arena_t *arena, size_t frame, arena_t *scratch,
+                         value_t *value) {
+  const size_t scratch_offset = scratch->offset;
+
+  // Not enough room to move the result around: the frame is kept instead
+  const auto survivor = valueClone(scratch, value);
+  if (survivor.code != RESULT_OK)
+    return value;
+
+  // Copying back takes exactly as much memory as the first copy did
+  const size_t survived = scratch->offset - scratch_offset;
+  if (frame + survived > arena->size)
+    return value;
+
+  profileNursery(arena->offset - frame, survived);
+  arenaRewind(arena, frame);
+  const auto promoted = valueClone(arena, survivor.value);
+  assert(promoted.code == RESULT_OK);
+  return promoted.value;
+}
+
+static environment_t *globalsOf(environment_t *environment) {
+  while (environment->parent) {
+    environment = environment->parent;
+  }
+  return environment;
+}
+
+// Closures are flat: the call environment holds arguments and captured values,
+// and chains straight to the global environment, regardless of the caller
 static result_value_ref_t invokeClosure(value_t *result, value_t closure_value,
                                         arena_t *arena,
-                                        environment_t *parent_environment) {
+                                        environment_t *caller_environment) {
   profileSafeAlloc();
 
   assert(closure_value.type == VALUE_TYPE_CLOSURE);
   closure_t closure = closure_value.value.closure;
 
-  if (result->value.list.count - 1 != closure.arguments.count) {
+  if (result->value.list.count - 1 != closure.arguments->count) {
     throw(result_value_ref_t, ERROR_CODE_TYPE_UNEXPECTED_ARITY,
           closure_value.position,
-          "Unexpected arity. Expected %lu arguments, got %lu.",
-          result->value.list.count - 1, closure.arguments.count);
+          "Unexpected arity. Expected %zu arguments, got %zu.",
+          closure.arguments->count, result->value.list.count - 1);
   }
 
+#ifdef JIT
+  environment_t *globals = globalsOf(caller_environment);
+  value_t native;
+  if (jitInvoke(globals->jit, globals, &closure, &result->value.list,
+                &native)) {
+    native.position = closure.form->position;
+    *result = native;
+    return ok(result_value_ref_t, result);
+  }
+#endif
+
+#ifdef REGISTER_VM
+  if (vmRunnable(&closure))
+    return vmInvoke(arena, &closure, result, globalsOf(caller_environment));
+#endif
+
+  // Temporaries of the call are allocated past this offset
+  const size_t frame = arena->offset;
+
   environment_t *environment = nullptr;
-  tryWithMeta(result_value_ref_t, environmentCreate(parent_environment),
+  tryWithMeta(result_value_ref_t,
+              environmentCreate(globalsOf(caller_environment)),
               closure_value.position, environment);
 
+  for (size_t i = 0; i < closure.captures.count; i++) {
+    capture_t *capture = &closure.captures.data[i];
+    tryWithCleanupMeta(
+        result_value_ref_t,
+        mapSet(environment->values, capture->symbol, &capture->value),
+        environmentDestroy(&environment), closure_value.position);
+  }
+
   // Populate the closure with the values, skipping the closure symbol
   for (size_t i = 1; i < result->value.list.count; i++) {
-    auto argument = listGet(node_t, &closure.arguments, i - 1);
+    auto argument = listGet(node_t, closure.arguments, i - 1);
     auto value = listGet(value_t, &result->value.list, i);
     tryWithCleanupMeta(
         result_value_ref_t,
@@ -76,31 +145,36 @@ static result_value_ref_t invokeClosure(value_t *result, value_t closure_value,
 
   value_t *reduced = nullptr;
   tryWithCleanupMeta(
-      result_value_ref_t, evaluate(arena, &closure.form, environment),
+      result_value_ref_t, evaluate(arena, closure.form, environment),
       environmentDestroy(&environment), closure_value.position, reduced);
+
+  // The call environment is about to be destroyed: its arena is free scratch
+  reduced = evacuate(arena, frame, environment->arena, reduced);
   environmentDestroy(&environment);
   return ok(result_value_ref_t, reduced);
 }
 
-static result_value_ref_t invokeSpecialForm(value_t *result, node_t form_node,
-                                            const node_list_t *nodes,
-                                            environment_t *environment) {
-  if (form_node.value.symbol[0] == 'd') {
-    try(result_value_ref_t, define(environment, nodes), result);
-  } else if (form_node.value.symbol[0] == 'f') {
-    try(result_value_ref_t, function(environment, nodes), result);
-  } else if (form_node.value.symbol[0] == 'l') {
-    try(result_value_ref_t, let(environment, nodes), result);
-  } else {
-    try(result_value_ref_t, cond(environment, nodes), result);
+// Calls the value at the head of the list of values in `result`
+static result_value_ref_t invokeValues(value_t *result, arena_t *arena,
+                                       environment_t *environment) {
+  value_t first_value = listGet(value_t, &result->value.list, 0);
+
+  if (first_value.type == VALUE_TYPE_BUILTIN) {
+    return invokeBuiltin(result, first_value, arena);
+  }
+
+  if (first_value.type == VALUE_TYPE_CLOSURE) {
+    return invokeClosure(result, first_value, arena, environment);
   }
 
   return ok(result_value_ref_t, result);
 }
 
-result_value_ref_t evaluateList(arena_t *arena, node_t *syntax_tree,
-                                environment_t *environment) {
-  const auto list = syntax_tree->value.list;
+// Evaluates the elements of the list, then calls the value of the first one
+static result_value_ref_t evaluateCall(arena_t *arena, node_t *syntax_tree,
+                                       environment_t *environment) {
+  profileShape("", syntax_tree);
+  node_list_t *list = &syntax_tree->value.list;
 
   value_t *result = nullptr;
   tryWithMeta(result_value_ref_t, valueCreate(arena, VALUE_TYPE_LIST),
@@ -108,83 +182,211 @@ result_value_ref_t evaluateList(arena_t *arena, node_t *syntax_tree,
   result->position.column = syntax_tree->position.column;
   result->position.line = syntax_tree->position.line;
 
-  if (list.count == 0) {
+  for (size_t i = 0; i < list->count; i++) {
+    value_t reduced;
+    try(result_value_ref_t,
+        evaluateLocal(arena, &list->data[i], environment, &reduced));
+    tryWithMeta(result_value_ref_t,
+                listAppend(value_t, &result->value.list, &reduced),
+                syntax_tree->position);
+  }
+
+  if (syntax_tree->quick == NODE_QUICK_NONE) {
+    syntax_tree->quick = quickenCall(&result->value.list);
+  }
+
+  if (list->count == 0) {
     return ok(result_value_ref_t, result);
   }
+  return invokeValues(result, arena, environment);
+}
 
-  auto first_node = listGet(node_t, &list, 0);
-  if (isSpecialFormNode(first_node)) {
-    return invokeSpecialForm(result, first_node, &list, environment);
+// Atoms don't need any memory other than the value they are written to: they
+// get one only when the caller doesn't provide it
+static result_value_ref_t atomValue(arena_t *arena, const node_t *syntax_tree,
+                                    value_t *destination) {
+  if (!destination) {
+    tryWithMeta(result_value_ref_t, valueCreate(arena, VALUE_TYPE_NIL),
+                syntax_tree->position, destination);
   }
+  destination->position.column = syntax_tree->position.column;
+  destination->position.line = syntax_tree->position.line;
+  return ok(result_value_ref_t, destination);
+}
 
-  for (size_t i = 0; i < list.count; i++) {
-    auto node = listGet(node_t, &list, i);
-    value_t *reduced = nullptr;
-    try(result_value_ref_t, evaluate(arena, &node, environment), reduced);
-    tryWithMeta(result_value_ref_t,
-                listAppend(value_t, &result->value.list, reduced),
-                syntax_tree->position);
+// Direct-threaded dispatch: nodes jump straight to the handler of their kind
+// (see quicken.c) through a table of label addresses, rather than going
+// through the checks on types and special forms. Handlers whose value is the
+// value of another node, like cond, jump to its handler instead of recursing.
+// Compilers without labels as values, or SWITCH_DISPATCH, fall back to a
+// switch.
+#if defined(__GNUC__) && !defined(SWITCH_DISPATCH)
+#define THREADED_DISPATCH
+#endif
+
+#ifdef THREADED_DISPATCH
+#define handler(Quick) handle_##Quick
+#define next() goto *HANDLERS[syntax_tree->quick]
+#else
+#define handler(Quick) case Quick
+#define next() goto dispatch
+#endif
+
+static result_value_ref_t dispatch(arena_t *arena, node_t *syntax_tree,
+                                   environment_t *environment,
+                                   value_t *destination) {
+  value_t *value = nullptr;
+
+#ifdef THREADED_DISPATCH
+  static const void *const HANDLERS[] = {
+      [NODE_QUICK_NONE] = &&handle_NODE_QUICK_NONE,
+      [NODE_QUICK_INTEGER] = &&handle_NODE_QUICK_INTEGER,
+      [NODE_QUICK_BOOLEAN] = &&handle_NODE_QUICK_BOOLEAN,
+      [NODE_QUICK_NIL] = &&handle_NODE_QUICK_NIL,
+      [NODE_QUICK_SYMBOL] = &&handle_NODE_QUICK_SYMBOL,
+      [NODE_QUICK_GLOBAL] = &&handle_NODE_QUICK_GLOBAL,
+      [NODE_QUICK_CALL] = &&handle_NODE_QUICK_CALL,
+      [NODE_QUICK_DEFINE] = &&handle_NODE_QUICK_DEFINE,
+      [NODE_QUICK_FUNCTION] = &&handle_NODE_QUICK_FUNCTION,
+      [NODE_QUICK_LET] = &&handle_NODE_QUICK_LET,
+      [NODE_QUICK_COND] = &&handle_NODE_QUICK_COND,
+      [NODE_QUICK_ADD_INT_2] = &&handle_NODE_QUICK_ADD_INT_2,
+      [NODE_QUICK_SUB_INT_2] = &&handle_NODE_QUICK_SUB_INT_2,
+      [NODE_QUICK_MUL_INT_2] = &&handle_NODE_QUICK_MUL_INT_2,
+      [NODE_QUICK_EQ_INT_2] = &&handle_NODE_QUICK_EQ_INT_2,
+      [NODE_QUICK_LT_INT_2] = &&handle_NODE_QUICK_LT_INT_2,
+      [NODE_QUICK_GT_INT_2] = &&handle_NODE_QUICK_GT_INT_2,
+      [NODE_QUICK_LEQ_INT_2] = &&handle_NODE_QUICK_LEQ_INT_2,
+      [NODE_QUICK_GEQ_INT_2] = &&handle_NODE_QUICK_GEQ_INT_2,
+  };
+  next();
+#else
+dispatch:
+  switch (syntax_tree->quick) {
+#endif
+
+handler(NODE_QUICK_NONE):
+  if (!quickenNode(syntax_tree))
+    return evaluateCall(arena, syntax_tree, environment);
+  next();
+
+handler(NODE_QUICK_INTEGER):
+  try(result_value_ref_t, atomValue(arena, syntax_tree, destination), value);
+  value->type = VALUE_TYPE_INTEGER;
+  value->value.integer = syntax_tree->value.integer;
+  return ok(result_value_ref_t, value);
+
+handler(NODE_QUICK_BOOLEAN):
+  try(result_value_ref_t, atomValue(arena, syntax_tree, destination), value);
+  value->type = VALUE_TYPE_BOOLEAN;
+  value->value.boolean = syntax_tree->value.boolean;
+  return ok(result_value_ref_t, value);
+
+handler(NODE_QUICK_NIL):
+  try(result_value_ref_t, atomValue(arena, syntax_tree, destination), value);
+  value->type = VALUE_TYPE_NIL;
+  value->value.nil = nullptr;
+  return ok(result_value_ref_t, value);
+
+handler(NODE_QUICK_SYMBOL):
+handler(NODE_QUICK_GLOBAL): {
+  const value_t *resolved = resolveQuickened(syntax_tree, environment);
+  if (!resolved) {
+    throw(result_value_ref_t, ERROR_CODE_REFERENCE_SYMBOL_NOT_FOUND,
+          syntax_tree->position,
+          "Symbol '%s' cannot be found in the current environment",
+          syntax_tree->value.symbol);
   }
 
-  value_t first_value = listGet(value_t, &result->value.list, 0);
+  try(result_value_ref_t, atomValue(arena, syntax_tree, destination), value);
+  value->type = resolved->type;
+  value->value = resolved->value;
+  return ok(result_value_ref_t, value);
+}
 
-  if (first_value.type == VALUE_TYPE_BUILTIN) {
-    return invokeBuiltin(result, first_value, arena);
+handler(NODE_QUICK_CALL):
+  return evaluateCall(arena, syntax_tree, environment);
+
+handler(NODE_QUICK_DEFINE):
+  return define(arena, environment, &syntax_tree->value.list);
+
+handler(NODE_QUICK_FUNCTION):
+  return function(arena, environment, &syntax_tree->value.list,
+                  &syntax_tree->value.function.free);
+
+handler(NODE_QUICK_LET):
+  return let(arena, environment, &syntax_tree->value.list);
+
+handler(NODE_QUICK_COND):
+  try(result_value_ref_t, cond(arena, environment, &syntax_tree->value.list),
+      syntax_tree);
+  next();
+
+handler(NODE_QUICK_ADD_INT_2):
+handler(NODE_QUICK_SUB_INT_2):
+handler(NODE_QUICK_MUL_INT_2):
+handler(NODE_QUICK_EQ_INT_2):
+handler(NODE_QUICK_LT_INT_2):
+handler(NODE_QUICK_GT_INT_2):
+handler(NODE_QUICK_LEQ_INT_2):
+handler(NODE_QUICK_GEQ_INT_2):
+  try(result_value_ref_t, atomValue(arena, syntax_tree, destination), value);
+  return evaluateBinaryInteger(arena, syntax_tree, environment, value);
+
+#ifndef THREADED_DISPATCH
+  default:
+    unreachable();
   }
+#endif
+}
 
-  if (first_value.type == VALUE_TYPE_CLOSURE) {
-    return invokeClosure(result, first_value, arena, environment);
+#undef handler
+#undef next
+
+// Values of frame-local nodes (see escape.c) are copied by their consumer, so
+// they are written to `destination`. Scalars don't reference any memory, so
+// whatever was allocated to compute them is released right away.
+static result_value_ref_t evaluateLocal(arena_t *arena, node_t *syntax_tree,
+                                        environment_t *environment,
+                                        value_t *destination) {
+  if (!syntax_tree->local) {
+    value_t *value = nullptr;
+    try(result_value_ref_t, evaluate(arena, syntax_tree, environment), value);
+    *destination = *value;
+    return ok(result_value_ref_t, destination);
   }
 
-  return ok(result_value_ref_t, result);
+  if (syntax_tree->type != NODE_TYPE_LIST) {
+    profileEscape(sizeof(value_t), 0);
+    return dispatch(arena, syntax_tree, environment, destination);
+  }
+
+  const size_t frame = arena->offset;
+  value_t *value = nullptr;
+  try(result_value_ref_t,
+      dispatch(arena, syntax_tree, environment, destination), value);
+  *destination = *value;
+
+  if (destination->type != VALUE_TYPE_LIST &&
+      destination->type != VALUE_TYPE_CLOSURE) {
+    profileEscape(0, arena->offset - frame);
+    arenaRewind(arena, frame);
+  }
+  return ok(result_value_ref_t, destination);
 }
 
 result_value_ref_t evaluate(arena_t *arena, node_t *syntax_tree,
                             environment_t *environment) {
   profileSafeAlloc();
   profileArena(arena);
+  return dispatch(arena, syntax_tree, environment, nullptr);
+}
 
-  value_t *value = nullptr;
-  tryWithMeta(result_value_ref_t, valueCreate(arena, VALUE_TYPE_INTEGER),
-              syntax_tree->position, value);
-  value->position.column = syntax_tree->position.column;
-  value->position.line = syntax_tree->position.line;
-
-  switch (syntax_tree->type) {
-  case NODE_TYPE_BOOLEAN: {
-    value->type = VALUE_TYPE_BOOLEAN;
-    value->value.boolean = syntax_tree->value.boolean;
-    break;
-  }
-  case NODE_TYPE_NIL: {
-    value->type = VALUE_TYPE_NIL;
-    value->value.nil = nullptr;
-    break;
-  }
-  case NODE_TYPE_INTEGER: {
-    value->type = VALUE_TYPE_INTEGER;
-    value->value.integer = syntax_tree->value.integer;
-    break;
-  }
-  case NODE_TYPE_SYMBOL: {
-    value_t *resolved_value =
-        environmentResolveSymbol(environment, syntax_tree->value.symbol);
-
-    if (!resolved_value) {
-      throw(result_value_ref_t, ERROR_CODE_REFERENCE_SYMBOL_NOT_FOUND,
-            syntax_tree->position,
-            "Symbol '%s' cannot be found in the current environment",
-            syntax_tree->value.symbol);
-    }
-
-    value->type = resolved_value->type;
-    value->value = resolved_value->value;
-    break;
-  }
-  case NODE_TYPE_LIST:
-    return evaluateList(arena, syntax_tree, environment);
-  default:
-    unreachable();
-  }
-  return ok(result_value_ref_t, value);
+result_void_t evaluatePrepare(environment_t *environment, closure_t *closure) {
+  // Bodies are read as is, without going through the optimizer
+  try(result_void_t, cacheFreeVariables(environment->code, closure->form));
+#ifdef REGISTER_VM
+  vmCompile(environment->code, environment, closure);
+#endif
+  return ok(result_void_t);
 }
@@ -5,5 +5,31 @@
 #include "node.h"
 #include "value.h"
 
+// Symbols of the special forms
+extern const char *DEFINE;
+extern const char *FUNCTION;
+extern const char *LET;
+extern const char *COND;
+
 result_value_ref_t evaluate(arena_t *arena, node_t *syntax_tree,
                             environment_t *environment);
+
+// Readies a closure bound in the global environment other than by def!, such
+// as by loading an image (see image.h)
+result_void_t evaluatePrepare(environment_t *environment, closure_t *closure);
+
+// Flags the nodes of a top-level form whose values don't outlive their frame
+void escapeAnalyze(node_t *syntax_tree);
+
+// Folds pure builtin calls on literals and prunes constant cond clauses, then
+// caches the free variables of fn forms. The optimized nodes are allocated on
+// `arena`, which should be holding the AST.
+result_void_t optimize(arena_t *arena, node_t *syntax_tree,
+                       environment_t *environment);
+
+#ifdef SHAPE_PROFILE
+// Prints the most frequent shapes of the calls evaluated so far
+void shapesReport(void);
+#else
+#define shapesReport()
+#endif
@@ -128,7 +128,7 @@ void formatValue(const value_t *value, int size,
   }
   case VALUE_TYPE_CLOSURE:
     append(size, output_buffer, offset, "(fn (");
-    node_list_t arguments = value->value.closure.arguments;
+    node_list_t arguments = *value->value.closure.arguments;
 
     if (arguments.count > 0) {
       for (size_t i = 0; i < arguments.count - 1; i++) {
@@ -142,7 +142,7 @@ void formatValue(const value_t *value, int size,
     }
     append(size, output_buffer, offset, ") ");
 
-    formatNode(&value->value.closure.form, size, output_buffer, offset);
+    formatNode(value->value.closure.form, size, output_buffer, offset);
     append(size, output_buffer, offset, ")");
   default:
   }
@@ -0,0 +1,149 @@
+// This is for the CI compiler
+#define _POSIX_C_SOURCE 200809L
+
+#include "gc.h"
+#include "../lib/arena.h"
+#include "../lib/map.h"
+#include "value.h"
+#include <stdio.h>
+#include <time.h>
+
+static uint64_t now(void) {
+  struct timespec time;
+  clock_gettime(CLOCK_MONOTONIC, &time);
+  return ((uint64_t)time.tv_sec * 1000000000U) + (uint64_t)time.tv_nsec;
+}
+
+void gcInit(gc_t *self, size_t threshold, double growth) {
+  self->threshold = threshold;
+  self->min_threshold = threshold;
+  self->growth = growth;
+  self->collections = 0;
+  self->reclaimed = 0;
+  self->total_pause = 0;
+  self->max_pause = 0;
+}
+
+// Copies the bindings of `source` to a new environment, on its own arena
+static result_ref_t copyEnvironment(const environment_t *source, size_t size) {
+  arena_t *arena = nullptr;
+  try(result_ref_t, arenaCreate(size), arena);
+
+  environment_t *environment = nullptr;
+  tryWithCleanup(result_ref_t, arenaAllocate(arena, sizeof(environment_t)),
+                 arenaDestroy(&arena), environment);
+  environment->arena = arena;
+  environment->parent = source->parent;
+  environment->version = source->version + 1;
+
+  tryWithCleanup(result_ref_t,
+                 mapCreate(value_t, arena, source->values->capacity),
+                 arenaDestroy(&arena), environment->values);
+
+  for (size_t i = 0; i < source->values->capacity; i++) {
+    if (!source->values->used[i])
+      continue;
+
+    value_t *value = &source->values->values[i];
+
+    // Scalars are copied with the map entry, the rest references heap memory
+    if (value->type == VALUE_TYPE_LIST || value->type == VALUE_TYPE_CLOSURE) {
+      tryWithCleanupMeta(result_ref_t, valueClone(arena, value),
+                         arenaDestroy(&arena), nullptr, value);
+    }
+
+    tryWithCleanup(result_ref_t,
+                   mapSet(environment->values, source->values->keys[i], value),
+                   arenaDestroy(&arena));
+  }
+
+  return ok(result_ref_t, environment);
+}
+
+result_void_t gcCollect(gc_t *self, environment_t **environment) {
+  const uint64_t start = now();
+  const size_t used = (*environment)->arena->offset;
+  size_t size = (*environment)->arena->size;
+
+  // Live data always fits in a space as big as the one it comes from
+  environment_t *copy = nullptr;
+  try(result_void_t, copyEnvironment(*environment, size), copy);
+
+  // Not enough headroom left: the heap grows, at the cost of another copy
+  if ((double)copy->arena->offset * self->growth > (double)size) {
+    while ((double)copy->arena->offset * self->growth > (double)size) {
+      size *= 2;
+    }
+
+    environment_t *grown = nullptr;
+    tryWithCleanup(result_void_t, copyEnvironment(copy, size),
+                   environmentDestroy(&copy), grown);
+    environmentDestroy(&copy);
+    copy = grown;
+  }
+
+  // Closure bodies live in the code region, which is handed over as is
+  copy->code = (*environment)->code;
+  (*environment)->code = nullptr;
+#ifdef JIT
+  copy->jit = (*environment)->jit;
+  (*environment)->jit = nullptr;
+#endif
+  environmentDestroy(environment);
+  *environment = copy;
+
+  const size_t live = copy->arena->offset;
+  const size_t threshold = (size_t)((double)live * self->growth);
+  self->threshold =
+      threshold > self->min_threshold ? threshold : self->min_threshold;
+
+  const uint64_t pause = now() - start;
+  self->collections++;
+  self->reclaimed += used > live ? used - live : 0;
+  self->total_pause += pause;
+  self->max_pause = pause > self->max_pause ? pause : self->max_pause;
+  return ok(result_void_t);
+}
+
+result_ref_t gcCopy(const environment_t *environment) {
+  environment_t *copy = nullptr;
+  try(result_ref_t, copyEnvironment(environment, environment->arena->size),
+      copy);
+
+  copy->code = environment->code;
+#ifdef JIT
+  copy->jit = environment->jit;
+#endif
+  return ok(result_ref_t, copy);
+}
+
+void gcRelease(environment_t **copy) {
+  if (!copy || !*copy)
+    return;
+
+  // The code region, and the code compiled from it, belong to the source
+  (*copy)->code = nullptr;
+#ifdef JIT
+  (*copy)->jit = nullptr;
+#endif
+  environmentDestroy(copy);
+}
+
+result_void_t gcMaybeCollect(gc_t *self, environment_t **environment) {
+  if ((*environment)->arena->offset < self->threshold)
+    return ok(result_void_t);
+
+  return gcCollect(self, environment);
+}
+
+#ifdef MEMORY_PROFILE
+void gcReport(const gc_t *self) {
+  printf("\n === Memory Metrics: Garbage Collection ===\n"
+         "    collections: %lu\n"
+         "    reclaimed:   %lu bytes\n"
+         "    threshold:   %lu bytes\n"
+         "    pause:       %0.3f ms total, %0.3f ms max\n",
+         self->collections, self->reclaimed, self->threshold,
+         (double)self->total_pause / 1e6, (double)self->max_pause / 1e6);
+}
+#endif
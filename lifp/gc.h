@@ -0,0 +1,43 @@
+#pragma once
+
+#include "../lib/result.h"
+#include "environment.h"
+#include <stddef.h>
+#include <stdint.h>
+
+// Copying collector for the memory of an environment.
+//
+// Bindings are copied, together with the lists and captures they reference,
+// to a fresh arena which then replaces the old one: anything left
+// behind (redefined values, outgrown maps...) is reclaimed at once. It must
+// only run at safe points, where no evaluation is in flight and bindings are
+// the only live values, such as in between top-level forms.
+typedef struct {
+  size_t threshold;     // Arena bytes in use that trigger a collection
+  size_t min_threshold; // Lower bound for the threshold after collections
+  double growth;        // Heap size is kept above `growth` times live data
+
+  size_t collections;
+  size_t reclaimed;     // Bytes
+  uint64_t total_pause; // Nanoseconds
+  uint64_t max_pause;   // Nanoseconds
+} gc_t;
+
+void gcInit(gc_t *self, size_t threshold, double growth);
+
+// Collects regardless of the threshold. The environment is moved.
+result_void_t gcCollect(gc_t *self, environment_t **environment);
+
+// Collects only if the environment uses more memory than the threshold
+result_void_t gcMaybeCollect(gc_t *self, environment_t **environment);
+
+// Copies the bindings of a global environment to a new one, which shares its
+// code region. Copies can be collected, and must be released with gcRelease.
+result_ref_t gcCopy(const environment_t *environment);
+void gcRelease(environment_t **copy);
+
+#ifdef MEMORY_PROFILE
+void gcReport(const gc_t *self);
+#else
+#define gcReport(Gc)
+#endif
@@ -0,0 +1,438 @@
+// This is for the CI compiler
+#define _POSIX_C_SOURCE 200809L
+
+#include "image.h"
+#include "../lib/list.h"
+#include "../lib/map.h"
+#include "evaluate.h"
+#include "node.h"
+#include "value.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Bump on any change to the records, or to what they decode to
+constexpr uint32_t IMAGE_VERSION = 1;
+constexpr char IMAGE_MAGIC[8] = "lifpi";
+constexpr size_t IMAGE_PATH_SIZE = 4096;
+
+typedef struct {
+  char magic[8];
+  uint32_t version;
+  uint32_t record_size;
+  uint64_t count; // Of records
+  uint64_t bindings;
+} header_t;
+
+typedef enum {
+  RECORD_BINDING,
+  RECORD_VALUE,
+  RECORD_NODE,
+  RECORD_CAPTURE,
+} record_kind_t;
+
+typedef struct {
+  uint32_t kind;
+  // Of the value or of the node
+  uint32_t type;
+  uint32_t line;
+  uint32_t column;
+  // Elements of lists, or captures of closures
+  uint32_t count;
+  // Integers and booleans
+  int32_t scalar;
+  // Whether nodes are local (see escape.c)
+  uint32_t local;
+  uint32_t reserved;
+  // Names of bindings, captures, builtins, and symbol nodes
+  char symbol[MAX_KEY_LENGTH];
+} record_t;
+
+static result_void_t writeRecord(FILE *file, const record_t *record) {
+  if (fwrite(record, sizeof(record_t), 1, file) != 1) {
+    throw(result_void_t, IMAGE_ERROR_IO, nullptr, "cannot write image");
+  }
+  return ok(result_void_t);
+}
+
+static result_void_t writeNode(FILE *file, const node_t *node, size_t *count) {
+  record_t record = {.kind = RECORD_NODE,
+                     .type = (uint32_t)node->type,
+                     .line = (uint32_t)node->position.line,
+                     .column = (uint32_t)node->position.column,
+                     .local = node->local};
+
+  switch (node->type) {
+  case NODE_TYPE_LIST:
+    record.count = (uint32_t)node->value.list.count;
+    break;
+  case NODE_TYPE_INTEGER:
+    record.scalar = node->value.integer;
+    break;
+  case NODE_TYPE_BOOLEAN:
+    record.scalar = node->value.boolean;
+    break;
+  // Quickened symbols keep their name (see node.h)
+  case NODE_TYPE_SYMBOL:
+    memcpy(record.symbol, node->value.symbol, SYMBOL_SIZE);
+    break;
+  case NODE_TYPE_NIL:
+  default:
+    break;
+  }
+
+  try(result_void_t, writeRecord(file, &record));
+  (*count)++;
+
+  for (size_t i = 0; i < record.count; i++) {
+    try(result_void_t, writeNode(file, &node->value.list.data[i], count));
+  }
+  return ok(result_void_t);
+}
+
+static result_void_t writeValue(FILE *file, const value_t *value,
+                                size_t *count) {
+  record_t record = {.kind = RECORD_VALUE,
+                     .type = (uint32_t)value->type,
+                     .line = (uint32_t)value->position.line,
+                     .column = (uint32_t)value->position.column};
+
+  switch (value->type) {
+  case VALUE_TYPE_BOOLEAN:
+    record.scalar = value->value.boolean;
+    break;
+  case VALUE_TYPE_INTEGER:
+    record.scalar = value->value.integer;
+    break;
+  case VALUE_TYPE_BUILTIN: {
+    const char *name = environmentBuiltinName(value->value.builtin);
+    if (!name) {
+      throw(result_void_t, IMAGE_ERROR_INVALID, nullptr,
+            "cannot write builtins that are not part of the standard library");
+    }
+    snprintf(record.symbol, MAX_KEY_LENGTH, "%s", name);
+    break;
+  }
+  case VALUE_TYPE_LIST:
+    record.count = (uint32_t)value->value.list.count;
+    break;
+  case VALUE_TYPE_CLOSURE:
+    record.count = (uint32_t)value->value.closure.captures.count;
+    break;
+  case VALUE_TYPE_NIL:
+  default:
+    break;
+  }
+
+  try(result_void_t, writeRecord(file, &record));
+  (*count)++;
+
+  if (value->type == VALUE_TYPE_LIST) {
+    for (size_t i = 0; i < record.count; i++) {
+      try(result_void_t, writeValue(file, &value->value.list.data[i], count));
+    }
+  }
+
+  if (value->type != VALUE_TYPE_CLOSURE)
+    return ok(result_void_t);
+
+  const closure_t *closure = &value->value.closure;
+  const node_t arguments = {.type = NODE_TYPE_LIST,
+                            .position = closure->form->position,
+                            .value.list = *closure->arguments};
+  try(result_void_t, writeNode(file, closure->form, count));
+  try(result_void_t, writeNode(file, &arguments, count));
+
+  for (size_t i = 0; i < closure->captures.count; i++) {
+    const capture_t *capture = &closure->captures.data[i];
+    record_t capture_record = {.kind = RECORD_CAPTURE};
+    memcpy(capture_record.symbol, capture->symbol, SYMBOL_SIZE);
+    try(result_void_t, writeRecord(file, &capture_record));
+    (*count)++;
+    try(result_void_t, writeValue(file, &capture->value, count));
+  }
+  return ok(result_void_t);
+}
+
+static result_void_t writeImage(FILE *file, const environment_t *environment) {
+  // Counts are known at the end: the header is written again then
+  header_t header = {.version = IMAGE_VERSION,
+                     .record_size = sizeof(record_t)};
+  memcpy(header.magic, IMAGE_MAGIC, sizeof(IMAGE_MAGIC));
+  if (fwrite(&header, sizeof(header_t), 1, file) != 1) {
+    throw(result_void_t, IMAGE_ERROR_IO, nullptr, "cannot write image");
+  }
+
+  size_t count = 0;
+  const auto values = environment->values;
+  for (size_t i = 0; i < values->capacity; i++) {
+    if (!values->used[i])
+      continue;
+
+    record_t record = {.kind = RECORD_BINDING};
+    memcpy(record.symbol, values->keys[i], MAX_KEY_LENGTH);
+    try(result_void_t, writeRecord(file, &record));
+    count++;
+    try(result_void_t, writeValue(file, &values->values[i], &count));
+    header.bindings++;
+  }
+
+  header.count = count;
+  if (fseek(file, 0, SEEK_SET) != 0 ||
+      fwrite(&header, sizeof(header_t), 1, file) != 1) {
+    throw(result_void_t, IMAGE_ERROR_IO, nullptr, "cannot write image");
+  }
+  return ok(result_void_t);
+}
+
+// The image is swapped in at once: readers never see it half written
+result_void_t imageDump(const environment_t *environment, const char *path) {
+  char temporary[IMAGE_PATH_SIZE];
+  snprintf(temporary, IMAGE_PATH_SIZE, "%s.%d", path, getpid());
+
+  FILE *file = fopen(temporary, "wb");
+  if (!file) {
+    throw(result_void_t, IMAGE_ERROR_IO, nullptr, "cannot write '%s'", path);
+  }
+
+  tryWithCleanup(result_void_t, writeImage(file, environment),
+                 (fclose(file), remove(temporary)));
+
+  if (fclose(file) != 0 || rename(temporary, path) != 0) {
+    remove(temporary);
+    throw(result_void_t, IMAGE_ERROR_IO, nullptr, "cannot write '%s'", path);
+  }
+  return ok(result_void_t);
+}
+
+typedef struct {
+  const record_t *records;
+  size_t count;
+  size_t next;
+} reader_t;
+
+// Takes the next record, which must be of `kind`. Anything else, including
+// running out of records, means the image is corrupt.
+static const record_t *take(reader_t *self, record_kind_t kind,
+                            size_t symbol_size) {
+  if (self->next == self->count)
+    return nullptr;
+
+  const record_t *record = &self->records[self->next++];
+  if (record->kind != kind || !memchr(record->symbol, 0, symbol_size))
+    return nullptr;
+  return record;
+}
+
+#define corrupt(Type) throw(Type, IMAGE_ERROR_INVALID, nullptr, "corrupt image")
+
+static result_void_t readNode(reader_t *self, arena_t *code, node_t *node) {
+  const record_t *record = take(self, RECORD_NODE, SYMBOL_SIZE);
+  if (!record)
+    corrupt(result_void_t);
+
+  node->type = (node_type_t)record->type;
+  node->position.line = record->line;
+  node->position.column = record->column;
+  node->local = record->local != 0;
+
+  switch (node->type) {
+  case NODE_TYPE_INTEGER:
+    node->value.integer = record->scalar;
+    return ok(result_void_t);
+  case NODE_TYPE_BOOLEAN:
+    node->value.boolean = record->scalar != 0;
+    return ok(result_void_t);
+  case NODE_TYPE_SYMBOL:
+    memcpy(node->value.symbol, record->symbol, SYMBOL_SIZE);
+    return ok(result_void_t);
+  case NODE_TYPE_NIL:
+    node->value.nil = nullptr;
+    return ok(result_void_t);
+  case NODE_TYPE_LIST:
+    break;
+  default:
+    corrupt(result_void_t);
+  }
+
+  node_list_t *list = nullptr;
+  try(result_void_t,
+      listCreate(node_t, code, record->count ? record->count : 1), list);
+
+  for (size_t i = 0; i < record->count; i++) {
+    node_t element = {};
+    try(result_void_t, readNode(self, code, &element));
+    try(result_void_t, listAppend(node_t, list, &element));
+  }
+  bytewiseCopy(&node->value.list, list, sizeof(node_list_t));
+  return ok(result_void_t);
+}
+
+static result_void_t readValue(reader_t *self, environment_t *environment,
+                               value_t *value);
+
+static result_void_t readClosure(reader_t *self, environment_t *environment,
+                                 const record_t *record, closure_t *closure) {
+  node_t *form = nullptr;
+  try(result_void_t, nodeCreate(environment->code, NODE_TYPE_NIL), form);
+  try(result_void_t, readNode(self, environment->code, form));
+
+  node_t *arguments = nullptr;
+  try(result_void_t, nodeCreate(environment->code, NODE_TYPE_NIL), arguments);
+  try(result_void_t, readNode(self, environment->code, arguments));
+  if (arguments->type != NODE_TYPE_LIST)
+    corrupt(result_void_t);
+
+  closure->form = form;
+  closure->arguments = &arguments->value.list;
+
+  if (record->count == 0)
+    return ok(result_void_t);
+
+  capture_list_t *captures = nullptr;
+  try(result_void_t,
+      listCreate(capture_t, environment->arena, record->count), captures);
+
+  for (size_t i = 0; i < record->count; i++) {
+    const record_t *symbol = take(self, RECORD_CAPTURE, SYMBOL_SIZE);
+    if (!symbol)
+      corrupt(result_void_t);
+
+    capture_t capture = {};
+    memcpy(capture.symbol, symbol->symbol, SYMBOL_SIZE);
+    try(result_void_t, readValue(self, environment, &capture.value));
+    try(result_void_t, listAppend(capture_t, captures, &capture));
+  }
+  bytewiseCopy(&closure->captures, captures, sizeof(capture_list_t));
+  return ok(result_void_t);
+}
+
+static result_void_t readValue(reader_t *self, environment_t *environment,
+                               value_t *value) {
+  const record_t *record = take(self, RECORD_VALUE, MAX_KEY_LENGTH);
+  if (!record)
+    corrupt(result_void_t);
+
+  value->type = (value_type_t)record->type;
+  value->position.line = record->line;
+  value->position.column = record->column;
+
+  switch (value->type) {
+  case VALUE_TYPE_BOOLEAN:
+    value->value.boolean = record->scalar != 0;
+    return ok(result_void_t);
+  case VALUE_TYPE_INTEGER:
+    value->value.integer = record->scalar;
+    return ok(result_void_t);
+  case VALUE_TYPE_NIL:
+    value->value.nil = nullptr;
+    return ok(result_void_t);
+  case VALUE_TYPE_BUILTIN:
+    value->value.builtin = environmentBuiltin(record->symbol);
+    if (!value->value.builtin) {
+      throw(result_void_t, IMAGE_ERROR_INVALID, nullptr,
+            "image references unknown builtin '%s'", record->symbol);
+    }
+    return ok(result_void_t);
+  case VALUE_TYPE_CLOSURE:
+    return readClosure(self, environment, record, &value->value.closure);
+  case VALUE_TYPE_LIST:
+    break;
+  default:
+    corrupt(result_void_t);
+  }
+
+  value_list_t *list = nullptr;
+  try(result_void_t,
+      listCreate(value_t, environment->arena,
+                 record->count ? record->count : 1),
+      list);
+
+  for (size_t i = 0; i < record->count; i++) {
+    value_t item = {};
+    try(result_void_t, readValue(self, environment, &item));
+    try(result_void_t, listAppend(value_t, list, &item));
+  }
+  bytewiseCopy(&value->value.list, list, sizeof(value_list_t));
+  return ok(result_void_t);
+}
+
+static result_void_t readImage(reader_t *reader, size_t bindings, gc_t *gc,
+                               environment_t **environment) {
+  for (size_t i = 0; i < bindings; i++) {
+    const record_t *record = take(reader, RECORD_BINDING, MAX_KEY_LENGTH);
+    if (!record)
+      corrupt(result_void_t);
+
+    value_t value = {};
+    try(result_void_t, readValue(reader, *environment, &value));
+    try(result_void_t, mapSet((*environment)->values, record->symbol, &value));
+
+    if (value.type == VALUE_TYPE_CLOSURE) {
+      value_t *bound = mapGet(value_t, (*environment)->values, record->symbol);
+      try(result_void_t,
+          evaluatePrepare(*environment, &bound->value.closure));
+    }
+
+    // In between bindings, the environment holds the only live values
+    try(result_void_t, gcMaybeCollect(gc, environment));
+  }
+
+  if (reader->next != reader->count)
+    corrupt(result_void_t);
+
+  (*environment)->version++;
+  return ok(result_void_t);
+}
+
+#undef corrupt
+
+result_void_t imageLoad(const char *path, gc_t *gc,
+                        environment_t **environment) {
+  const int file_descriptor = open(path, O_RDONLY);
+  if (file_descriptor < 0) {
+    throw(result_void_t, IMAGE_ERROR_IO, nullptr, "cannot open '%s'", path);
+  }
+
+  struct stat file_stat;
+  if (fstat(file_descriptor, &file_stat) < 0 ||
+      (size_t)file_stat.st_size < sizeof(header_t)) {
+    close(file_descriptor);
+    throw(result_void_t, IMAGE_ERROR_INVALID, nullptr, "'%s' is not an image",
+          path);
+  }
+
+  const size_t size = (size_t)file_stat.st_size;
+  void *memory =
+      mmap(nullptr, size, PROT_READ, MAP_PRIVATE, file_descriptor, 0);
+  close(file_descriptor);
+  if (memory == MAP_FAILED) {
+    throw(result_void_t, IMAGE_ERROR_IO, nullptr, "cannot map '%s'", path);
+  }
+
+  const header_t *header = memory;
+  if (memcmp(header->magic, IMAGE_MAGIC, sizeof(IMAGE_MAGIC)) != 0 ||
+      header->version != IMAGE_VERSION ||
+      header->record_size != sizeof(record_t) ||
+      header->count != (size - sizeof(header_t)) / sizeof(record_t) ||
+      (size - sizeof(header_t)) % sizeof(record_t) != 0) {
+    munmap(memory, size);
+    throw(result_void_t, IMAGE_ERROR_INVALID, nullptr,
+          "'%s' is not an image of this version", path);
+  }
+
+  reader_t reader = {
+      .records = (const void *)&header[1],
+      .count = header->count,
+      .next = 0,
+  };
+  tryWithCleanup(result_void_t,
+                 readImage(&reader, header->bindings, gc, environment),
+                 munmap(memory, size));
+
+  munmap(memory, size);
+  return ok(result_void_t);
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include "../lib/result.h"
+#include "environment.h"
+#include "error.h"
+#include "gc.h"
+
+// Snapshot of the global environment.
+//
+// Bindings are written as a flat array of fixed-size records in preorder:
+// values followed by their elements, closures by their body, parameters and
+// captures. Builtins are referenced by name and nothing in the file is an
+// address, so images load in any process running the same interpreter.
+//
+// Loading maps the image read-only and decodes the records straight into the
+// environment memory: closure bodies into its code region, everything else
+// into its arena. Bodies come back unquickened, and are specialized again by
+// their first evaluation.
+typedef enum {
+  IMAGE_ERROR_IO = ERROR_CODE_RUNTIME_ERROR + 1,
+  IMAGE_ERROR_INVALID,
+} image_error_t;
+
+// Writes the bindings of the global environment to `path`
+result_void_t imageDump(const environment_t *environment, const char *path);
+
+// Binds the values of the image at `path` in the global environment. It's
+// collected as needed along the way, so it's moved like with gcCollect.
+result_void_t imageLoad(const char *path, gc_t *gc,
+                        environment_t **environment);
@@ -0,0 +1,142 @@
+#include "intern.h"
+#include "../lib/arena.h"
+#include <stdio.h>
+#include <string.h>
+
+static constexpr uint64_t FNV_OFFSET = 14695981039346656037U;
+static constexpr uint64_t FNV_PRIME = 1099511628211U;
+
+static uint64_t mix(uint64_t hash, uint64_t value) {
+  return (hash ^ value) * FNV_PRIME;
+}
+
+static uint64_t hashNode(const node_t *node) {
+  uint64_t hash = mix(FNV_OFFSET, (uint64_t)node->type);
+  hash = mix(hash, (uint64_t)node->position.line);
+  hash = mix(hash, (uint64_t)node->position.column);
+
+  switch (node->type) {
+  case NODE_TYPE_INTEGER:
+    return mix(hash, (uint64_t)(uint32_t)node->value.integer);
+  case NODE_TYPE_BOOLEAN:
+    return mix(hash, (uint64_t)node->value.boolean);
+  case NODE_TYPE_SYMBOL:
+    for (const char *c = node->value.symbol; *c; c++) {
+      hash = mix(hash, (uint64_t)(unsigned char)*c);
+    }
+    return hash;
+  case NODE_TYPE_LIST:
+    hash = mix(hash, (uint64_t)(uintptr_t)node->value.list.data);
+    return mix(hash, (uint64_t)node->value.list.count);
+  case NODE_TYPE_NIL:
+  default:
+    return hash;
+  }
+}
+
+static bool nodeEquals(const node_t *left, const node_t *right) {
+  if (left->type != right->type ||
+      left->position.line != right->position.line ||
+      left->position.column != right->position.column)
+    return false;
+
+  switch (left->type) {
+  case NODE_TYPE_INTEGER:
+    return left->value.integer == right->value.integer;
+  case NODE_TYPE_BOOLEAN:
+    return left->value.boolean == right->value.boolean;
+  case NODE_TYPE_SYMBOL:
+    return strcmp(left->value.symbol, right->value.symbol) == 0;
+  case NODE_TYPE_LIST:
+    return left->value.list.data == right->value.list.data &&
+           left->value.list.count == right->value.list.count;
+  case NODE_TYPE_NIL:
+  default:
+    return true;
+  }
+}
+
+result_ref_t internCreate(size_t capacity) {
+  // Probing stays short as long as the table is at most half full
+  size_t slots = 1;
+  while (slots < capacity * 2) {
+    slots *= 2;
+  }
+
+  arena_t *arena = nullptr;
+  try(result_ref_t,
+      arenaCreate(sizeof(intern_t) + (sizeof(intern_entry_t) * slots) + 8),
+      arena);
+
+  intern_t *intern = nullptr;
+  tryWithCleanup(result_ref_t, arenaAllocate(arena, sizeof(intern_t)),
+                 arenaDestroy(&arena), intern);
+  tryWithCleanup(result_ref_t,
+                 arenaAllocate(arena, sizeof(intern_entry_t) * slots),
+                 arenaDestroy(&arena), intern->entries);
+
+  intern->arena = arena;
+  intern->capacity = capacity;
+  intern->slots = slots;
+  return ok(result_ref_t, intern);
+}
+
+void internDestroy(intern_t **self) {
+  if (!self || !*self)
+    return;
+
+  // The table is allocated on its own arena
+  arena_t *arena = (*self)->arena;
+  arenaDestroy(&arena);
+  *self = nullptr;
+}
+
+void internReset(intern_t *self) {
+  memset(self->entries, 0, sizeof(intern_entry_t) * self->slots);
+  self->count = 0;
+}
+
+node_t *internList(intern_t *self, const node_list_t *list) {
+  uint64_t hash = mix(FNV_OFFSET, (uint64_t)list->count);
+  for (size_t i = 0; i < list->count; i++) {
+    hash = mix(hash, hashNode(&list->data[i]));
+  }
+
+  const size_t mask = self->slots - 1;
+  for (size_t slot = hash & mask;; slot = (slot + 1) & mask) {
+    intern_entry_t *entry = &self->entries[slot];
+
+    if (!entry->elements) {
+      if (self->count >= self->capacity)
+        return list->data;
+
+      entry->hash = hash;
+      entry->elements = list->data;
+      entry->count = list->count;
+      self->count++;
+      return list->data;
+    }
+
+    if (entry->hash != hash || entry->count != list->count)
+      continue;
+
+    bool equals = true;
+    for (size_t i = 0; i < list->count && equals; i++) {
+      equals = nodeEquals(&entry->elements[i], &list->data[i]);
+    }
+
+    if (equals) {
+      self->hits++;
+      return entry->elements;
+    }
+  }
+}
+
+#ifdef MEMORY_PROFILE
+void internReport(const intern_t *self) {
+  printf("\n === Memory Metrics: Hash Consing ===\n"
+         "    shared:    %lu lists\n"
+         "    reclaimed: %lu bytes\n",
+         self->hits, self->reclaimed);
+}
+#endif
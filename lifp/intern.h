@@ -0,0 +1,51 @@
+#pragma once
+
+#include "../lib/arena.h"
+#include "../lib/result.h"
+#include "node.h"
+#include <stddef.h>
+#include <stdint.h>
+
+// Hash-consing table for AST lists.
+//
+// Lists with the same elements share them: they take AST memory once and are
+// the very same nodes, so that anything cached on a node is shared too.
+// Elements are compared by value and position for atoms and by identity for
+// lists, which is enough once lists are interned bottom-up.
+//
+// Positions are compared so that errors point at the occurrence that raised
+// them: repeated subtrees at different places in a source stay apart, and it
+// is forms read again from the same source while the table lives that share.
+// The AST must be immutable once interned, and the table reset along with the
+// AST arena.
+typedef struct {
+  uint64_t hash;
+  node_t *elements;
+  size_t count;
+} intern_entry_t;
+
+typedef struct {
+  arena_t *arena;
+  size_t capacity; // Lists the table can hold
+  size_t count;
+  size_t slots; // Power of two, kept at least twice the capacity
+  intern_entry_t *entries;
+
+  size_t hits;
+  size_t reclaimed; // Bytes of AST memory given back on hits
+} intern_t;
+
+// The table can hold `capacity` lists: past that, lists are not interned
+result_ref_t internCreate(size_t capacity);
+void internDestroy(intern_t **self);
+void internReset(intern_t *self);
+
+// Returns the elements of a list equal to `list`, or records `list` and
+// returns its own elements when there is none
+node_t *internList(intern_t *self, const node_list_t *list);
+
+#ifdef MEMORY_PROFILE
+void internReport(const intern_t *self);
+#else
+#define internReport(Intern)
+#endif
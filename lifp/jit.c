@@ -0,0 +1,672 @@
+// This is for the CI compiler
+#define _DEFAULT_SOURCE
+
+#include "jit.h"
+#include "../lib/arena.h"
+#include "environment.h"
+#include "evaluate.h"
+#include "node.h"
+#include <stddef.h>
+#include <stdint.h>
+
+// Baseline compiler
+// ---
+//
+// With JIT, every call to a closure bound by def! is counted, and the body of
+// the closures called more than JIT_THRESHOLD times is compiled to x86-64
+// machine code. Each node is translated to a fixed template, leaving its value
+// in rax: arguments are read from an array of integers, let bindings are
+// pushed on the native stack, and calls of the closure to itself are native
+// calls.
+//
+// Types are checked when compiling: arguments are integers, conditions are
+// booleans, and builtins take two integers. Anything else (globals other than
+// callees, captures, lists, nil, other closures, calls with arguments other
+// than integers) is left to the interpreter. Compiled code that can't go on,
+// like on too deep a recursion, bails out and the call is run again by the
+// interpreter: compiled bodies have no side effects.
+//
+// Only x86-64 Linux has a backend. Elsewhere, arm64 included, or when built
+// with JIT_PORTABLE, nothing is compiled: closures fail to compile once they
+// are hot, and every call is left to the interpreter, with the same results.
+//
+// ```sh
+// make JIT=1 bin/run
+// perf record -g bin/run script.lifp
+// ```
+
+#ifdef JIT
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+constexpr size_t JIT_THRESHOLD = 64;
+constexpr size_t JIT_ENTRIES_BITS = 8;
+constexpr size_t JIT_ENTRIES = (size_t)1 << JIT_ENTRIES_BITS;
+constexpr size_t JIT_CODE_SIZE = 4096;
+constexpr size_t JIT_ARGUMENTS = 8;
+constexpr int64_t JIT_MAX_DEPTH = 10000;
+
+typedef enum {
+  JIT_TYPE_INTEGER,
+  JIT_TYPE_BOOLEAN,
+} jit_type_t;
+
+// Compiled bodies return their value in rax, and whether they bailed out in
+// rdx
+typedef struct {
+  int64_t value;
+  int64_t bailed;
+} jit_return_t;
+static_assert(sizeof(jit_return_t) == 16, "returned in two registers");
+
+typedef jit_return_t (*jit_function_t)(const int64_t *arguments,
+                                       int64_t depth);
+
+typedef struct {
+  const node_t *form;
+  size_t calls;
+  // Version of the global environment callees were resolved in
+  size_t version;
+  bool failed;
+  jit_type_t type;
+  jit_function_t function;
+  void *memory;
+  size_t size;
+} jit_entry_t;
+
+struct jit_t {
+  arena_t *arena;
+  jit_entry_t *entries;
+};
+
+result_ref_t jitCreate(void) {
+  arena_t *arena = nullptr;
+  try(result_ref_t,
+      arenaCreate(sizeof(jit_t) + JIT_ENTRIES * sizeof(jit_entry_t)), arena);
+
+  jit_t *jit = nullptr;
+  tryWithCleanup(result_ref_t, arenaAllocate(arena, sizeof(jit_t)),
+                 arenaDestroy(&arena), jit);
+  jit->arena = arena;
+
+  tryWithCleanup(result_ref_t,
+                 arenaAllocate(arena, JIT_ENTRIES * sizeof(jit_entry_t)),
+                 arenaDestroy(&arena), jit->entries);
+
+  return ok(result_ref_t, jit);
+}
+
+static void release(jit_entry_t *entry) {
+  if (entry->memory) {
+    munmap(entry->memory, entry->size);
+  }
+  entry->memory = nullptr;
+  entry->function = nullptr;
+}
+
+void jitDestroy(jit_t **self) {
+  if (!self || !*self)
+    return;
+
+  for (size_t i = 0; i < JIT_ENTRIES; i++) {
+    release(&(*self)->entries[i]);
+  }
+
+  arena_t *arena = (*self)->arena;
+  arenaDestroy(&arena);
+  *self = nullptr;
+}
+
+// Entries are keyed by the address of the body, from this slot on
+static size_t slotOf(const node_t *form) {
+  // Bodies sit at multiples of the node size apart, so their lower bits say
+  // little: the top bits of the address times 2^64 over the golden ratio mix
+  // all of them
+  const uint64_t address = (uint64_t)(uintptr_t)form;
+  return (size_t)((address * 0x9e3779b97f4a7c15U) >> (64 - JIT_ENTRIES_BITS));
+}
+
+// It's null when the table is full
+static jit_entry_t *entryOf(jit_t *self, const node_t *form) {
+  const size_t start = slotOf(form);
+  for (size_t i = 0; i < JIT_ENTRIES; i++) {
+    jit_entry_t *entry = &self->entries[(start + i) & (JIT_ENTRIES - 1)];
+    if (entry->form == form)
+      return entry;
+
+    if (!entry->form) {
+      entry->form = form;
+      return entry;
+    }
+  }
+  return nullptr;
+}
+
+void jitForget(jit_t *self, const arena_t *code) {
+  if (!self)
+    return;
+
+  // Entries are placed again from scratch, so that no probe stops at the
+  // hole a forgotten entry left
+  jit_entry_t entries[JIT_ENTRIES];
+  memcpy(entries, self->entries, sizeof(entries));
+  memset(self->entries, 0, sizeof(entries));
+
+  for (size_t i = 0; i < JIT_ENTRIES; i++) {
+    jit_entry_t *entry = &entries[i];
+    if (!entry->form)
+      continue;
+
+    if (!arenaOwns(code, entry->form)) {
+      release(entry);
+      continue;
+    }
+
+    size_t slot = slotOf(entry->form);
+    while (self->entries[slot].form) {
+      slot = (slot + 1) & (JIT_ENTRIES - 1);
+    }
+    self->entries[slot] = *entry;
+  }
+}
+
+#ifdef JIT_NATIVE
+typedef struct {
+  uint8_t code[JIT_CODE_SIZE];
+  size_t size;
+  bool overflow;
+  // Jumps to the bail-out epilogue, chained through their displacement
+  size_t bails;
+  // Values pushed on the frame, past the saved registers
+  size_t depth;
+  environment_t *globals;
+  const closure_t *closure;
+  // Type of the values returned by calls of the closure to itself
+  jit_type_t type;
+} assembler_t;
+
+// Symbols bound by the arguments and the let forms of the body
+typedef struct slot_t {
+  const char *symbol;
+  // Arguments are read from the caller's array, bindings from the frame
+  bool argument;
+  size_t index;
+  jit_type_t type;
+  const struct slot_t *parent;
+} slot_t;
+
+// Machine code of the builtins taking eax and ecx
+typedef struct {
+  builtin_t builtin;
+  jit_type_t type;
+  // Instruction for integers, setcc for booleans
+  uint8_t code[3];
+  size_t size;
+} operation_t;
+
+static const operation_t OPERATIONS[] = {
+    {sum, JIT_TYPE_INTEGER, {0x01, 0xC8}, 2},            // add eax, ecx
+    {subtract, JIT_TYPE_INTEGER, {0x29, 0xC8}, 2},       // sub eax, ecx
+    {multiply, JIT_TYPE_INTEGER, {0x0F, 0xAF, 0xC1}, 3}, // imul eax, ecx
+    {equal, JIT_TYPE_BOOLEAN, {0x0F, 0x94, 0xC0}, 3},    // sete al
+    {lessThan, JIT_TYPE_BOOLEAN, {0x0F, 0x9C, 0xC0}, 3}, // setl al
+    {greaterThan, JIT_TYPE_BOOLEAN, {0x0F, 0x9F, 0xC0}, 3},  // setg al
+    {lessEqual, JIT_TYPE_BOOLEAN, {0x0F, 0x9E, 0xC0}, 3},    // setle al
+    {greaterEqual, JIT_TYPE_BOOLEAN, {0x0F, 0x9D, 0xC0}, 3}, // setge al
+};
+
+static void emitBytes(assembler_t *assembler, size_t count,
+                      const uint8_t *bytes) {
+  if (assembler->size + count > JIT_CODE_SIZE) {
+    assembler->overflow = true;
+    return;
+  }
+  memcpy(&assembler->code[assembler->size], bytes, count);
+  assembler->size += count;
+}
+
+#define emit(Assembler, ...)                                                   \
+  emitBytes((Assembler), sizeof((const uint8_t[]){__VA_ARGS__}),               \
+            (const uint8_t[]){__VA_ARGS__})
+
+static void emit32(assembler_t *assembler, uint32_t value) {
+  emit(assembler, (uint8_t)value, (uint8_t)(value >> 8),
+       (uint8_t)(value >> 16), (uint8_t)(value >> 24));
+}
+
+// Emits the displacement of a forward jump, linking it to `chain` until its
+// target is known. Nothing jumps from offset 0, which ends chains.
+static void emitLink(assembler_t *assembler, size_t *chain) {
+  const size_t at = assembler->size;
+  emit32(assembler, (uint32_t)*chain);
+  *chain = at;
+}
+
+// Points the jumps linked in `chain` to the current offset
+static void patchChain(assembler_t *assembler, size_t chain) {
+  if (assembler->overflow)
+    return;
+
+  while (chain) {
+    uint32_t next;
+    memcpy(&next, &assembler->code[chain], sizeof(uint32_t));
+    const uint32_t displacement = (uint32_t)(assembler->size - chain - 4);
+    memcpy(&assembler->code[chain], &displacement, sizeof(uint32_t));
+    chain = next;
+  }
+}
+
+static void push(assembler_t *assembler) {
+  emit(assembler, 0x50); // push rax
+  assembler->depth++;
+}
+
+static void epilogue(assembler_t *assembler) {
+  emit(assembler, 0x48, 0x8D, 0x65, 0xF0); // lea rsp, [rbp - 16]
+  emit(assembler, 0x41, 0x5C);             // pop r12
+  emit(assembler, 0x5B);                   // pop rbx
+  emit(assembler, 0x5D);                   // pop rbp
+  emit(assembler, 0xC3);                   // ret
+}
+
+static const slot_t *lookupSlot(const slot_t *scope, const char *symbol) {
+  for (; scope; scope = scope->parent) {
+    if (strcmp(scope->symbol, symbol) == 0)
+      return scope;
+  }
+  return nullptr;
+}
+
+static bool compileNode(assembler_t *assembler, const node_t *node,
+                        const slot_t *scope, jit_type_t *type);
+
+static bool compileOperation(assembler_t *assembler, const node_list_t *list,
+                             const operation_t *operation,
+                             const slot_t *scope, jit_type_t *type) {
+  jit_type_t left;
+  jit_type_t right;
+  if (list->count != 3 ||
+      !compileNode(assembler, &list->data[1], scope, &left) ||
+      left != JIT_TYPE_INTEGER)
+    return false;
+
+  push(assembler);
+  if (!compileNode(assembler, &list->data[2], scope, &right) ||
+      right != JIT_TYPE_INTEGER)
+    return false;
+
+  emit(assembler, 0x48, 0x89, 0xC1); // mov rcx, rax
+  emit(assembler, 0x58);             // pop rax
+  assembler->depth--;
+
+  // Integers are 32 bits and wrap around, like in the builtins
+  if (operation->type == JIT_TYPE_INTEGER) {
+    emitBytes(assembler, operation->size, operation->code);
+    emit(assembler, 0x48, 0x63, 0xC0); // movsxd rax, eax
+  } else {
+    emit(assembler, 0x39, 0xC8); // cmp eax, ecx
+    emitBytes(assembler, operation->size, operation->code);
+    emit(assembler, 0x0F, 0xB6, 0xC0); // movzx eax, al
+  }
+
+  *type = operation->type;
+  return true;
+}
+
+// Arguments are pushed in reverse, so that the callee reads them as an array
+static bool compileSelfCall(assembler_t *assembler, const node_list_t *list,
+                            const slot_t *scope, jit_type_t *type) {
+  const size_t count = list->count - 1;
+  for (size_t i = count; i > 0; i--) {
+    jit_type_t argument;
+    if (!compileNode(assembler, &list->data[i], scope, &argument) ||
+        argument != JIT_TYPE_INTEGER)
+      return false;
+    push(assembler);
+  }
+
+  emit(assembler, 0x48, 0x89, 0xE7); // mov rdi, rsp
+  emit(assembler, 0x4C, 0x89, 0xE6); // mov rsi, r12
+  emit(assembler, 0xE8);             // call, back to the entry
+  emit32(assembler, (uint32_t)-(int64_t)(assembler->size + 4));
+  emit(assembler, 0x48, 0x81, 0xC4); // add rsp, imm32
+  emit32(assembler, (uint32_t)(count * 8));
+  assembler->depth -= count;
+
+  emit(assembler, 0x48, 0x85, 0xD2); // test rdx, rdx
+  emit(assembler, 0x0F, 0x85);       // jnz bail
+  emitLink(assembler, &assembler->bails);
+
+  *type = assembler->type;
+  return true;
+}
+
+static bool compileBranch(assembler_t *assembler, const node_t *node,
+                          const slot_t *scope, jit_type_t *type,
+                          bool *typed) {
+  jit_type_t branch;
+  if (!compileNode(assembler, node, scope, &branch) ||
+      (*typed && branch != *type))
+    return false;
+
+  *type = branch;
+  *typed = true;
+  return true;
+}
+
+// Clauses test their condition and jump to the next one when it's false, or
+// jump past the fallback once their value is in rax
+static bool compileCond(assembler_t *assembler, const node_list_t *list,
+                        const slot_t *scope, jit_type_t *type) {
+  if (list->count < 2)
+    return false;
+
+  bool typed = false;
+  size_t exits = 0;
+  for (size_t i = 1; i < list->count - 1; i++) {
+    const node_t *clause = &list->data[i];
+    if (clause->type != NODE_TYPE_LIST || clause->value.list.count != 2)
+      return false;
+
+    jit_type_t test;
+    if (!compileNode(assembler, &clause->value.list.data[0], scope, &test) ||
+        test != JIT_TYPE_BOOLEAN)
+      return false;
+
+    size_t next = 0;
+    emit(assembler, 0x85, 0xC0); // test eax, eax
+    emit(assembler, 0x0F, 0x84); // je next
+    emitLink(assembler, &next);
+
+    if (!compileBranch(assembler, &clause->value.list.data[1], scope, type,
+                       &typed))
+      return false;
+
+    emit(assembler, 0xE9); // jmp exit
+    emitLink(assembler, &exits);
+    patchChain(assembler, next);
+  }
+
+  if (!compileBranch(assembler, &list->data[list->count - 1], scope, type,
+                     &typed))
+    return false;
+
+  patchChain(assembler, exits);
+  return true;
+}
+
+// Bindings are pushed one at a time, as they see the ones before them
+static bool compileBindings(assembler_t *assembler,
+                            const node_list_t *couples, size_t index,
+                            const node_t *body, const slot_t *scope,
+                            jit_type_t *type) {
+  if (index == couples->count)
+    return compileNode(assembler, body, scope, type);
+
+  const node_t *couple = &couples->data[index];
+  if (couple->type != NODE_TYPE_LIST || couple->value.list.count != 2 ||
+      couple->value.list.data[0].type != NODE_TYPE_SYMBOL)
+    return false;
+
+  slot_t slot = {.symbol = couple->value.list.data[0].value.symbol,
+                 .argument = false,
+                 .index = assembler->depth,
+                 .parent = scope};
+  if (!compileNode(assembler, &couple->value.list.data[1], scope, &slot.type))
+    return false;
+
+  push(assembler);
+  if (!compileBindings(assembler, couples, index + 1, body, &slot, type))
+    return false;
+
+  emit(assembler, 0x48, 0x83, 0xC4, 0x08); // add rsp, 8
+  assembler->depth--;
+  return true;
+}
+
+static bool compileList(assembler_t *assembler, const node_list_t *list,
+                        const slot_t *scope, jit_type_t *type) {
+  if (list->count == 0 || list->data[0].type != NODE_TYPE_SYMBOL)
+    return false;
+
+  const char *symbol = list->data[0].value.symbol;
+  if (strcmp(symbol, DEFINE) == 0 || strcmp(symbol, FUNCTION) == 0)
+    return false;
+
+  if (strcmp(symbol, LET) == 0) {
+    if (list->count != 3 || list->data[1].type != NODE_TYPE_LIST)
+      return false;
+    return compileBindings(assembler, &list->data[1].value.list, 0,
+                           &list->data[2], scope, type);
+  }
+
+  if (strcmp(symbol, COND) == 0)
+    return compileCond(assembler, list, scope, type);
+
+  // Callees are resolved once: rebinding them takes a new version
+  if (lookupSlot(scope, symbol))
+    return false;
+
+  const value_t *callee = environmentResolveSymbol(assembler->globals, symbol);
+  if (!callee)
+    return false;
+
+  if (callee->type == VALUE_TYPE_BUILTIN) {
+    const size_t count = sizeof(OPERATIONS) / sizeof(operation_t);
+    for (size_t i = 0; i < count; i++) {
+      if (OPERATIONS[i].builtin == callee->value.builtin)
+        return compileOperation(assembler, list, &OPERATIONS[i], scope, type);
+    }
+    return false;
+  }
+
+  const closure_t *closure = assembler->closure;
+  if (callee->type == VALUE_TYPE_CLOSURE &&
+      callee->value.closure.form == closure->form &&
+      callee->value.closure.captures.count == 0 &&
+      list->count - 1 == closure->arguments->count)
+    return compileSelfCall(assembler, list, scope, type);
+
+  return false;
+}
+
+static bool compileNode(assembler_t *assembler, const node_t *node,
+                        const slot_t *scope, jit_type_t *type) {
+  switch (node->type) {
+  case NODE_TYPE_INTEGER:
+    emit(assembler, 0x48, 0xC7, 0xC0); // mov rax, imm32
+    emit32(assembler, (uint32_t)node->value.integer);
+    *type = JIT_TYPE_INTEGER;
+    return true;
+  case NODE_TYPE_BOOLEAN:
+    emit(assembler, 0x48, 0xC7, 0xC0); // mov rax, imm32
+    emit32(assembler, node->value.boolean ? 1 : 0);
+    *type = JIT_TYPE_BOOLEAN;
+    return true;
+  case NODE_TYPE_SYMBOL: {
+    const slot_t *slot = lookupSlot(scope, node->value.symbol);
+    if (!slot)
+      return false;
+
+    if (slot->argument) {
+      emit(assembler, 0x48, 0x8B, 0x83); // mov rax, [rbx + disp32]
+      emit32(assembler, (uint32_t)(slot->index * 8));
+    } else {
+      // Below the saved rbx and r12
+      const int64_t offset = -24 - (8 * (int64_t)slot->index);
+      emit(assembler, 0x48, 0x8B, 0x85); // mov rax, [rbp + disp32]
+      emit32(assembler, (uint32_t)offset);
+    }
+    *type = slot->type;
+    return true;
+  }
+  case NODE_TYPE_LIST:
+    return compileList(assembler, &node->value.list, scope, type);
+  case NODE_TYPE_NIL:
+  default:
+    return false;
+  }
+}
+
+// Compiled bodies take the arguments in rdi, and the calls left before
+// bailing out in rsi
+static bool assemble(assembler_t *assembler, const slot_t *scope,
+                     jit_type_t *type) {
+  emit(assembler, 0x55);                   // push rbp
+  emit(assembler, 0x48, 0x89, 0xE5);       // mov rbp, rsp
+  emit(assembler, 0x53);                   // push rbx
+  emit(assembler, 0x41, 0x54);             // push r12
+  emit(assembler, 0x48, 0x89, 0xFB);       // mov rbx, rdi
+  emit(assembler, 0x49, 0x89, 0xF4);       // mov r12, rsi
+  emit(assembler, 0x49, 0x83, 0xEC, 0x01); // sub r12, 1
+  emit(assembler, 0x0F, 0x8C);             // jl bail
+  emitLink(assembler, &assembler->bails);
+
+  if (!compileNode(assembler, assembler->closure->form, scope, type))
+    return false;
+
+  emit(assembler, 0x31, 0xD2); // xor edx, edx
+  epilogue(assembler);
+
+  patchChain(assembler, assembler->bails);
+  emit(assembler, 0xBA); // mov edx, imm32
+  emit32(assembler, 1);
+  epilogue(assembler);
+
+  return !assembler->overflow;
+}
+
+// perf names the frames of generated code through /tmp/perf-<pid>.map
+static void perfMap(const void *code, size_t size, const node_t *form) {
+  char path[64];
+  snprintf(path, sizeof(path), "/tmp/perf-%d.map", getpid());
+  FILE *map = fopen(path, "a");
+  if (!map)
+    return;
+
+  fprintf(map, "%lx %zx lifp:fn@%zu:%zu\n", (unsigned long)(uintptr_t)code,
+          size, form->position.line, form->position.column);
+  fclose(map);
+}
+
+// Pages are never writable and executable at once
+static bool install(jit_entry_t *entry, const assembler_t *assembler) {
+  const size_t page = (size_t)sysconf(_SC_PAGESIZE);
+  const size_t size = (assembler->size + page - 1) / page * page;
+
+  void *memory = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (memory == MAP_FAILED)
+    return false;
+
+  memcpy(memory, assembler->code, assembler->size);
+  if (mprotect(memory, size, PROT_READ | PROT_EXEC) != 0) {
+    munmap(memory, size);
+    return false;
+  }
+
+  entry->memory = memory;
+  entry->size = size;
+  entry->function = (jit_function_t)memory;
+  perfMap(memory, assembler->size, entry->form);
+  return true;
+}
+
+// Calls of the closure to itself are assumed to return integers first, then
+// booleans: the assumption holds if the body returns the same type
+static bool compile(jit_entry_t *entry, environment_t *globals,
+                    const closure_t *closure) {
+  const node_list_t *arguments = closure->arguments;
+  slot_t slots[JIT_ARGUMENTS];
+  const slot_t *scope = nullptr;
+  for (size_t i = 0; i < arguments->count; i++) {
+    const node_t *argument = &arguments->data[i];
+    if (argument->type != NODE_TYPE_SYMBOL)
+      return false;
+
+    slots[i] = (slot_t){.symbol = argument->value.symbol,
+                        .argument = true,
+                        .index = i,
+                        .type = JIT_TYPE_INTEGER,
+                        .parent = scope};
+    scope = &slots[i];
+  }
+
+  const jit_type_t types[] = {JIT_TYPE_INTEGER, JIT_TYPE_BOOLEAN};
+  for (size_t i = 0; i < sizeof(types) / sizeof(jit_type_t); i++) {
+    assembler_t assembler = {
+        .globals = globals, .closure = closure, .type = types[i]};
+    jit_type_t type;
+    if (assemble(&assembler, scope, &type) && type == types[i]) {
+      entry->type = type;
+      return install(entry, &assembler);
+    }
+  }
+  return false;
+}
+#else
+static bool compile(jit_entry_t *entry, environment_t *globals,
+                    const closure_t *closure) {
+  (void)entry;
+  (void)globals;
+  (void)closure;
+  return false;
+}
+#endif
+
+bool jitInvoke(jit_t *self, environment_t *globals, const closure_t *closure,
+               const value_list_t *values, value_t *result) {
+  // Bodies elsewhere don't outlive their form, and their address may be
+  // reused by another one
+  if (!self || closure->captures.count > 0 ||
+      closure->arguments->count > JIT_ARGUMENTS ||
+      !arenaOwns(globals->code, closure->form))
+    return false;
+
+  int64_t arguments[JIT_ARGUMENTS];
+  for (size_t i = 1; i < values->count; i++) {
+    const value_t *value = &values->data[i];
+    if (value->type != VALUE_TYPE_INTEGER)
+      return false;
+    arguments[i - 1] = value->value.integer;
+  }
+
+  jit_entry_t *entry = entryOf(self, closure->form);
+  if (!entry)
+    return false;
+
+  if (entry->version != globals->version) {
+    release(entry);
+    entry->failed = false;
+    entry->version = globals->version;
+  }
+
+  if (entry->failed)
+    return false;
+
+  if (!entry->function) {
+    if (++entry->calls < JIT_THRESHOLD)
+      return false;
+
+    entry->failed = !compile(entry, globals, closure);
+    if (entry->failed)
+      return false;
+  }
+
+  const jit_return_t returned = entry->function(arguments, JIT_MAX_DEPTH);
+  if (returned.bailed)
+    return false;
+
+  if (entry->type == JIT_TYPE_INTEGER) {
+    result->type = VALUE_TYPE_INTEGER;
+    result->value.integer = (int32_t)returned.value;
+  } else {
+    result->type = VALUE_TYPE_BOOLEAN;
+    result->value.boolean = returned.value != 0;
+  }
+  return true;
+}
+#endif
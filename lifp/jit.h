@@ -0,0 +1,33 @@
+#pragma once
+
+#include "../lib/result.h"
+#include "environment.h"
+#include "value.h"
+
+// Baseline compiler for hot closures.
+//
+// Closures invoked more than a threshold number of times are compiled to
+// native code, one template of machine code per form. Only integer and
+// boolean code is compiled: literals, arguments, let, cond, arithmetic and
+// comparison builtins, and calls of the closure to itself. Anything else, and
+// every architecture other than x86-64, is left to the interpreter.
+//
+// Compiled closures are listed in /tmp/perf-<pid>.map, so that perf can name
+// their frames.
+// Architectures with a backend: elsewhere, calls all run on the interpreter
+#if defined(__x86_64__) && defined(__linux__) && !defined(JIT_PORTABLE)
+#define JIT_NATIVE
+#endif
+
+typedef struct jit_t jit_t;
+
+result_ref_t jitCreate(void);
+void jitDestroy(jit_t **self);
+
+// Drops the code compiled from bodies `code` no longer holds, once rewound
+void jitForget(jit_t *self, const arena_t *code);
+
+// Runs the closure called with `values` natively, if it's hot and can be
+// compiled. It's false when the call is left to the interpreter.
+bool jitInvoke(jit_t *self, environment_t *globals, const closure_t *closure,
+               const value_list_t *values, value_t *result);
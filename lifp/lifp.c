@@ -0,0 +1,218 @@
+// This is for the CI compiler
+#define _POSIX_C_SOURCE 200809L
+
+#include "lifp.h"
+#include "../lib/alloc.h"
+#include "../lib/arena.h"
+#include "../lib/map.h"
+#include "../lib/profile.h"
+#include "environment.h"
+#include "evaluate.h"
+#include "gc.h"
+#include "intern.h"
+#include "parse.h"
+#include "tokenize.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Memory allocated for AST parsing
+constexpr size_t AST_MEMORY = (size_t)(1024 * 64);
+
+// Memory allocated for storing transient values across environments
+constexpr size_t TEMP_MEMORY = (size_t)(1024 * 64);
+
+// Distinct lists of a form sharing their elements with equal ones
+constexpr size_t INTERN_CAPACITY = 1024;
+
+// Environment memory in use before the first garbage collection
+constexpr size_t GC_THRESHOLD = (size_t)(1024 * 16);
+
+// Environment memory is kept at least this many times the live data
+constexpr double GC_GROWTH = 2.0;
+
+struct lifp_vm_t {
+  arena_t *ast_arena;
+  arena_t *temp_arena;
+  intern_t *intern;
+  environment_t *environment;
+  gc_t gc;
+#ifdef MEMORY_PROFILE
+  // Metrics of whatever the machine does, in use while it runs
+  profile_t profile;
+#endif
+};
+
+#ifdef MEMORY_PROFILE
+#define enterProfile(Self) profile_t *previous = profileUse(&(Self)->profile)
+#define leaveProfile() profileUse(previous)
+#else
+#define enterProfile(Self)
+#define leaveProfile()
+#endif
+
+static result_void_t initialize(lifp_vm_t *self) {
+  try(result_void_t, arenaCreate(AST_MEMORY), self->ast_arena);
+  try(result_void_t, arenaCreate(TEMP_MEMORY), self->temp_arena);
+  try(result_void_t, internCreate(INTERN_CAPACITY), self->intern);
+  try(result_void_t, environmentCreate(nullptr), self->environment);
+  return ok(result_void_t);
+}
+
+result_ref_t lifpCreate(void) {
+  lifp_vm_t *self = nullptr;
+  try(result_ref_t, allocSafe(sizeof(lifp_vm_t)), self);
+  self->ast_arena = nullptr;
+  self->temp_arena = nullptr;
+  self->intern = nullptr;
+  self->environment = nullptr;
+  gcInit(&self->gc, GC_THRESHOLD, GC_GROWTH);
+#ifdef MEMORY_PROFILE
+  self->profile = (profile_t){};
+#endif
+
+  enterProfile(self);
+  profileInit();
+  const auto initialization = initialize(self);
+  leaveProfile();
+
+  if (initialization.code != RESULT_OK) {
+    lifpDestroy(&self);
+    throw(result_ref_t, initialization.code, nullptr, "%s",
+          initialization.message);
+  }
+  return ok(result_ref_t, self);
+}
+
+void lifpDestroy(lifp_vm_t **self) {
+  if (!self || !*self)
+    return;
+
+  enterProfile(*self);
+  environmentDestroy(&(*self)->environment);
+  internDestroy(&(*self)->intern);
+  arenaDestroy(&(*self)->temp_arena);
+  arenaDestroy(&(*self)->ast_arena);
+  profileEnd();
+  leaveProfile();
+
+  // The machine itself was allocated in the caller's profile
+  deallocSafe(self);
+}
+
+// Reclaims the memory of the previous form. Bindings are the only live values
+// in between forms, so it's also safe to collect the environment.
+static result_void_t reclaim(lifp_vm_t *self) {
+  arenaReset(self->temp_arena);
+  arenaReset(self->ast_arena);
+  internReset(self->intern);
+  return gcMaybeCollect(&self->gc, &self->environment);
+}
+
+// Tells whether the lexer has no forms left, without consuming them
+static bool isExhausted(const lexer_t *lexer) {
+  lexer_t lookahead = *lexer;
+  const auto token = lexerNext(&lookahead);
+  return token.code == RESULT_OK && token.value.type == TOKEN_TYPE_EOF;
+}
+
+static result_value_ref_t evaluateSource(lifp_vm_t *self, size_t size,
+                                         const char source[static size]) {
+  const position_t start = {.line = 1, .column = 0};
+  tryWithMeta(result_value_ref_t, reclaim(self), start);
+
+  lexer_t lexer;
+  lexerInit(&lexer, size, source);
+  while (true) {
+    node_t *syntax_tree = nullptr;
+    try(result_value_ref_t,
+        parseNextInterned(self->ast_arena, &lexer, self->intern), syntax_tree);
+
+    if (!syntax_tree)
+      break;
+
+    tryWithMeta(result_value_ref_t,
+                optimize(self->ast_arena, syntax_tree, self->environment),
+                syntax_tree->position);
+    escapeAnalyze(syntax_tree);
+
+    value_t *reduced = nullptr;
+    try(result_value_ref_t,
+        evaluate(self->temp_arena, syntax_tree, self->environment), reduced);
+
+    // The last value is left in place for the caller, until the next call
+    if (isExhausted(&lexer))
+      return ok(result_value_ref_t, reduced);
+
+    tryWithMeta(result_value_ref_t, reclaim(self), syntax_tree->position);
+  }
+
+  value_t *nil = nullptr;
+  tryWithMeta(result_value_ref_t,
+              arenaAllocate(self->temp_arena, sizeof(value_t)), start, nil);
+  nil->type = VALUE_TYPE_NIL;
+  nil->position = start;
+  nil->value.nil = nullptr;
+  return ok(result_value_ref_t, nil);
+}
+
+result_value_ref_t lifpEvalString(lifp_vm_t *self, size_t size,
+                                  const char source[static size]) {
+  enterProfile(self);
+  const auto result = evaluateSource(self, size, source);
+  leaveProfile();
+  return result;
+}
+
+result_value_ref_t lifpEvalFile(lifp_vm_t *self, const char *path) {
+  const position_t start = {.line = 1, .column = 0};
+  const int file_descriptor = open(path, O_RDONLY);
+  struct stat file_stat;
+  if (file_descriptor < 0 || fstat(file_descriptor, &file_stat) < 0) {
+    if (file_descriptor >= 0)
+      close(file_descriptor);
+    throw(result_value_ref_t, LIFP_ERROR_IO, start, "cannot read '%s'", path);
+  }
+
+  const size_t size = (size_t)file_stat.st_size;
+  if (size == 0) {
+    close(file_descriptor);
+    return lifpEvalString(self, 0, "");
+  }
+
+  // Nodes copy whatever they need from the source, which can go right after
+  char *source =
+      mmap(nullptr, size, PROT_READ, MAP_PRIVATE, file_descriptor, 0);
+  close(file_descriptor);
+  if (source == MAP_FAILED) {
+    throw(result_value_ref_t, LIFP_ERROR_IO, start, "cannot map '%s'", path);
+  }
+
+  const auto result = lifpEvalString(self, size, source);
+  munmap(source, size);
+  return result;
+}
+
+result_void_t lifpRegisterBuiltin(lifp_vm_t *self, const char *name,
+                                  builtin_t builtin) {
+  value_t value = {.type = VALUE_TYPE_BUILTIN, .value.builtin = builtin};
+  enterProfile(self);
+  const auto binding = mapSet(self->environment->values, name, &value);
+  leaveProfile();
+  try(result_void_t, binding);
+
+  // Bindings cached by quickened nodes may be the replaced one
+  self->environment->version++;
+  return ok(result_void_t);
+}
+
+#ifdef MEMORY_PROFILE
+void lifpReport(lifp_vm_t *self) {
+  enterProfile(self);
+  profileReport();
+  leaveProfile();
+  gcReport(&self->gc);
+  internReport(self->intern);
+}
+#endif
@@ -0,0 +1,52 @@
+#pragma once
+
+#include "../lib/result.h"
+#include "error.h"
+#include "value.h"
+#include <stddef.h>
+
+// Embedding API.
+//
+// A virtual machine owns everything an interpreter needs: its arenas, its
+// global environment and collector, its intern table and their metrics.
+// Nothing is shared between machines, so a host can run as many as it likes,
+// each on its own thread. A machine must only be used by one thread at a time.
+//
+// ```c
+// lifp_vm_t *vm = nullptr;
+// try(result_ref_t, lifpCreate(), vm);
+// try(result_void_t, lifpRegisterBuiltin(vm, "host.answer", answer));
+// const auto result = lifpEvalString(vm, strlen(source), source);
+// lifpDestroy(&vm);
+// ```
+//
+// With MEMORY_PROFILE, machines record their memory metrics in a profile of
+// their own (see profile.h), rather than in the profile of the thread.
+typedef enum {
+  LIFP_ERROR_IO = ERROR_CODE_RUNTIME_ERROR + 1,
+} lifp_error_t;
+
+typedef struct lifp_vm_t lifp_vm_t;
+
+result_ref_t lifpCreate(void);
+void lifpDestroy(lifp_vm_t **self);
+
+// Evaluates all the forms of `source`, and returns the value of the last one,
+// or nil when there are none. The value is valid until the next evaluation.
+result_value_ref_t lifpEvalString(lifp_vm_t *self, size_t size,
+                                  const char source[static size]);
+
+// Like lifpEvalString, with the contents of the file at `path`
+result_value_ref_t lifpEvalFile(lifp_vm_t *self, const char *path);
+
+// Binds `builtin` to `name` in the global environment, replacing whatever was
+// bound to it. Host builtins are never evaluated ahead of time.
+result_void_t lifpRegisterBuiltin(lifp_vm_t *self, const char *name,
+                                  builtin_t builtin);
+
+#ifdef MEMORY_PROFILE
+// Prints the memory metrics of the machine, its collector and intern table
+void lifpReport(lifp_vm_t *self);
+#else
+#define lifpReport(Self)
+#endif
@@ -18,6 +18,7 @@ result_ref_t nodeCreate(arena_t *arena, node_type_t type) {
 
 result_void_t nodeCopy(const node_t *source, node_t *destination) {
   destination->type = source->type;
+  destination->local = source->local;
   destination->position.column = source->position.column;
   destination->position.line = source->position.line;
 
@@ -31,6 +32,50 @@ result_void_t nodeCopy(const node_t *source, node_t *destination) {
   return ok(result_void_t);
 }
 
+result_void_t nodeDeepCopy(const node_t *source, node_t *destination) {
+  destination->type = source->type;
+  destination->local = source->local;
+  destination->position.column = source->position.column;
+  destination->position.line = source->position.line;
+
+  if (source->type != NODE_TYPE_LIST) {
+    destination->value = source->value;
+    return ok(result_void_t);
+  }
+
+  // Sub-lists are allocated on the same arena as the destination list, and so
+  // are the free variables cached on fn forms
+  arena_t *arena = destination->value.list.arena;
+  const symbol_list_t *free_variables = source->value.function.free;
+  if (free_variables) {
+    const size_t count = free_variables->count;
+    symbol_list_t *variables = nullptr;
+    try(result_void_t,
+        listCreate(symbol_t, arena, count ? count : 1), variables);
+    try(result_void_t, listCopy(symbol_t, free_variables, variables));
+    destination->value.function.free = variables;
+  }
+
+  for (size_t i = 0; i < source->value.list.count; i++) {
+    node_t child = listGet(node_t, &source->value.list, i);
+
+    if (child.type == NODE_TYPE_LIST) {
+      const size_t count = child.value.list.count;
+      node_list_t *list = nullptr;
+      try(result_void_t, listCreate(node_t, arena, count ? count : 1), list);
+
+      node_t copy = child;
+      bytewiseCopy(&copy.value.list, list, sizeof(node_list_t));
+      try(result_void_t, nodeDeepCopy(&child, &copy));
+      child = copy;
+    }
+
+    try(result_void_t, listAppend(node_t, &destination->value.list, &child));
+  }
+
+  return ok(result_void_t);
+}
+
 result_ref_t nodeClone(arena_t *arena, const node_t *source) {
   node_t *destination = nullptr;
   try(result_ref_t, nodeCreate(arena, source->type), destination);
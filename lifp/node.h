@@ -10,6 +10,9 @@
 typedef struct node_t node_t;
 typedef union node_value_t node_value_t;
 typedef List(node_t) node_list_t;
+typedef char symbol_t[SYMBOL_SIZE];
+// Symbols a fn body references without binding them (see specials.c)
+typedef List(symbol_t) symbol_list_t;
 
 typedef enum {
   NODE_TYPE_LIST,
@@ -19,10 +22,46 @@ typedef enum {
   NODE_TYPE_NIL,
 } node_type_t;
 
+// Handlers evaluating a node. Nodes start without one, and rewrite themselves
+// to the most specialized handler once evaluated (see quicken.c).
+typedef enum {
+  NODE_QUICK_NONE,
+  NODE_QUICK_INTEGER,
+  NODE_QUICK_BOOLEAN,
+  NODE_QUICK_NIL,
+  NODE_QUICK_SYMBOL,
+  NODE_QUICK_GLOBAL,
+  NODE_QUICK_CALL,
+  NODE_QUICK_DEFINE,
+  NODE_QUICK_FUNCTION,
+  NODE_QUICK_LET,
+  NODE_QUICK_COND,
+  NODE_QUICK_ADD_INT_2,
+  NODE_QUICK_SUB_INT_2,
+  NODE_QUICK_MUL_INT_2,
+  NODE_QUICK_EQ_INT_2,
+  NODE_QUICK_LT_INT_2,
+  NODE_QUICK_GT_INT_2,
+  NODE_QUICK_LEQ_INT_2,
+  NODE_QUICK_GEQ_INT_2,
+} node_quick_t;
+
 typedef union node_value_t {
   node_list_t list;
   int32_t integer;
   char symbol[SYMBOL_SIZE];
+  // Symbols quickened to globals cache their binding past the name
+  struct {
+    char symbol[SYMBOL_SIZE];
+    struct value_t *binding;
+    const struct environment_t *environment;
+    size_t version;
+  } global;
+  // fn forms cache the free variables of their body past the list
+  struct {
+    node_list_t list;
+    const symbol_list_t *free;
+  } function;
   bool boolean;
   nullptr_t nil;
 } node_value_t;
@@ -30,8 +69,14 @@ typedef union node_value_t {
 typedef struct node_t {
   position_t position;
   node_type_t type;
+  bool local; // Value is copied before its frame returns (see escape.c)
+  node_quick_t quick : 8;
   node_value_t value;
 } node_t;
 
+typedef Result(node_t *, position_t) result_node_ref_t;
+
 result_ref_t nodeCreate(arena_t *arena, node_type_t type);
 result_void_t nodeCopy(const node_t *source, node_t *destination);
+// Like nodeCopy, but sub-lists are copied too instead of being shared
+result_void_t nodeDeepCopy(const node_t *source, node_t *destination);
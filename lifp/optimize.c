@@ -0,0 +1,359 @@
+#include "../lib/arena.h"
+#include "../lib/list.h"
+#include "environment.h"
+#include "evaluate.h"
+#include "node.h"
+#include "value.h"
+#include <stddef.h>
+#include <string.h>
+
+// Constant folding
+// ---
+//
+// Calls to pure builtins (see environmentIsPure) on literal arguments are
+// replaced by their result, let bindings to literals are substituted in their
+// body, and cond clauses with literal conditions are pruned. Builtins are
+// resolved when the form is optimized, unless shadowed by fn or let bindings.
+//
+// Function bodies run later, against whatever is bound then: calls in them
+// are never folded, or rebinding a builtin would go unnoticed by functions
+// defined before.
+//
+// Lists may be shared with other parts of the AST (see intern.h), so they are
+// never modified: lists are copied on the arena holding the AST and folded,
+// and the copy is dropped if nothing changed.
+
+// Bindings visible from a node. Only literals can be substituted: other values
+// are unknown until evaluation, and only shadow outer bindings and builtins.
+typedef struct binding_t {
+  const char *symbol;
+  const node_t *literal;
+  const struct binding_t *parent;
+} binding_t;
+
+static const binding_t *lookup(const binding_t *scope, const char *symbol) {
+  for (; scope; scope = scope->parent) {
+    if (strcmp(scope->symbol, symbol) == 0)
+      return scope;
+  }
+  return nullptr;
+}
+
+static bool isLiteral(const node_t *node) {
+  return node->type == NODE_TYPE_INTEGER || node->type == NODE_TYPE_BOOLEAN ||
+         node->type == NODE_TYPE_NIL;
+}
+
+// Lists are the same when they have the very same elements
+static bool sameNode(const node_t *left, const node_t *right) {
+  if (left->type != right->type)
+    return false;
+
+  switch (left->type) {
+  case NODE_TYPE_INTEGER:
+    return left->value.integer == right->value.integer;
+  case NODE_TYPE_BOOLEAN:
+    return left->value.boolean == right->value.boolean;
+  case NODE_TYPE_SYMBOL:
+    return strcmp(left->value.symbol, right->value.symbol) == 0;
+  case NODE_TYPE_LIST:
+    if (left->value.list.count != right->value.list.count)
+      return false;
+    if (left->value.list.data == right->value.list.data)
+      return true;
+    for (size_t i = 0; i < left->value.list.count; i++) {
+      if (!sameNode(&left->value.list.data[i], &right->value.list.data[i]))
+        return false;
+    }
+    return true;
+  case NODE_TYPE_NIL:
+  default:
+    return true;
+  }
+}
+
+static result_void_t fold(arena_t *arena, environment_t *environment,
+                          const binding_t *scope, node_t *node);
+
+// Replaces the elements of `node` with a copy, that can then be folded
+static result_void_t copyElements(arena_t *arena, node_t *node) {
+  const node_list_t source = node->value.list;
+  node_list_t *list = nullptr;
+  try(result_void_t,
+      listCreate(node_t, arena, source.count ? source.count : 1), list);
+  for (size_t i = 0; i < source.count; i++) {
+    try(result_void_t, listAppend(node_t, list, &source.data[i]));
+  }
+  bytewiseCopy(&node->value.list, list, sizeof(node_list_t));
+  return ok(result_void_t);
+}
+
+// Evaluates a pure builtin call ahead of time, when its result is a literal
+static void foldCall(arena_t *arena, environment_t *environment,
+                     const binding_t *scope, node_t *node) {
+  // Bodies of functions are folded without an environment
+  if (!environment)
+    return;
+
+  const node_list_t *list = &node->value.list;
+  const node_t *head = &list->data[0];
+  if (head->type != NODE_TYPE_SYMBOL || lookup(scope, head->value.symbol))
+    return;
+
+  const value_t *callee =
+      environmentResolveSymbol(environment, head->value.symbol);
+  if (!callee || callee->type != VALUE_TYPE_BUILTIN ||
+      !environmentIsPure(callee->value.builtin))
+    return;
+
+  for (size_t i = 1; i < list->count; i++) {
+    if (!isLiteral(&list->data[i]))
+      return;
+  }
+
+  // Nothing the call allocates outlives it: results are literals
+  const size_t start = arena->offset;
+  const auto created = listCreate(value_t, arena, list->count);
+  if (created.code != RESULT_OK)
+    return;
+
+  value_list_t *arguments = created.value;
+  for (size_t i = 1; i < list->count; i++) {
+    const node_t *argument = &list->data[i];
+    value_t value = {.position = argument->position};
+    if (argument->type == NODE_TYPE_INTEGER) {
+      value.type = VALUE_TYPE_INTEGER;
+      value.value.integer = argument->value.integer;
+    } else if (argument->type == NODE_TYPE_BOOLEAN) {
+      value.type = VALUE_TYPE_BOOLEAN;
+      value.value.boolean = argument->value.boolean;
+    } else {
+      value.type = VALUE_TYPE_NIL;
+    }
+    // Capacity is enough for all arguments
+    (void)listAppend(value_t, arguments, &value);
+  }
+
+  value_t result = {.type = VALUE_TYPE_NIL, .position = node->position};
+  const auto call = callee->value.builtin(&result, arguments);
+  arenaRewind(arena, start);
+
+  // Errors are left to evaluation, which reports them
+  if (call.code != RESULT_OK)
+    return;
+
+  if (result.type == VALUE_TYPE_INTEGER) {
+    node->type = NODE_TYPE_INTEGER;
+    node->value.integer = result.value.integer;
+  } else if (result.type == VALUE_TYPE_BOOLEAN) {
+    node->type = NODE_TYPE_BOOLEAN;
+    node->value.boolean = result.value.boolean;
+  } else if (result.type == VALUE_TYPE_NIL) {
+    node->type = NODE_TYPE_NIL;
+    node->value.nil = nullptr;
+  }
+}
+
+static result_void_t bindArguments(arena_t *arena, environment_t *environment,
+                                   const binding_t *scope,
+                                   const node_list_t *arguments, size_t index,
+                                   node_t *body) {
+  if (index == arguments->count)
+    return fold(arena, environment, scope, body);
+
+  const node_t *argument = &arguments->data[index];
+  if (argument->type != NODE_TYPE_SYMBOL)
+    return bindArguments(arena, environment, scope, arguments, index + 1,
+                         body);
+
+  const binding_t binding = {.symbol = argument->value.symbol,
+                             .parent = scope};
+  return bindArguments(arena, environment, &binding, arguments, index + 1,
+                       body);
+}
+
+// Bindings see the ones before them, so they are folded one at a time. The
+// let is dropped altogether when all of them are literals and so is its body.
+static result_void_t foldLet(arena_t *arena, environment_t *environment,
+                             const binding_t *scope, node_list_t *couples,
+                             size_t index, node_t *body, bool *literals) {
+  if (index == couples->count)
+    return fold(arena, environment, scope, body);
+
+  node_t *couple = &couples->data[index];
+  if (couple->type != NODE_TYPE_LIST || couple->value.list.count != 2 ||
+      couple->value.list.data[0].type != NODE_TYPE_SYMBOL) {
+    *literals = false;
+    return foldLet(arena, environment, scope, couples, index + 1, body,
+                   literals);
+  }
+
+  const node_list_t original = couple->value.list;
+  try(result_void_t, copyElements(arena, couple));
+  node_t *value = &couple->value.list.data[1];
+  try(result_void_t, fold(arena, environment, scope, value));
+  *literals = *literals && isLiteral(value);
+
+  if (sameNode(&original.data[1], value)) {
+    couple->value.list = original;
+    value = &couple->value.list.data[1];
+  }
+
+  const binding_t binding = {
+      .symbol = couple->value.list.data[0].value.symbol,
+      .literal = isLiteral(value) ? value : nullptr,
+      .parent = scope};
+  return foldLet(arena, environment, &binding, couples, index + 1, body,
+                 literals);
+}
+
+// Clauses with a false condition are dropped, and the first one with a true
+// condition replaces the ones after it and the fallback
+static void pruneCond(node_t *node) {
+  node_list_t *list = &node->value.list;
+  const node_t fallback = list->data[list->count - 1];
+
+  size_t kept = 1;
+  bool taken = false;
+  for (size_t i = 1; i < list->count - 1 && !taken; i++) {
+    const node_t clause = list->data[i];
+    const node_t *condition = &clause.value.list.data[0];
+
+    if (condition->type != NODE_TYPE_BOOLEAN) {
+      list->data[kept++] = clause;
+    } else if (condition->value.boolean) {
+      list->data[kept++] = clause.value.list.data[1];
+      taken = true;
+    }
+  }
+
+  if (!taken) {
+    list->data[kept++] = fallback;
+  }
+  list->count = kept;
+
+  // Only the fallback is left: it's the value of the whole cond
+  if (list->count == 2) {
+    *node = list->data[1];
+  }
+}
+
+static result_void_t foldCond(arena_t *arena, environment_t *environment,
+                              const binding_t *scope, node_t *node) {
+  node_list_t *list = &node->value.list;
+  if (list->count < 2)
+    return ok(result_void_t);
+
+  for (size_t i = 1; i < list->count - 1; i++) {
+    node_t *clause = &list->data[i];
+    if (clause->type != NODE_TYPE_LIST || clause->value.list.count != 2)
+      return ok(result_void_t);
+  }
+
+  try(result_void_t, copyElements(arena, node));
+  for (size_t i = 1; i < list->count - 1; i++) {
+    node_t *clause = &list->data[i];
+    const node_t original = *clause;
+    try(result_void_t, copyElements(arena, clause));
+    try(result_void_t,
+        fold(arena, environment, scope, &clause->value.list.data[0]));
+    try(result_void_t,
+        fold(arena, environment, scope, &clause->value.list.data[1]));
+
+    if (sameNode(&original, clause)) {
+      *clause = original;
+    }
+  }
+  try(result_void_t,
+      fold(arena, environment, scope, &list->data[list->count - 1]));
+
+  pruneCond(node);
+  return ok(result_void_t);
+}
+
+static result_void_t foldNode(arena_t *arena, environment_t *environment,
+                              const binding_t *scope, node_t *node) {
+  if (node->type == NODE_TYPE_SYMBOL) {
+    const binding_t *binding = lookup(scope, node->value.symbol);
+    if (binding && binding->literal) {
+      const position_t position = node->position;
+      *node = *binding->literal;
+      node->position = position;
+    }
+    return ok(result_void_t);
+  }
+
+  if (node->type != NODE_TYPE_LIST || node->value.list.count == 0)
+    return ok(result_void_t);
+
+  node_list_t *list = &node->value.list;
+
+  // Malformed special forms are left to evaluation, which reports them
+  if (isForm(list, FUNCTION)) {
+    if (list->count != 3 || list->data[1].type != NODE_TYPE_LIST)
+      return ok(result_void_t);
+
+    try(result_void_t, copyElements(arena, node));
+    return bindArguments(arena, nullptr, scope, &list->data[1].value.list, 0,
+                         &list->data[2]);
+  }
+
+  if (isForm(list, DEFINE)) {
+    if (list->count != 3)
+      return ok(result_void_t);
+
+    try(result_void_t, copyElements(arena, node));
+    return fold(arena, environment, scope, &list->data[2]);
+  }
+
+  if (isForm(list, LET)) {
+    if (list->count != 3 || list->data[1].type != NODE_TYPE_LIST)
+      return ok(result_void_t);
+
+    try(result_void_t, copyElements(arena, node));
+    node_t *couples = &list->data[1];
+    try(result_void_t, copyElements(arena, couples));
+
+    bool literals = true;
+    try(result_void_t, foldLet(arena, environment, scope,
+                               &couples->value.list, 0, &list->data[2],
+                               &literals));
+
+    if (literals && isLiteral(&list->data[2])) {
+      *node = list->data[2];
+    }
+    return ok(result_void_t);
+  }
+
+  if (isForm(list, COND))
+    return foldCond(arena, environment, scope, node);
+
+  try(result_void_t, copyElements(arena, node));
+  for (size_t i = 0; i < list->count; i++) {
+    try(result_void_t, fold(arena, environment, scope, &list->data[i]));
+  }
+
+  foldCall(arena, environment, scope, node);
+  return ok(result_void_t);
+}
+
+static result_void_t fold(arena_t *arena, environment_t *environment,
+                          const binding_t *scope, node_t *node) {
+  const node_t original = *node;
+  const size_t start = arena->offset;
+  try(result_void_t, foldNode(arena, environment, scope, node));
+
+  // Elements are restored bottom-up when unchanged, so an unchanged list
+  // means that everything allocated to fold it is garbage
+  if (original.type == NODE_TYPE_LIST && sameNode(&original, node)) {
+    *node = original;
+    arenaRewind(arena, start);
+  }
+  return ok(result_void_t);
+}
+
+result_void_t optimize(arena_t *arena, node_t *syntax_tree,
+                       environment_t *environment) {
+  try(result_void_t, fold(arena, environment, nullptr, syntax_tree));
+  return cacheFreeVariables(arena, syntax_tree);
+}
@@ -1,16 +1,25 @@
 #include "parse.h"
 #include "error.h"
+#include "intern.h"
 #include "node.h"
 #include <assert.h>
 #include <stddef.h>
 #include <string.h>
 
-result_node_ref_t parseAtom(arena_t *arena, token_t token) {
-  assert(token.type == TOKEN_TYPE_INTEGER || token.type == TOKEN_TYPE_SYMBOL);
+static constexpr size_t LIST_INITIAL_SIZE = 8;
 
-  node_t *node = nullptr;
-  tryWithMeta(result_node_ref_t, nodeCreate(arena, NODE_TYPE_INTEGER),
-              token.position, node);
+static bool spanEquals(const lexer_t *lexer, source_span_t span,
+                       size_t length, const char string[static length]) {
+  return span.length == length &&
+         memcmp(&lexer->source[span.offset], string, length) == 0;
+}
+
+// Nodes are written in place, straight into the list holding them, so that
+// only lists take AST memory: literals live inside their parent's elements
+
+static result_node_ref_t parseAtom(const lexer_t *lexer, token_t token,
+                                   node_t *node) {
+  assert(token.type == TOKEN_TYPE_INTEGER || token.type == TOKEN_TYPE_SYMBOL);
 
   node->position = token.position;
 
@@ -19,99 +28,158 @@ result_node_ref_t parseAtom(arena_t *arena, token_t token) {
     node->type = NODE_TYPE_INTEGER;
     node->value.integer = token.value.integer;
     return ok(result_node_ref_t, node);
-  case TOKEN_TYPE_SYMBOL:
-    if (strncmp(token.value.symbol, TRUE, 4) == 0) {
+  case TOKEN_TYPE_SYMBOL: {
+    const source_span_t symbol = token.value.symbol;
+    if (spanEquals(lexer, symbol, 4, TRUE)) {
       node->type = NODE_TYPE_BOOLEAN;
       node->value.boolean = true;
       return ok(result_node_ref_t, node);
     }
 
-    if (strncmp(token.value.symbol, FALSE, 5) == 0) {
+    if (spanEquals(lexer, symbol, 5, FALSE)) {
       node->type = NODE_TYPE_BOOLEAN;
       node->value.boolean = false;
       return ok(result_node_ref_t, node);
     }
 
-    if (strncmp(token.value.symbol, NIL, 3) == 0) {
+    if (spanEquals(lexer, symbol, 3, NIL)) {
       node->type = NODE_TYPE_NIL;
       node->value.nil = nullptr;
       return ok(result_node_ref_t, node);
     }
 
+    // Nodes own their symbols, so this is the only place where text is copied
+    if (symbol.length >= SYMBOL_SIZE) {
+      throw(result_node_ref_t, ERROR_CODE_SYNTAX_UNEXPECTED_TOKEN,
+            token.position, "Symbol too long. Expected length <= %lu, got %lu",
+            SYMBOL_SIZE - 1, symbol.length);
+    }
+
     node->type = NODE_TYPE_SYMBOL;
-    memcpy(node->value.symbol, token.value.symbol, SYMBOL_SIZE);
+    memcpy(node->value.symbol, &lexer->source[symbol.offset], symbol.length);
+    node->value.symbol[symbol.length] = 0;
     return ok(result_node_ref_t, node);
+  }
   case TOKEN_TYPE_LPAREN:
   case TOKEN_TYPE_RPAREN:
+  case TOKEN_TYPE_EOF:
   default:
     unreachable();
   }
 }
 
-result_node_ref_t parseList(arena_t *arena, const token_list_t *tokens,
-                            size_t *offset, size_t *depth) {
-  token_t first_token = listGet(token_t, tokens, *offset);
+static result_node_ref_t parseForm(arena_t *arena, lexer_t *lexer,
+                                   intern_t *intern, token_t first_token,
+                                   node_t *node);
 
-  node_t *node = nullptr;
-  tryWithMeta(result_node_ref_t, nodeCreate(arena, NODE_TYPE_LIST),
-              first_token.position, node);
+static result_node_ref_t parseList(arena_t *arena, lexer_t *lexer,
+                                   intern_t *intern, token_t first_token,
+                                   node_t *node) {
+  const size_t start = arena->offset;
 
-  node->position = first_token.position;
-  node->type = NODE_TYPE_LIST;
-  (*depth)++;
-  (*offset)++;
+  node_list_t *list = nullptr;
+  tryWithMeta(result_node_ref_t,
+              listCreate(node_t, arena, LIST_INITIAL_SIZE),
+              first_token.position, list);
+
+  while (true) {
+    token_t token;
+    try(result_node_ref_t, lexerNext(lexer), token);
 
-  for (; *offset < tokens->capacity; (*offset)++) {
-    const token_t token = listGet(token_t, tokens, *offset);
-    if (token.type == TOKEN_TYPE_RPAREN) {
-      (*depth)--;
+    if (token.type == TOKEN_TYPE_RPAREN)
       break;
+
+    // There are left parens that don't match right parens
+    if (token.type == TOKEN_TYPE_EOF) {
+      throw(result_node_ref_t, ERROR_CODE_SYNTAX_UNBALANCED_PARENTHESES,
+            first_token.position, "Unbalanced parentheses");
     }
 
-    node_t *sub_node = nullptr;
-    try(result_node_ref_t, parse(arena, tokens, offset, depth), sub_node);
-    tryWithMeta(result_node_ref_t,
-                listAppend(node_t, &node->value.list, sub_node),
+    node_t element = {};
+    try(result_node_ref_t, parseForm(arena, lexer, intern, token, &element));
+    tryWithMeta(result_node_ref_t, listAppend(node_t, list, &element),
                 token.position);
   }
 
+  node->type = NODE_TYPE_LIST;
+  node->position = first_token.position;
+  bytewiseCopy(&node->value.list, list, sizeof(node_list_t));
+
+  if (!intern)
+    return ok(result_node_ref_t, node);
+
+  // As lists are interned bottom-up, when an equal list exists whatever was
+  // allocated since this one started is garbage, elements included
+  node_t *elements = internList(intern, &node->value.list);
+  if (elements != node->value.list.data) {
+    intern->reclaimed += arena->offset - start;
+    arenaRewind(arena, start);
+    node->value.list.capacity = node->value.list.count;
+    node->value.list.data = elements;
+  }
+
   return ok(result_node_ref_t, node);
 }
 
-result_node_ref_t parse(arena_t *arena, const token_list_t *tokens,
-                        size_t *offset, size_t *depth) {
-  if (tokens->count == 0) {
+static result_node_ref_t parseForm(arena_t *arena, lexer_t *lexer,
+                                   intern_t *intern, token_t first_token,
+                                   node_t *node) {
+  switch (first_token.type) {
+  case TOKEN_TYPE_LPAREN:
+    return parseList(arena, lexer, intern, first_token, node);
+  case TOKEN_TYPE_RPAREN:
+    throw(result_node_ref_t, ERROR_CODE_SYNTAX_UNBALANCED_PARENTHESES,
+          first_token.position, "Unbalanced parentheses");
+  case TOKEN_TYPE_INTEGER:
+  case TOKEN_TYPE_SYMBOL:
+    return parseAtom(lexer, first_token, node);
+  case TOKEN_TYPE_EOF:
+  default:
+    unreachable();
+  }
+}
+
+result_node_ref_t parseNextInterned(arena_t *arena, lexer_t *lexer,
+                                    intern_t *intern) {
+  token_t first_token;
+  try(result_node_ref_t, lexerNext(lexer), first_token);
+
+  if (first_token.type == TOKEN_TYPE_EOF) {
     return ok(result_node_ref_t, nullptr);
   }
 
-  const token_t first_token = listGet(token_t, tokens, *offset);
-  size_t initial_depth = *depth;
+  node_t *node = nullptr;
+  tryWithMeta(result_node_ref_t, nodeCreate(arena, NODE_TYPE_NIL),
+              first_token.position, node);
+  try(result_node_ref_t, parseForm(arena, lexer, intern, first_token, node));
+  return ok(result_node_ref_t, node);
+}
 
-  if (first_token.type == TOKEN_TYPE_LPAREN) {
-    result_node_ref_t parse_list_result =
-        parseList(arena, tokens, offset, depth);
+result_node_ref_t parseNext(arena_t *arena, lexer_t *lexer) {
+  return parseNextInterned(arena, lexer, nullptr);
+}
 
-    // There are left parens that don't match right parens
-    if (*depth != initial_depth) {
-      throw(result_node_ref_t, ERROR_CODE_SYNTAX_UNBALANCED_PARENTHESES,
-            first_token.position, "Unbalanced parentheses");
-    }
+result_node_ref_t parse(arena_t *arena, lexer_t *lexer) {
+  node_t *node = nullptr;
+  try(result_node_ref_t, parseNext(arena, lexer), node);
 
-    // There are dangling chars after top level list
-    if (initial_depth == 0 && *offset != (tokens->count - 1)) {
-      const token_t last_token = listGet(token_t, tokens, *offset + 1);
+  if (!node) {
+    return ok(result_node_ref_t, nullptr);
+  }
 
-      if (last_token.type == TOKEN_TYPE_RPAREN) {
-        throw(result_node_ref_t, ERROR_CODE_SYNTAX_UNBALANCED_PARENTHESES,
-              first_token.position, "Unbalanced parentheses");
-      }
+  // There are dangling chars after top level form
+  token_t last_token;
+  try(result_node_ref_t, lexerNext(lexer), last_token);
 
-      throw(result_node_ref_t, ERROR_CODE_SYNTAX_UNEXPECTED_TOKEN,
-            last_token.position, "Unexpected token at the end input");
-    }
+  if (last_token.type == TOKEN_TYPE_RPAREN) {
+    throw(result_node_ref_t, ERROR_CODE_SYNTAX_UNBALANCED_PARENTHESES,
+          node->position, "Unbalanced parentheses");
+  }
 
-    return parse_list_result;
+  if (last_token.type != TOKEN_TYPE_EOF) {
+    throw(result_node_ref_t, ERROR_CODE_SYNTAX_UNEXPECTED_TOKEN,
+          last_token.position, "Unexpected token at the end input");
   }
 
-  return parseAtom(arena, first_token);
+  return ok(result_node_ref_t, node);
 }
@@ -2,9 +2,11 @@
 
 #include "../lib/arena.h"
 #include "../lib/result.h"
+#include "intern.h"
 #include "node.h"
 #include "position.h"
 #include "token.h"
+#include "tokenize.h"
 #include <stddef.h>
 #include <stdint.h>
 
@@ -12,6 +14,13 @@ constexpr char TRUE[] = "true";
 constexpr char FALSE[] = "false";
 constexpr char NIL[] = "nil";
 
-typedef Result(node_t *, position_t) result_node_ref_t;
-result_node_ref_t parse(arena_t *arena, const token_list_t *tokens,
-                        size_t *offset, size_t *depth);
+// Parses the next top-level form, leaving the lexer right after it, so that a
+// source can be consumed one form at a time. Returns nullptr at end of input.
+result_node_ref_t parseNext(arena_t *arena, lexer_t *lexer);
+
+// Like parseNext, but equal lists share their elements (see intern.h)
+result_node_ref_t parseNextInterned(arena_t *arena, lexer_t *lexer,
+                                    intern_t *intern);
+
+// Parses a source holding exactly one form
+result_node_ref_t parse(arena_t *arena, lexer_t *lexer);
@@ -0,0 +1,286 @@
+#include "../lib/map.h"
+#include "../lib/result.h"
+#include "environment.h"
+#include "node.h"
+#include "value.h"
+#include <assert.h>
+#include <stddef.h>
+
+// Quickening
+// ---
+//
+// After their first evaluation, nodes rewrite themselves into a specialized
+// version of what they just did, which skips most of the generic work:
+//
+//   * atoms and special forms skip their detection;
+//   * symbols bound in the global environment cache their binding;
+//   * arithmetic and comparison builtins called on two integers compute their
+//     result directly, without building lists of values and arguments.
+//
+// Specializations are guarded by checks on types and bindings. When a guard
+// fails, the node is deoptimized to the generic evaluation for good. Nodes
+// can be shared (see intern.h) and evaluated in different environments, so a
+// guard never assumes the environment is the one the node was quickened in.
+
+// Handler of a node that hasn't been evaluated yet: it only depends on its
+// shape, except for calls which are specialized by the values they get
+static node_quick_t quickenShape(const node_t *node) {
+  switch (node->type) {
+  case NODE_TYPE_INTEGER:
+    return NODE_QUICK_INTEGER;
+  case NODE_TYPE_BOOLEAN:
+    return NODE_QUICK_BOOLEAN;
+  case NODE_TYPE_NIL:
+    return NODE_QUICK_NIL;
+  // Symbols are assumed to be global, until found in a local binding
+  case NODE_TYPE_SYMBOL:
+    return NODE_QUICK_GLOBAL;
+  case NODE_TYPE_LIST:
+  default:
+    break;
+  }
+
+  const node_list_t *list = &node->value.list;
+  if (list->count == 0 || list->data[0].type != NODE_TYPE_SYMBOL)
+    return NODE_QUICK_CALL;
+
+  const char *symbol = list->data[0].value.symbol;
+  if (strcmp(symbol, DEFINE) == 0)
+    return NODE_QUICK_DEFINE;
+  if (strcmp(symbol, FUNCTION) == 0)
+    return NODE_QUICK_FUNCTION;
+  if (strcmp(symbol, LET) == 0)
+    return NODE_QUICK_LET;
+  if (strcmp(symbol, COND) == 0)
+    return NODE_QUICK_COND;
+  return NODE_QUICK_CALL;
+}
+
+static result_value_ref_t invokeValues(value_t *result, arena_t *arena,
+                                       environment_t *environment);
+
+// In the same order as the node_quick_t they quicken to
+static const builtin_t BINARY_INTEGER_BUILTINS[] = {
+    sum,      subtract,    multiply,  equal,
+    lessThan, greaterThan, lessEqual, greaterEqual,
+};
+
+static bool isBinaryInteger(node_quick_t quick) {
+  return quick >= NODE_QUICK_ADD_INT_2 && quick <= NODE_QUICK_GEQ_INT_2;
+}
+
+static builtin_t binaryIntegerBuiltin(node_quick_t quick) {
+  assert(isBinaryInteger(quick));
+  return BINARY_INTEGER_BUILTINS[(size_t)(quick - NODE_QUICK_ADD_INT_2)];
+}
+
+// Rewrites a node that hasn't been evaluated yet to the handler of its shape.
+// Calls are left alone, until their values are known.
+static bool quickenNode(node_t *node) {
+  const node_quick_t quick = quickenShape(node);
+  if (quick == NODE_QUICK_CALL)
+    return false;
+
+  // The name of the symbol shares its memory with the cache
+  if (quick == NODE_QUICK_GLOBAL) {
+    node->value.global.binding = nullptr;
+    node->value.global.environment = nullptr;
+  }
+  node->quick = quick;
+  return true;
+}
+
+// Specialization of calls to `builtin` on two integers, if any
+static node_quick_t quickenBuiltin(builtin_t builtin) {
+  const size_t count = sizeof(BINARY_INTEGER_BUILTINS) / sizeof(builtin_t);
+  for (size_t i = 0; i < count; i++) {
+    if (BINARY_INTEGER_BUILTINS[i] == builtin)
+      return (node_quick_t)(NODE_QUICK_ADD_INT_2 + (int)i);
+  }
+  return NODE_QUICK_CALL;
+}
+
+// Specialization of a call, given the values of its elements
+static node_quick_t quickenCall(const value_list_t *values) {
+  if (values->count != 3 || values->data[0].type != VALUE_TYPE_BUILTIN ||
+      values->data[1].type != VALUE_TYPE_INTEGER ||
+      values->data[2].type != VALUE_TYPE_INTEGER)
+    return NODE_QUICK_CALL;
+
+  return quickenBuiltin(values->data[0].value.builtin);
+}
+
+// Local bindings shadow globals, so they are looked up regardless of the
+// cache: a symbol found there is deoptimized
+static value_t *resolveQuickened(node_t *node, environment_t *environment) {
+  const char *symbol = node->value.symbol;
+  if (node->quick == NODE_QUICK_SYMBOL)
+    return environmentResolveSymbol(environment, symbol);
+
+  for (; environment->parent; environment = environment->parent) {
+    value_t *local = mapGet(value_t, environment->values, symbol);
+    if (local) {
+      node->quick = NODE_QUICK_SYMBOL;
+      return local;
+    }
+  }
+
+  auto global = &node->value.global;
+  if (global->environment == environment &&
+      global->version == environment->version)
+    return global->binding;
+
+  value_t *binding = mapGet(value_t, environment->values, symbol);
+  if (binding) {
+    global->binding = binding;
+    global->environment = environment;
+    global->version = environment->version;
+  }
+  return binding;
+}
+
+// Values of the elements of the call are handed over to the generic path, to
+// avoid evaluating them again
+static result_value_ref_t deoptimize(arena_t *arena, node_t *syntax_tree,
+                                     environment_t *environment,
+                                     value_t values[static 3]) {
+  syntax_tree->quick = NODE_QUICK_CALL;
+
+  value_t *result = nullptr;
+  tryWithMeta(result_value_ref_t, valueCreate(arena, VALUE_TYPE_LIST),
+              syntax_tree->position, result);
+  result->position = syntax_tree->position;
+
+  for (size_t i = 0; i < 3; i++) {
+    tryWithMeta(result_value_ref_t,
+                listAppend(value_t, &result->value.list, &values[i]),
+                syntax_tree->position);
+  }
+  return invokeValues(result, arena, environment);
+}
+
+// Operands of superinstructions are read in place when they are literals or
+// symbols, without going through values: anything else needs evaluation
+static bool integerOperand(node_t *node, environment_t *environment,
+                           int32_t *integer) {
+  if (node->quick == NODE_QUICK_INTEGER) {
+    *integer = node->value.integer;
+    return true;
+  }
+
+  if (node->quick != NODE_QUICK_SYMBOL && node->quick != NODE_QUICK_GLOBAL)
+    return false;
+
+  const value_t *value = resolveQuickened(node, environment);
+  if (!value || value->type != VALUE_TYPE_INTEGER)
+    return false;
+
+  *integer = value->value.integer;
+  return true;
+}
+
+static void computeBinaryInteger(node_quick_t quick, int32_t left,
+                                 int32_t right, value_t *result) {
+  switch (quick) {
+  case NODE_QUICK_ADD_INT_2:
+    result->type = VALUE_TYPE_INTEGER;
+    result->value.integer = left + right;
+    break;
+  case NODE_QUICK_SUB_INT_2:
+    result->type = VALUE_TYPE_INTEGER;
+    result->value.integer = left - right;
+    break;
+  case NODE_QUICK_MUL_INT_2:
+    result->type = VALUE_TYPE_INTEGER;
+    result->value.integer = left * right;
+    break;
+  case NODE_QUICK_EQ_INT_2:
+    result->type = VALUE_TYPE_BOOLEAN;
+    result->value.boolean = left == right;
+    break;
+  case NODE_QUICK_LT_INT_2:
+    result->type = VALUE_TYPE_BOOLEAN;
+    result->value.boolean = left < right;
+    break;
+  case NODE_QUICK_GT_INT_2:
+    result->type = VALUE_TYPE_BOOLEAN;
+    result->value.boolean = left > right;
+    break;
+  case NODE_QUICK_LEQ_INT_2:
+    result->type = VALUE_TYPE_BOOLEAN;
+    result->value.boolean = left <= right;
+    break;
+  case NODE_QUICK_GEQ_INT_2:
+    result->type = VALUE_TYPE_BOOLEAN;
+    result->value.boolean = left >= right;
+    break;
+  case NODE_QUICK_NONE:
+  case NODE_QUICK_INTEGER:
+  case NODE_QUICK_BOOLEAN:
+  case NODE_QUICK_NIL:
+  case NODE_QUICK_SYMBOL:
+  case NODE_QUICK_GLOBAL:
+  case NODE_QUICK_CALL:
+  case NODE_QUICK_DEFINE:
+  case NODE_QUICK_FUNCTION:
+  case NODE_QUICK_LET:
+  case NODE_QUICK_COND:
+  default:
+    unreachable();
+  }
+}
+
+// Superinstruction for a builtin applied to two integer literals or symbols,
+// like `(- a 1)` or `(< a b)`. It's false when the node has any other shape,
+// and leaves it to the checks of the generic handler.
+static bool fuseBinaryInteger(node_t *syntax_tree, environment_t *environment,
+                              value_t *result) {
+  if (!isBinaryInteger(syntax_tree->quick))
+    return false;
+
+  node_t *nodes = syntax_tree->value.list.data;
+  if (nodes[0].quick != NODE_QUICK_SYMBOL &&
+      nodes[0].quick != NODE_QUICK_GLOBAL)
+    return false;
+
+  const value_t *head = resolveQuickened(&nodes[0], environment);
+  if (!head || head->type != VALUE_TYPE_BUILTIN ||
+      head->value.builtin != binaryIntegerBuiltin(syntax_tree->quick))
+    return false;
+
+  int32_t left;
+  int32_t right;
+  if (!integerOperand(&nodes[1], environment, &left) ||
+      !integerOperand(&nodes[2], environment, &right))
+    return false;
+
+  computeBinaryInteger(syntax_tree->quick, left, right, result);
+  return true;
+}
+
+// Writes the result to `result`, unless the node is deoptimized
+static result_value_ref_t evaluateBinaryInteger(arena_t *arena,
+                                                node_t *syntax_tree,
+                                                environment_t *environment,
+                                                value_t *result) {
+  profileShape("", syntax_tree);
+  if (fuseBinaryInteger(syntax_tree, environment, result))
+    return ok(result_value_ref_t, result);
+
+  node_t *nodes = syntax_tree->value.list.data;
+  value_t values[3];
+  for (size_t i = 0; i < 3; i++) {
+    try(result_value_ref_t,
+        evaluateLocal(arena, &nodes[i], environment, &values[i]));
+  }
+
+  if (values[0].type != VALUE_TYPE_BUILTIN ||
+      values[0].value.builtin != binaryIntegerBuiltin(syntax_tree->quick) ||
+      values[1].type != VALUE_TYPE_INTEGER ||
+      values[2].type != VALUE_TYPE_INTEGER)
+    return deoptimize(arena, syntax_tree, environment, values);
+
+  computeBinaryInteger(syntax_tree->quick, values[1].value.integer,
+                       values[2].value.integer, result);
+  return ok(result_value_ref_t, result);
+}
@@ -0,0 +1,120 @@
+#include "node.h"
+#include <stddef.h>
+
+// Call shapes
+// ---
+//
+// With SHAPE_PROFILE, evaluation counts the shapes of the calls it runs: the
+// callee, and the kind of each argument, like `(< symbol integer)`. Shapes
+// tested by a cond are counted again as `cond (< symbol integer)`. The most
+// frequent ones are the candidates for superinstructions (see quicken.c).
+//
+// ```sh
+// make SHAPES=1 bin/run
+// bin/run script.lifp
+// ```
+
+#ifdef SHAPE_PROFILE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+constexpr size_t SHAPES_CAPACITY = 256;
+constexpr size_t SHAPES_REPORTED = 20;
+constexpr size_t SHAPE_SIZE = 64;
+
+typedef struct {
+  char shape[SHAPE_SIZE];
+  unsigned long hits;
+} shape_t;
+
+// Counted per thread, like the memory profiler's metrics
+static thread_local shape_t shapes[SHAPES_CAPACITY];
+static thread_local size_t shapes_count = 0;
+static thread_local unsigned long shapes_dropped = 0;
+
+static const char *shapeOf(const node_t *node) {
+  switch (node->type) {
+  case NODE_TYPE_INTEGER:
+    return "integer";
+  case NODE_TYPE_BOOLEAN:
+    return "boolean";
+  case NODE_TYPE_NIL:
+    return "nil";
+  case NODE_TYPE_SYMBOL:
+    return "symbol";
+  case NODE_TYPE_LIST:
+  default:
+    return "call";
+  }
+}
+
+static void profileShape(const char *context, const node_t *node) {
+  if (node->type != NODE_TYPE_LIST || node->value.list.count == 0)
+    return;
+
+  const node_list_t *list = &node->value.list;
+  char shape[SHAPE_SIZE];
+  size_t offset = 0;
+
+#define append(...)                                                            \
+  if (offset < SHAPE_SIZE) {                                                   \
+    offset += (size_t)snprintf(&shape[offset], SHAPE_SIZE - offset,            \
+                               __VA_ARGS__);                                   \
+  }
+
+  // Callees are named, so that shapes tell builtins apart
+  const node_t *head = &list->data[0];
+  append("%s(%s", context,
+         head->type == NODE_TYPE_SYMBOL ? head->value.symbol : shapeOf(head));
+  for (size_t i = 1; i < list->count; i++) {
+    append(" %s", shapeOf(&list->data[i]));
+  }
+  append(")");
+#undef append
+
+  for (size_t i = 0; i < shapes_count; i++) {
+    if (strcmp(shapes[i].shape, shape) == 0) {
+      shapes[i].hits++;
+      return;
+    }
+  }
+
+  if (shapes_count == SHAPES_CAPACITY) {
+    shapes_dropped++;
+    return;
+  }
+
+  strcpy(shapes[shapes_count].shape, shape);
+  shapes[shapes_count].hits = 1;
+  shapes_count++;
+}
+
+static int compareShapes(const void *left, const void *right) {
+  const unsigned long left_hits = ((const shape_t *)left)->hits;
+  const unsigned long right_hits = ((const shape_t *)right)->hits;
+  return (left_hits < right_hits) - (left_hits > right_hits);
+}
+
+void shapesReport(void) {
+  qsort(shapes, shapes_count, sizeof(shape_t), compareShapes);
+
+  unsigned long total = 0;
+  for (size_t i = 0; i < shapes_count; i++) {
+    total += shapes[i].hits;
+  }
+
+  printf("\n === Call Shapes ===\n");
+  for (size_t i = 0; i < shapes_count && i < SHAPES_REPORTED; i++) {
+    printf("    %10lu (%5.2f%%)  %s\n", shapes[i].hits,
+           (double)shapes[i].hits * 100 / (double)total, shapes[i].shape);
+  }
+  printf("\n"
+         "    Stats:\n"
+         "      shapes:    %lu\n"
+         "      untracked: %lu calls\n",
+         shapes_count, shapes_dropped);
+}
+#else
+#define profileShape(Context, Node)
+#endif
@@ -1,5 +1,6 @@
 #include "../lib/list.h"
 #include "../lib/map.h"
+#include "../lib/profile.h"
 #include "../lib/result.h"
 #include "environment.h"
 #include "error.h"
@@ -10,12 +11,10 @@
 #include <stddef.h>
 #include <string.h>
 
-typedef result_value_ref_t (*special_form_t)(environment_t *,
-                                             const node_list_t *);
-
 const char *DEFINE_EXAMPLE = "(def! x (+ 1 2))";
 const char *DEFINE = "def!";
-result_value_ref_t define(environment_t *env, const node_list_t *nodes) {
+result_value_ref_t define(arena_t *arena, environment_t *env,
+                          node_list_t *nodes) {
   assert(nodes->count > 0); // def! is always there
   node_t first = listGet(node_t, nodes, 0);
   if (nodes->count != 3) {
@@ -29,30 +28,189 @@ result_value_ref_t define(environment_t *env, const node_list_t *nodes) {
           "%s requires a symbol and a form. %s", DEFINE, DEFINE_EXAMPLE);
   }
 
-  // Perform reduction in the AST memory
-  value_t *result = nullptr;
-  node_t value = listGet(node_t, nodes, 2);
-  try(result_value_ref_t, evaluate(nodes->arena, &value, env), result);
+  // Perform reduction in transient memory
+  const size_t frame = arena->offset;
+  value_t result;
+  node_t *value = &nodes->data[2];
+  try(result_value_ref_t, evaluateLocal(arena, value, env, &result));
 
-  // If reduction is successful, we can move the closure to VM memory
+  // If reduction is successful, the value is promoted to VM memory, so that it
+  // outlives the memory of the form defining it
   value_t *copy = nullptr;
-  tryWithMeta(result_value_ref_t, valueClone(env->arena, result),
-              value.position, copy);
+  tryWithMeta(result_value_ref_t, valueClone(env->arena, &result),
+              value->position, copy);
+  tryWithMeta(result_value_ref_t, valuePromote(env->code, copy),
+              value->position);
+#ifdef REGISTER_VM
+  if (copy->type == VALUE_TYPE_CLOSURE) {
+    vmCompile(env->code, env, &copy->value.closure);
+  }
+#endif
   tryWithMeta(result_value_ref_t, mapSet(env->values, key.value.symbol, copy),
-              value.position);
-
-  value_t nil = {
-      .type = VALUE_TYPE_NIL,
-      .value.nil = nullptr,
-      .position = first.position,
-  };
-  return ok(result_value_ref_t, &nil);
+              value->position);
+
+  // New global bindings can move the existing ones around
+  if (!env->parent) {
+    env->version++;
+  }
+
+  // Nothing in the reduction's memory is referenced after the promotion
+  if (value->local && arena->offset > frame) {
+    profileEscape(0, arena->offset - frame);
+    arenaRewind(arena, frame);
+  }
+
+  value_t *nil = nullptr;
+  tryWithMeta(result_value_ref_t, valueCreate(arena, VALUE_TYPE_NIL),
+              first.position, nil);
+  nil->value.nil = nullptr;
+  nil->position = first.position;
+  return ok(result_value_ref_t, nil);
 }
 
 const char *FUNCTION_EXAMPLE = "(fn (a b) (+ a b))";
 const char *FUNCTION = "fn";
-result_value_ref_t function(environment_t *env, const node_list_t *nodes) {
-  (void)env;
+const char *LET = "let";
+
+// Symbols bound by the enclosing fn and let forms of a closure body
+typedef struct scope_t {
+  const char *symbol;
+  const struct scope_t *parent;
+} scope_t;
+
+static bool isBound(const scope_t *scope, const char *symbol) {
+  for (; scope; scope = scope->parent) {
+    if (strcmp(scope->symbol, symbol) == 0)
+      return true;
+  }
+  return false;
+}
+
+static result_void_t collectFree(const node_t *node, const scope_t *scope,
+                                 symbol_list_t *variables);
+
+static result_void_t collectBody(const node_list_t *symbols, size_t index,
+                                 const node_t *body, const scope_t *scope,
+                                 symbol_list_t *variables) {
+  if (index == symbols->count)
+    return collectFree(body, scope, variables);
+
+  const node_t *symbol = &symbols->data[index];
+  if (symbol->type != NODE_TYPE_SYMBOL)
+    return collectBody(symbols, index + 1, body, scope, variables);
+
+  const scope_t inner = {.symbol = symbol->value.symbol, .parent = scope};
+  return collectBody(symbols, index + 1, body, &inner, variables);
+}
+
+// let bindings see the ones before them, so they are bound one at a time
+static result_void_t collectLet(const node_list_t *couples, size_t index,
+                                const node_t *body, const scope_t *scope,
+                                symbol_list_t *variables) {
+  if (index == couples->count)
+    return collectFree(body, scope, variables);
+
+  const node_t *couple = &couples->data[index];
+  if (couple->type != NODE_TYPE_LIST || couple->value.list.count != 2 ||
+      couple->value.list.data[0].type != NODE_TYPE_SYMBOL)
+    return collectLet(couples, index + 1, body, scope, variables);
+
+  try(result_void_t,
+      collectFree(&couple->value.list.data[1], scope, variables));
+  const scope_t inner = {.symbol = couple->value.list.data[0].value.symbol,
+                         .parent = scope};
+  return collectLet(couples, index + 1, body, &inner, variables);
+}
+
+// Appends the free variables of `node` to `variables`, once each
+static result_void_t collectFree(const node_t *node, const scope_t *scope,
+                                 symbol_list_t *variables) {
+  if (node->type == NODE_TYPE_SYMBOL) {
+    const char *symbol = node->value.symbol;
+    if (isBound(scope, symbol))
+      return ok(result_void_t);
+
+    for (size_t i = 0; i < variables->count; i++) {
+      if (strcmp(variables->data[i], symbol) == 0)
+        return ok(result_void_t);
+    }
+    return listAppend(symbol_t, variables, symbol);
+  }
+
+  if (node->type != NODE_TYPE_LIST || node->value.list.count == 0)
+    return ok(result_void_t);
+
+  const node_list_t *list = &node->value.list;
+  const node_t *first = &list->data[0];
+  if (first->type == NODE_TYPE_SYMBOL && list->count == 3) {
+    const char *form = first->value.symbol;
+    if (strcmp(form, FUNCTION) == 0 && list->data[1].type == NODE_TYPE_LIST)
+      return collectBody(&list->data[1].value.list, 0, &list->data[2], scope,
+                         variables);
+
+    if (strcmp(form, LET) == 0 && list->data[1].type == NODE_TYPE_LIST)
+      return collectLet(&list->data[1].value.list, 0, &list->data[2], scope,
+                        variables);
+
+    if (strcmp(form, DEFINE) == 0)
+      return collectFree(&list->data[2], scope, variables);
+  }
+
+  for (size_t i = 0; i < list->count; i++) {
+    try(result_void_t, collectFree(&list->data[i], scope, variables));
+  }
+  return ok(result_void_t);
+}
+
+// Free variables of the body of a well-formed fn form, allocated on `arena`
+static result_ref_t freeVariables(arena_t *arena, const node_list_t *nodes) {
+  symbol_list_t *variables = nullptr;
+  try(result_ref_t, listCreate(symbol_t, arena, CLOSURE_CAPTURES_INITIAL_SIZE),
+      variables);
+  try(result_ref_t,
+      collectBody(&nodes->data[1].value.list, 0, &nodes->data[2], nullptr,
+                  variables));
+  return ok(result_ref_t, variables);
+}
+
+// Caches the free variables of the fn forms in `node` on the forms, so that
+// closures don't look for them each time they are created. Free variables
+// only depend on the form itself, which makes this safe on shared lists.
+static result_void_t cacheFreeVariables(arena_t *arena, node_t *node) {
+  if (node->type != NODE_TYPE_LIST || node->value.list.count == 0)
+    return ok(result_void_t);
+
+  node_list_t *list = &node->value.list;
+  for (size_t i = 0; i < list->count; i++) {
+    try(result_void_t, cacheFreeVariables(arena, &list->data[i]));
+  }
+
+  // Malformed fn forms are reported by the evaluator, so they're skipped
+  const node_t *first = &list->data[0];
+  const bool fn = first->type == NODE_TYPE_SYMBOL &&
+                  strcmp(first->value.symbol, FUNCTION) == 0 &&
+                  list->count == 3 && list->data[1].type == NODE_TYPE_LIST;
+  if (!fn || node->value.function.free)
+    return ok(result_void_t);
+
+  try(result_void_t, freeVariables(arena, list), node->value.function.free);
+  return ok(result_void_t);
+}
+
+// Bindings of the global environment are late-bound: they are resolved when
+// the closure is called, which allows for recursion and redefinitions
+static value_t *resolveCapture(environment_t *env, const char *symbol) {
+  for (; env->parent; env = env->parent) {
+    value_t *value = mapGet(value_t, env->values, symbol);
+    if (value)
+      return value;
+  }
+  return nullptr;
+}
+
+result_value_ref_t function(arena_t *arena, environment_t *env,
+                            node_list_t *nodes,
+                            const symbol_list_t **variables) {
   assert(nodes->count > 0); // fn is always there
   node_t first = listGet(node_t, nodes, 0);
   if (nodes->count != 3) {
@@ -77,28 +235,52 @@ result_value_ref_t function(environment_t *env, const node_list_t *nodes) {
     }
   }
 
-  node_t form = listGet(node_t, nodes, 2);
+  node_t *form = &nodes->data[2];
 
   value_t *closure = nullptr;
-  tryWithMeta(result_value_ref_t, valueCreate(nodes->arena, VALUE_TYPE_CLOSURE),
-              form.position, closure);
+  tryWithMeta(result_value_ref_t, valueCreate(arena, VALUE_TYPE_CLOSURE),
+              form->position, closure);
 
   closure->position.column = first.position.column;
   closure->position.line = first.position.line;
 
+  // The body is shared with the form: creating a closure doesn't copy it
+  closure->value.closure.form = form;
+  closure->value.closure.arguments = &nodes->data[1].value.list;
+
+  // Forms that weren't optimized have their free variables cached by their
+  // first closure, on the arena holding them
+  if (!*variables) {
+    tryWithMeta(result_value_ref_t, freeVariables(nodes->arena, nodes),
+                form->position, *variables);
+  }
+
+  // Free variables are copied into the closure, which is then independent of
+  // the environment creating it
+  const symbol_list_t *free_variables = *variables;
+  capture_list_t *captures = nullptr;
   tryWithMeta(result_value_ref_t,
-              listCopy(node_t, &arguments.value.list,
-                       &closure->value.closure.arguments),
-              form.position);
-  tryWithMeta(result_value_ref_t, nodeCopy(&form, &closure->value.closure.form),
-              form.position);
+              listCreate(capture_t, arena, CLOSURE_CAPTURES_INITIAL_SIZE),
+              form->position, captures);
+  for (size_t i = 0; i < free_variables->count; i++) {
+    const value_t *value = resolveCapture(env, free_variables->data[i]);
+    if (!value)
+      continue;
+
+    capture_t capture = {.value = *value};
+    strcpy(capture.symbol, free_variables->data[i]);
+    tryWithMeta(result_value_ref_t,
+                listAppend(capture_t, captures, &capture), form->position);
+  }
+  bytewiseCopy(&closure->value.closure.captures, captures,
+               sizeof(capture_list_t));
 
   return ok(result_value_ref_t, closure);
 }
 
 const char *LET_EXAMPLE = "(let ((a 1) (b 2)) (+ a b))";
-const char *LET = "let";
-result_value_ref_t let(environment_t *env, const node_list_t *nodes) {
+result_value_ref_t let(arena_t *arena, environment_t *env,
+                       node_list_t *nodes) {
   assert(nodes->count > 0); // let is always there
   node_t first = listGet(node_t, nodes, 0);
   if (nodes->count != 3) {
@@ -136,20 +318,20 @@ result_value_ref_t let(environment_t *env, const node_list_t *nodes) {
             LET_EXAMPLE);
     }
 
-    node_t body = listGet(node_t, &couple.value.list, 1);
-    value_t *evaluated = nullptr;
-    tryWithCleanup(result_value_ref_t, evaluate(nodes->arena, &body, local_env),
-                   environmentDestroy(&local_env), evaluated);
+    node_t *body = &couple.value.list.data[1];
+    value_t evaluated;
+    tryWithCleanup(result_value_ref_t,
+                   evaluateLocal(arena, body, local_env, &evaluated),
+                   environmentDestroy(&local_env));
     tryWithCleanupMeta(
         result_value_ref_t,
-        mapSet(local_env->values, symbol.value.symbol, evaluated),
-        environmentDestroy(&local_env), evaluated->position);
+        mapSet(local_env->values, symbol.value.symbol, &evaluated),
+        environmentDestroy(&local_env), evaluated.position);
   }
 
-  node_t form = listGet(node_t, nodes, 2);
-
   value_t *result = nullptr;
-  tryWithCleanup(result_value_ref_t, evaluate(nodes->arena, &form, local_env),
+  tryWithCleanup(result_value_ref_t,
+                 evaluate(arena, &nodes->data[2], local_env),
                  environmentDestroy(&local_env), result);
 
   environmentDestroy(&local_env);
@@ -158,34 +340,37 @@ result_value_ref_t let(environment_t *env, const node_list_t *nodes) {
 
 const char *COND_EXAMPLE = "(cond\n\t((!= x 0) (/ 10 x))\n\t(+ x 10))";
 const char *COND = "cond";
-result_value_ref_t cond(environment_t *env, const node_list_t *nodes) {
+// The value of a cond is the value of the form it selects, which is left to
+// the caller: evaluating it is a tail call
+result_node_ref_t cond(arena_t *arena, environment_t *env, node_list_t *nodes) {
   assert(nodes->count > 0);
-  value_t *result = nullptr;
 
   for (size_t i = 1; i < nodes->count - 1; i++) {
     node_t node = listGet(node_t, nodes, i);
     if (node.type != NODE_TYPE_LIST || node.value.list.count != 2) {
-      throw(result_value_ref_t, ERROR_CODE_RUNTIME_ERROR, node.position,
+      throw(result_node_ref_t, ERROR_CODE_RUNTIME_ERROR, node.position,
             "%s requires a list of condition-form assignments. %s", COND,
             LET_EXAMPLE);
     }
 
-    node_t condition = listGet(node_t, &node.value.list, 0);
-    try(result_value_ref_t, evaluate(nodes->arena, &condition, env), result);
+    node_t *condition = &node.value.list.data[0];
+    profileShape("cond ", condition);
 
-    if (result->type != VALUE_TYPE_BOOLEAN) {
-      throw(result_value_ref_t, ERROR_CODE_RUNTIME_ERROR, node.position,
+    // Compare-and-branch: comparisons of integers are tested in place
+    value_t test;
+    if (!fuseBinaryInteger(condition, env, &test)) {
+      try(result_node_ref_t, evaluateLocal(arena, condition, env, &test));
+    }
+
+    if (test.type != VALUE_TYPE_BOOLEAN) {
+      throw(result_node_ref_t, ERROR_CODE_RUNTIME_ERROR, node.position,
             "Conditions should resolve to a boolean. %s", LET_EXAMPLE);
     }
 
-    if (result->value.boolean) {
-      node_t form = listGet(node_t, &node.value.list, 1);
-      try(result_value_ref_t, evaluate(nodes->arena, &form, env), result);
-      return ok(result_value_ref_t, result);
+    if (test.value.boolean) {
+      return ok(result_node_ref_t, &node.value.list.data[1]);
     }
   }
 
-  node_t fallback = listGet(node_t, nodes, nodes->count - 1);
-  try(result_value_ref_t, evaluate(nodes->arena, &fallback, env), result);
-  return ok(result_value_ref_t, result);
+  return ok(result_node_ref_t, &nodes->data[nodes->count - 1]);
 }
@@ -87,6 +87,24 @@ result_void_position_t mathMin(value_t *result, value_list_t *values) {
   return ok(result_void_position_t);
 }
 
+// State of the generator behind math.random. It's per thread, so that
+// interpreters running concurrently neither race on it nor share a sequence.
+static thread_local uint64_t random_state = 0;
+
+// xorshift64*: good enough for scripts, and cheap
+static uint64_t randomNext(void) {
+  if (random_state == 0) {
+    // Threads seeded within the same second still get distinct sequences
+    random_state = (uint64_t)time(nullptr) ^ (uint64_t)(uintptr_t)&random_state;
+    random_state |= 1;
+  }
+
+  random_state ^= random_state >> 12;
+  random_state ^= random_state << 25;
+  random_state ^= random_state >> 27;
+  return random_state * 2685821657736338717U;
+}
+
 // Math random function - returns a random integer between 0 and RAND_MAX
 const char *MATH_RANDOM = "math.random";
 result_void_position_t mathRandom(value_t *result, value_list_t *values) {
@@ -95,15 +113,8 @@ result_void_position_t mathRandom(value_t *result, value_list_t *values) {
           "%s requires no arguments. Got %zu", MATH_RANDOM, values->count);
   }
 
-  // Initialize random number generator on first call
-  static bool initialized = false;
-  if (!initialized) {
-    srand((unsigned int)time(nullptr));
-    initialized = true;
-  }
-
   result->type = VALUE_TYPE_INTEGER;
-  result->value.integer = rand();
+  result->value.integer = (int32_t)((randomNext() >> 32) % (RAND_MAX + 1U));
 
   return ok(result_void_position_t);
 }
@@ -6,6 +6,7 @@
 
 constexpr char LPAREN = '(';
 constexpr char RPAREN = ')';
+constexpr char COMMENT = ';';
 
 constexpr size_t SYMBOL_SIZE = 16;
 
@@ -14,13 +15,21 @@ typedef enum {
   TOKEN_TYPE_RPAREN,
   TOKEN_TYPE_SYMBOL,
   TOKEN_TYPE_INTEGER,
+  TOKEN_TYPE_EOF,
 } token_type_t;
 
+// Slice of the source buffer the token was read from
+typedef struct {
+  size_t offset;
+  size_t length;
+} source_span_t;
+
 typedef union {
-  char symbol[SYMBOL_SIZE];
+  source_span_t symbol;
   int32_t integer;
   nullptr_t lparen;
   nullptr_t rparen;
+  nullptr_t eof;
 } token_value_t;
 
 typedef struct {
@@ -2,127 +2,352 @@
 #include "error.h"
 #include "position.h"
 
-#include <ctype.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
-#include <stdlib.h>
 #include <string.h>
 
-typedef Result(token_t, position_t) result_token_t;
-result_token_t bufferToToken(size_t buffer_len, char buffer[static buffer_len],
-                             position_t position) {
-  buffer[buffer_len] = 0;
-  char *remainder;
-  // FIXME: this is silently overflowing
-  int32_t number = (int32_t)strtol(buffer, &remainder, 10);
-
-  // This condition is met when all the chars of the token represent an integer
-  // This includes also leading +/-
-  const bool is_number = ((!remainder) || (strlen(remainder) == 0)) != 0;
-  if (is_number) {
-    const token_t tok = {.type = TOKEN_TYPE_INTEGER,
-                         .value.integer = number,
-                         .position = position};
-    return ok(result_token_t, tok);
+typedef enum {
+  ATOM_SYMBOL,
+  ATOM_INTEGER,
+  ATOM_OVERFLOW,
+} atom_class_t;
+
+// Classifies and converts an atom in a single pass. Integers are made of an
+// optional leading +/- followed by digits only. The accumulator saturates at
+// the limit, so arbitrarily long literals cannot wrap around.
+static atom_class_t parseInteger(size_t length, const char atom[static length],
+                                 int32_t *integer) {
+  const bool negative = atom[0] == '-';
+  const size_t start = (negative || atom[0] == '+') ? 1 : 0;
+  if (start == length)
+    return ATOM_SYMBOL;
+
+  const uint64_t limit = negative ? (uint64_t)INT32_MAX + 1 : INT32_MAX;
+  uint64_t value = 0;
+  bool overflow = false;
+
+  for (size_t i = start; i < length; i++) {
+    const unsigned digit = (unsigned char)(atom[i] - '0');
+    if (digit > 9)
+      return ATOM_SYMBOL;
+
+    value = (value * 10) + digit;
+    overflow |= value > limit;
+    value = overflow ? limit : value;
   }
 
-  if (buffer_len >= SYMBOL_SIZE) {
-    throw(result_token_t, ERROR_CODE_SYNTAX_UNEXPECTED_TOKEN, position,
-          "Token too long. Expected length <= %lu, got %lu", SYMBOL_SIZE,
-          buffer_len);
+  if (overflow)
+    return ATOM_OVERFLOW;
+
+  *integer = negative ? (int32_t)(-(int64_t)value) : (int32_t)value;
+  return ATOM_INTEGER;
+}
+
+result_token_t atomToToken(const lexer_t *lexer, size_t start, size_t length,
+                           position_t position) {
+  const char *atom = &lexer->source[start];
+  token_t tok = {.position = position};
+
+  switch (parseInteger(length, atom, &tok.value.integer)) {
+  case ATOM_INTEGER:
+    tok.type = TOKEN_TYPE_INTEGER;
+    return ok(result_token_t, tok);
+  case ATOM_OVERFLOW:
+    throw(result_token_t, ERROR_CODE_SYNTAX_INTEGER_OVERFLOW, position,
+          "Integer out of range. Expected %d <= n <= %d", INT32_MIN,
+          INT32_MAX);
+  case ATOM_SYMBOL:
+  default:
+    // it's just a symbol: it references the source, no copy is needed
+    tok.type = TOKEN_TYPE_SYMBOL;
+    tok.value.symbol.offset = start;
+    tok.value.symbol.length = length;
+    return ok(result_token_t, tok);
   }
+}
 
-  // else, it's just a symbol
-  token_t tok = {.type = TOKEN_TYPE_SYMBOL, .position = position};
-  memcpy(&tok.value.symbol, buffer, buffer_len);
-  tok.value.symbol[buffer_len] = 0;
-  return ok(result_token_t, tok);
+void lexerInit(lexer_t *self, size_t length, const char source[static length]) {
+  self->source = source;
+  self->length = length;
+  self->offset = 0;
+  self->cursor.line = 1;
+  self->cursor.column = 0;
 }
 
-result_token_list_ref_t tokenize(arena_t *arena, const char *source) {
-  position_t cursor = {.column = 0, .line = 1};
+// Character classes are those of the "C" locale, spelled out to avoid the
+// locale-dependent libc calls in the hot loop
+static inline bool isWhitespace(char current_char) {
+  return current_char == ' ' ||
+         (unsigned char)(current_char - '\t') <= (unsigned char)('\r' - '\t');
+}
 
-  token_list_t *tokens = nullptr;
-  tryWithMeta(result_token_list_ref_t, listCreate(token_t, arena, 32), cursor,
-              tokens);
-
-  constexpr size_t BUFFER_CAPACITY = 64;
-  char buffer[BUFFER_CAPACITY] = {0};
-  size_t buffer_len = 0;
-  token_t token;
-  position_t position = {};
-
-  for (int i = 0; source[i] != '\0'; i++) {
-    cursor.column++;
-    const char current_char = source[i];
-
-    if (current_char == LPAREN) {
-      token.type = TOKEN_TYPE_LPAREN;
-      token.value.lparen = nullptr;
-      token.position = cursor;
-      tryWithMeta(result_token_list_ref_t, listAppend(token_t, tokens, &token),
-                  position);
-    } else if (current_char == RPAREN) {
-      if (buffer_len > 0) {
-        try(result_token_list_ref_t,
-            bufferToToken(buffer_len, buffer, position), token);
-        tryWithMeta(result_token_list_ref_t,
-                    listAppend(token_t, tokens, &token), position);
-        // clean buffer
-        buffer_len = 0;
-      }
-
-      token.type = TOKEN_TYPE_RPAREN;
-      token.value.rparen = nullptr;
-      token.position = cursor;
-      tryWithMeta(result_token_list_ref_t, listAppend(token_t, tokens, &token),
-                  position);
-    } else if (isspace(current_char)) {
-      if (current_char == '\n') {
-        cursor.line++;
-        cursor.column = 0;
-      }
-
-      if (buffer_len == 0)
-        continue;
-
-      try(result_token_list_ref_t, bufferToToken(buffer_len, buffer, position),
-          token);
-      tryWithMeta(result_token_list_ref_t, listAppend(token_t, tokens, &token),
-                  position);
-      // clean buffer
-      buffer_len = 0;
-    } else if (isprint(current_char)) {
-      if (buffer_len == 0) {
-        position.line = cursor.line;
-        position.column = cursor.column;
-      }
-
-      if (buffer_len >= BUFFER_CAPACITY) {
-        throw(result_token_list_ref_t, ERROR_CODE_SYNTAX_UNEXPECTED_TOKEN,
-              position, "Token too long. Expected length <= %lu, got %lu",
-              SYMBOL_SIZE, buffer_len);
-      }
-
-      buffer[buffer_len++] = current_char;
-      continue;
-    } else {
-      throw(result_token_list_ref_t, ERROR_CODE_SYNTAX_UNEXPECTED_TOKEN, cursor,
-            "Unexpected token '%c'", current_char);
+static inline bool isPrintable(char current_char) {
+  return (unsigned char)(current_char - ' ') <= (unsigned char)('~' - ' ');
+}
+
+static inline bool isDelimiter(char current_char) {
+  return current_char == LPAREN || current_char == RPAREN ||
+         current_char == COMMENT || isWhitespace(current_char);
+}
+
+// Bulk scanning
+// ---
+//
+// Whitespace runs and atoms are scanned SCAN_WIDTH bytes at a time. Each
+// chunk is turned into bitmasks with SCAN_BITS bits per byte (movemask on x86,
+// narrowing shift on arm64) so that the first interesting byte is found with a
+// count-trailing-zeros and newlines are counted with a popcount.
+
+#if defined(SCALAR_LEXER)
+// Forced scalar build, used as a baseline by the benchmarks
+#elif defined(__AVX2__)
+#include <immintrin.h>
+#define SCAN_WIDTH 32
+#define SCAN_BITS 1
+
+static inline uint64_t toMask(__m256i chunk) {
+  return (uint32_t)_mm256_movemask_epi8(chunk);
+}
+
+static inline void whitespaceMasks(const char *source, uint64_t *whitespace,
+                                   uint64_t *newline) {
+  const __m256i chunk = _mm256_loadu_si256((const void *)source);
+  const __m256i shifted = _mm256_sub_epi8(chunk, _mm256_set1_epi8('\t'));
+  const __m256i control = _mm256_cmpeq_epi8(
+      _mm256_min_epu8(shifted, _mm256_set1_epi8('\r' - '\t')), shifted);
+  const __m256i space = _mm256_cmpeq_epi8(chunk, _mm256_set1_epi8(' '));
+  *whitespace = toMask(_mm256_or_si256(space, control));
+  *newline = toMask(_mm256_cmpeq_epi8(chunk, _mm256_set1_epi8('\n')));
+}
+
+static inline uint64_t stopMask(const char *source) {
+  const __m256i chunk = _mm256_loadu_si256((const void *)source);
+  const __m256i shifted = _mm256_sub_epi8(chunk, _mm256_set1_epi8(' '));
+  const __m256i printable = _mm256_cmpeq_epi8(
+      _mm256_min_epu8(shifted, _mm256_set1_epi8('~' - ' ')), shifted);
+  const __m256i delimiters = _mm256_or_si256(
+      _mm256_or_si256(_mm256_cmpeq_epi8(chunk, _mm256_set1_epi8(' ')),
+                      _mm256_cmpeq_epi8(chunk, _mm256_set1_epi8(COMMENT))),
+      _mm256_or_si256(_mm256_cmpeq_epi8(chunk, _mm256_set1_epi8(LPAREN)),
+                      _mm256_cmpeq_epi8(chunk, _mm256_set1_epi8(RPAREN))));
+  return toMask(delimiters) | (~toMask(printable) & 0xFFFFFFFFU);
+}
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define SCAN_WIDTH 16
+#define SCAN_BITS 1
+
+static inline uint64_t toMask(__m128i chunk) {
+  return (uint16_t)_mm_movemask_epi8(chunk);
+}
+
+static inline void whitespaceMasks(const char *source, uint64_t *whitespace,
+                                   uint64_t *newline) {
+  const __m128i chunk = _mm_loadu_si128((const void *)source);
+  const __m128i shifted = _mm_sub_epi8(chunk, _mm_set1_epi8('\t'));
+  const __m128i control = _mm_cmpeq_epi8(
+      _mm_min_epu8(shifted, _mm_set1_epi8('\r' - '\t')), shifted);
+  const __m128i space = _mm_cmpeq_epi8(chunk, _mm_set1_epi8(' '));
+  *whitespace = toMask(_mm_or_si128(space, control));
+  *newline = toMask(_mm_cmpeq_epi8(chunk, _mm_set1_epi8('\n')));
+}
+
+static inline uint64_t stopMask(const char *source) {
+  const __m128i chunk = _mm_loadu_si128((const void *)source);
+  const __m128i shifted = _mm_sub_epi8(chunk, _mm_set1_epi8(' '));
+  const __m128i printable = _mm_cmpeq_epi8(
+      _mm_min_epu8(shifted, _mm_set1_epi8('~' - ' ')), shifted);
+  const __m128i delimiters =
+      _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, _mm_set1_epi8(' ')),
+                                _mm_cmpeq_epi8(chunk, _mm_set1_epi8(COMMENT))),
+                   _mm_or_si128(_mm_cmpeq_epi8(chunk, _mm_set1_epi8(LPAREN)),
+                                _mm_cmpeq_epi8(chunk, _mm_set1_epi8(RPAREN))));
+  return toMask(delimiters) | (~toMask(printable) & 0xFFFFU);
+}
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define SCAN_WIDTH 16
+#define SCAN_BITS 4
+
+static inline uint64_t toMask(uint8x16_t chunk) {
+  const uint8x8_t narrowed = vshrn_n_u16(vreinterpretq_u16_u8(chunk), 4);
+  return vget_lane_u64(vreinterpret_u64_u8(narrowed), 0);
+}
+
+static inline void whitespaceMasks(const char *source, uint64_t *whitespace,
+                                   uint64_t *newline) {
+  const uint8x16_t chunk = vld1q_u8((const uint8_t *)source);
+  const uint8x16_t control = vcleq_u8(vsubq_u8(chunk, vdupq_n_u8('\t')),
+                                      vdupq_n_u8('\r' - '\t'));
+  const uint8x16_t space = vceqq_u8(chunk, vdupq_n_u8(' '));
+  *whitespace = toMask(vorrq_u8(space, control));
+  *newline = toMask(vceqq_u8(chunk, vdupq_n_u8('\n')));
+}
+
+static inline uint64_t stopMask(const char *source) {
+  const uint8x16_t chunk = vld1q_u8((const uint8_t *)source);
+  const uint8x16_t printable =
+      vcleq_u8(vsubq_u8(chunk, vdupq_n_u8(' ')), vdupq_n_u8('~' - ' '));
+  const uint8x16_t delimiters =
+      vorrq_u8(vorrq_u8(vceqq_u8(chunk, vdupq_n_u8(' ')),
+                        vceqq_u8(chunk, vdupq_n_u8(COMMENT))),
+               vorrq_u8(vceqq_u8(chunk, vdupq_n_u8(LPAREN)),
+                        vceqq_u8(chunk, vdupq_n_u8(RPAREN))));
+  return toMask(vorrq_u8(delimiters, vmvnq_u8(printable)));
+}
+#endif
+
+static void skipBlanks(lexer_t *self) {
+  const char *source = self->source;
+  size_t offset = self->offset;
+  size_t newlines = 0;
+  size_t line_start = 0; // offset following the last newline
+
+#ifdef SCAN_WIDTH
+  while (offset + SCAN_WIDTH <= self->length) {
+    uint64_t whitespace;
+    uint64_t newline;
+    whitespaceMasks(&source[offset], &whitespace, &newline);
+
+    const uint64_t others = ~whitespace;
+    const size_t run = others ? (size_t)__builtin_ctzll(others) / SCAN_BITS
+                              : SCAN_WIDTH;
+    if (run < SCAN_WIDTH) {
+      newline &= (1ULL << (run * SCAN_BITS)) - 1;
     }
+
+    if (newline) {
+      newlines += (size_t)__builtin_popcountll(newline) / SCAN_BITS;
+      line_start =
+          offset + (size_t)(63 - __builtin_clzll(newline)) / SCAN_BITS + 1;
+    }
+
+    offset += run;
+    if (run < SCAN_WIDTH)
+      break;
+  }
+#endif
+
+  while (offset < self->length && isWhitespace(source[offset])) {
+    if (source[offset] == '\n') {
+      newlines++;
+      line_start = offset + 1;
+    }
+    offset++;
+  }
+
+  if (newlines > 0) {
+    self->cursor.line += newlines;
+    self->cursor.column = offset - line_start;
+  } else {
+    self->cursor.column += offset - self->offset;
+  }
+  self->offset = offset;
+}
+
+// Comments run from `;` to the end of the line, and are discarded like blanks
+static void skipWhitespaces(lexer_t *self) {
+  skipBlanks(self);
+
+  while (self->offset < self->length &&
+         self->source[self->offset] == COMMENT) {
+    const char *newline = memchr(&self->source[self->offset], '\n',
+                                 self->length - self->offset);
+    const size_t end =
+        newline ? (size_t)(newline - self->source) : self->length;
+    self->cursor.column += end - self->offset;
+    self->offset = end;
+    skipBlanks(self);
   }
+}
 
-  if (buffer_len > 0) {
-    if (buffer_len >= BUFFER_CAPACITY) {
-      throw(result_token_list_ref_t, ERROR_CODE_SYNTAX_UNEXPECTED_TOKEN,
-            position, "Token too long. Expected length <= %lu, got %lu",
-            SYMBOL_SIZE, buffer_len);
+// Returns the offset of the first byte, starting from `offset`, that cannot be
+// part of an atom: either a delimiter or a non-printable character
+static size_t scanAtom(const lexer_t *self, size_t offset) {
+  const char *source = self->source;
+
+#ifdef SCAN_WIDTH
+  while (offset + SCAN_WIDTH <= self->length) {
+    const uint64_t stop = stopMask(&source[offset]);
+    if (stop) {
+      return offset + (size_t)__builtin_ctzll(stop) / SCAN_BITS;
     }
-    try(result_token_list_ref_t, bufferToToken(buffer_len, buffer, position),
-        token);
+    offset += SCAN_WIDTH;
+  }
+#endif
+
+  while (offset < self->length && isPrintable(source[offset]) &&
+         !isDelimiter(source[offset])) {
+    offset++;
+  }
+  return offset;
+}
+
+result_token_t lexerNext(lexer_t *self) {
+  skipWhitespaces(self);
+
+  token_t token = {.position = self->cursor};
+  if (self->offset >= self->length) {
+    token.type = TOKEN_TYPE_EOF;
+    token.value.eof = nullptr;
+    return ok(result_token_t, token);
+  }
+
+  const size_t start = self->offset;
+  const char current_char = self->source[self->offset++];
+  self->cursor.column++;
+  token.position = self->cursor;
+
+  if (current_char == LPAREN) {
+    token.type = TOKEN_TYPE_LPAREN;
+    token.value.lparen = nullptr;
+    return ok(result_token_t, token);
+  }
+
+  if (current_char == RPAREN) {
+    token.type = TOKEN_TYPE_RPAREN;
+    token.value.rparen = nullptr;
+    return ok(result_token_t, token);
+  }
+
+  if (!isPrintable(current_char)) {
+    throw(result_token_t, ERROR_CODE_SYNTAX_UNEXPECTED_TOKEN, self->cursor,
+          "Unexpected token '%c'", current_char);
+  }
+
+  // Atoms extend until the next delimiter
+  const position_t position = self->cursor;
+  const size_t end = scanAtom(self, self->offset);
+  self->cursor.column += end - self->offset;
+  self->offset = end;
+
+  if (end < self->length && !isDelimiter(self->source[end])) {
+    self->cursor.column++;
+    throw(result_token_t, ERROR_CODE_SYNTAX_UNEXPECTED_TOKEN, self->cursor,
+          "Unexpected token '%c'", self->source[end]);
+  }
+
+  return atomToToken(self, start, end - start, position);
+}
+
+result_token_list_ref_t tokenize(arena_t *arena, const char *source) {
+  lexer_t lexer;
+  lexerInit(&lexer, strlen(source), source);
+
+  token_list_t *tokens = nullptr;
+  tryWithMeta(result_token_list_ref_t, listCreate(token_t, arena, 32),
+              lexer.cursor, tokens);
+
+  while (true) {
+    token_t token;
+    try(result_token_list_ref_t, lexerNext(&lexer), token);
+
+    if (token.type == TOKEN_TYPE_EOF)
+      break;
+
     tryWithMeta(result_token_list_ref_t, listAppend(token_t, tokens, &token),
-                position);
+                token.position);
   }
 
   return ok(result_token_list_ref_t, tokens);
@@ -4,5 +4,20 @@
 #include "../lib/result.h"
 #include "token.h"
 typedef Result(token_list_t *, position_t) result_token_list_ref_t;
+typedef Result(token_t, position_t) result_token_t;
+
+// Pull-style lexer: tokens are produced one at a time by `lexerNext`, so
+// consumers never need to materialise the whole token list.
+typedef struct {
+  const char *source; // Source buffer, not necessarily null-terminated
+  size_t length;      // Length of the source buffer
+  size_t offset;      // Offset of the next character to be read
+  position_t cursor;  // Position of the last character read
+} lexer_t;
+
+void lexerInit(lexer_t *self, size_t length, const char source[static length]);
+
+// Once the input is exhausted, it keeps returning TOKEN_TYPE_EOF tokens
+result_token_t lexerNext(lexer_t *self);
 
 result_token_list_ref_t tokenize(arena_t *arena, const char *source);
@@ -12,19 +12,31 @@ result_ref_t valueCreate(arena_t *arena, value_type_t type) {
     bytewiseCopy(&value->value.list, list, sizeof(value_list_t));
   }
 
-  if (value->type == VALUE_TYPE_CLOSURE) {
-    value_list_t *list = nullptr;
-    try(result_ref_t, listCreate(node_t, arena, VALUE_LIST_INITIAL_SIZE), list);
-    bytewiseCopy(&value->value.closure.arguments, list, sizeof(value_list_t));
-
-    // TODO: this is pessimistic, forms can be also non-lists and therefore
-    // require less memory. Can we clean this up?
-    node_t *form = nullptr;
-    try(result_ref_t, nodeCreate(arena, NODE_TYPE_LIST), form);
-    bytewiseCopy(&value->value.closure.form, form, sizeof(node_t));
+  return ok(result_ref_t, value);
+}
+
+static result_void_t cloneCaptures(arena_t *arena, const capture_list_t *source,
+                                   capture_list_t *destination) {
+  if (source->count == 0)
+    return ok(result_void_t);
+
+  capture_list_t *list = nullptr;
+  try(result_void_t, listCreate(capture_t, arena, source->count), list);
+
+  for (size_t i = 0; i < source->count; i++) {
+    capture_t capture = listGet(capture_t, source, i);
+    if (capture.value.type == VALUE_TYPE_LIST ||
+        capture.value.type == VALUE_TYPE_CLOSURE) {
+      value_t *clone = nullptr;
+      tryWithMeta(result_void_t, valueClone(arena, &capture.value), nullptr,
+                  clone);
+      capture.value = *clone;
+    }
+    try(result_void_t, listAppend(capture_t, list, &capture));
   }
 
-  return ok(result_ref_t, value);
+  bytewiseCopy(destination, list, sizeof(capture_list_t));
+  return ok(result_void_t);
 }
 
 result_value_ref_t valueClone(arena_t *arena, const value_t *source) {
@@ -48,22 +60,72 @@ result_value_ref_t valueClone(arena_t *arena, const value_t *source) {
     destination->value.nil = source->value.nil;
     break;
   case VALUE_TYPE_CLOSURE:
-    nodeCopy(&source->value.closure.form, &destination->value.closure.form);
-
+    destination->value.closure.form = source->value.closure.form;
+    destination->value.closure.arguments = source->value.closure.arguments;
+#ifdef REGISTER_VM
+    destination->value.closure.program = source->value.closure.program;
+#endif
     tryWithMeta(result_value_ref_t,
-                listCopy(value_t, &source->value.closure.arguments,
-                         &destination->value.closure.arguments),
+                cloneCaptures(arena, &source->value.closure.captures,
+                              &destination->value.closure.captures),
                 source->position);
     break;
   case VALUE_TYPE_LIST:
-    tryWithMeta(
-        result_value_ref_t,
-        listCopy(value_t, &source->value.list, &destination->value.list),
-        source->position);
+    // Nested lists and closures reference memory of their own, which is
+    // cloned as well, so that the clone does not depend on the source arena
+    for (size_t i = 0; i < source->value.list.count; i++) {
+      value_t item = listGet(value_t, &source->value.list, i);
+      if (item.type == VALUE_TYPE_LIST || item.type == VALUE_TYPE_CLOSURE) {
+        value_t *clone = nullptr;
+        try(result_value_ref_t, valueClone(arena, &item), clone);
+        item = *clone;
+      }
+      tryWithMeta(result_value_ref_t,
+                  listAppend(value_t, &destination->value.list, &item),
+                  source->position);
+    }
     break;
   default:
     unreachable();
   }
 
   return ok(result_value_ref_t, destination);
-}
\ No newline at end of file
+}
+static result_ref_t promoteNode(arena_t *code, const node_t *source) {
+  node_t *node = nullptr;
+  try(result_ref_t, nodeCreate(code, source->type), node);
+  try(result_ref_t, nodeDeepCopy(source, node));
+  return ok(result_ref_t, node);
+}
+
+result_void_t valuePromote(arena_t *code, value_t *value) {
+  if (value->type == VALUE_TYPE_LIST) {
+    for (size_t i = 0; i < value->value.list.count; i++) {
+      try(result_void_t, valuePromote(code, &value->value.list.data[i]));
+    }
+    return ok(result_void_t);
+  }
+
+  if (value->type != VALUE_TYPE_CLOSURE)
+    return ok(result_void_t);
+
+  closure_t *closure = &value->value.closure;
+  for (size_t i = 0; i < closure->captures.count; i++) {
+    try(result_void_t, valuePromote(code, &closure->captures.data[i].value));
+  }
+
+  if (arenaOwns(code, closure->form))
+    return ok(result_void_t);
+
+  node_t *form = nullptr;
+  try(result_void_t, promoteNode(code, closure->form), form);
+
+  const node_t arguments_node = {.type = NODE_TYPE_LIST,
+                                 .value.list = *closure->arguments};
+  node_t *arguments = nullptr;
+  try(result_void_t, promoteNode(code, &arguments_node), arguments);
+
+  closure->form = form;
+  closure->arguments = &arguments->value.list;
+  return ok(result_void_t);
+}
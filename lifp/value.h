@@ -9,6 +9,8 @@
 
 typedef struct value_t value_t;
 typedef List(value_t) value_list_t;
+typedef struct capture_t capture_t;
+typedef List(capture_t) capture_list_t;
 typedef Result(value_t *, position_t) result_value_ref_t;
 typedef ResultVoid(position_t) result_void_position_t;
 typedef result_void_position_t (*builtin_t)(value_t *result,
@@ -23,9 +25,19 @@ typedef enum {
   VALUE_TYPE_LIST,
 } value_type_t;
 
+// Closures share their body with the fn form they come from: it's never
+// copied, unless the closure outlives the form (see valuePromote). Its shape is
+// immutable, but nodes specialize themselves when evaluated (see quicken.c).
 typedef struct {
-  node_t form;
-  node_list_t arguments;
+  node_t *form;
+  const node_list_t *arguments;
+  // Values of the free variables bound outside of the global environment when
+  // the closure was created. Other free variables are global.
+  capture_list_t captures;
+#ifdef REGISTER_VM
+  // Compiled body, when the closure runs on the register machine (see vm.c)
+  const struct program_t *program;
+#endif
 } closure_t;
 
 typedef struct value_t {
@@ -41,7 +53,18 @@ typedef struct value_t {
   } value;
 } value_t;
 
+typedef struct capture_t {
+  char symbol[SYMBOL_SIZE];
+  value_t value;
+} capture_t;
+
 constexpr size_t VALUE_LIST_INITIAL_SIZE = 8;
+constexpr size_t CLOSURE_CAPTURES_INITIAL_SIZE = 2;
 
 result_ref_t valueCreate(arena_t *arena, value_type_t type);
+// The clone lives entirely on `arena`, regardless of where the source lives,
+// except for closure bodies which are shared
 result_value_ref_t valueClone(arena_t *arena, const value_t *source);
+// Moves closure bodies referenced by `value` to the long-lived `code` region,
+// unless they live there already
+result_void_t valuePromote(arena_t *code, value_t *value);
@@ -0,0 +1,685 @@
+#include "../lib/arena.h"
+#include "../lib/result.h"
+#include "environment.h"
+#include "error.h"
+#include "node.h"
+#include "value.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// Register machine
+// ---
+//
+// With REGISTER_VM, closures bound by def! are compiled to instructions over
+// a fixed file of registers of their frame, and calls between them don't
+// create environments: arguments are copied straight into the registers of
+// the callee, followed by its captured values. Let bindings and temporaries
+// get the registers left, handed out by a linear-scan allocator.
+//
+// Bodies the compiler can't handle (fn and def! forms, malformed forms, or
+// more live values than registers) are left to the tree walker, as are calls
+// to builtins and to closures without a program.
+//
+// ```sh
+// make VM=1 bin/run
+// ```
+
+#ifdef REGISTER_VM
+
+constexpr size_t REGISTERS_COUNT = 32;
+constexpr size_t CALL_MAX_SIZE = 16;
+constexpr size_t INSTRUCTIONS_CAPACITY = 256;
+constexpr size_t OPERANDS_CAPACITY = 512;
+constexpr size_t VIRTUAL_REGISTERS_CAPACITY = 256;
+// Programs run on the native stack, a frame of registers each: past this many
+// nested runs, calls are handed back to the tree walker instead of failing, so
+// that the machine never refuses a recursion the tree walker would run
+constexpr size_t VM_MAX_DEPTH = 512;
+
+// Runs nested on the native stack of the thread, whatever their environment
+static thread_local size_t vm_depth = 0;
+
+typedef enum {
+  OPCODE_INTEGER,
+  OPCODE_BOOLEAN,
+  OPCODE_NIL,
+  OPCODE_GLOBAL,
+  OPCODE_MOVE,
+  // Builtin call specialized for two integers, if the guards hold
+  OPCODE_BINARY,
+  OPCODE_CALL,
+  // Jumps if the source is false
+  OPCODE_BRANCH,
+  OPCODE_JUMP,
+  OPCODE_RETURN,
+} opcode_t;
+
+typedef struct {
+  opcode_t opcode;
+  node_quick_t quick;
+  uint16_t target;
+  uint16_t source;
+  // Registers of the callee and the arguments of calls, in `operands`
+  uint16_t count;
+  size_t operands;
+  union {
+    int32_t integer;
+    bool boolean;
+    size_t jump;
+  } immediate;
+  // Positions for values and errors, and the cache of globals
+  node_t *node;
+} instruction_t;
+
+typedef struct program_t {
+  size_t count;
+  instruction_t *instructions;
+  uint16_t *operands;
+} program_t;
+
+// Live range of a virtual register, as instruction indexes
+typedef struct {
+  size_t start;
+  size_t end;
+} interval_t;
+
+// Instructions are emitted on virtual registers first, and rewritten to the
+// allocated ones once the whole body is compiled
+typedef struct {
+  environment_t *globals;
+  instruction_t instructions[INSTRUCTIONS_CAPACITY];
+  size_t count;
+  uint16_t operands[OPERANDS_CAPACITY];
+  size_t operands_count;
+  interval_t intervals[VIRTUAL_REGISTERS_CAPACITY];
+  size_t registers;
+  // Arguments and captures come first, and keep their registers
+  size_t fixed;
+} compiler_t;
+
+// Registers of the symbols bound by arguments, captures and let
+typedef struct slot_t {
+  const char *symbol;
+  uint16_t reg;
+  const struct slot_t *parent;
+} slot_t;
+
+static const slot_t *lookupSlot(const slot_t *scope, const char *symbol) {
+  for (; scope; scope = scope->parent) {
+    if (strcmp(scope->symbol, symbol) == 0)
+      return scope;
+  }
+  return nullptr;
+}
+
+static bool newRegister(compiler_t *compiler, uint16_t *reg) {
+  if (compiler->registers == VIRTUAL_REGISTERS_CAPACITY)
+    return false;
+
+  compiler->intervals[compiler->registers] =
+      (interval_t){.start = SIZE_MAX, .end = 0};
+  *reg = (uint16_t)compiler->registers++;
+  return true;
+}
+
+// Registers read or written by an instruction
+static size_t registersOf(uint16_t *operands, instruction_t *instruction,
+                          uint16_t *registers[static CALL_MAX_SIZE + 1]) {
+  switch (instruction->opcode) {
+  case OPCODE_INTEGER:
+  case OPCODE_BOOLEAN:
+  case OPCODE_NIL:
+  case OPCODE_GLOBAL:
+    registers[0] = &instruction->target;
+    return 1;
+  case OPCODE_MOVE:
+    registers[0] = &instruction->target;
+    registers[1] = &instruction->source;
+    return 2;
+  case OPCODE_BINARY:
+  case OPCODE_CALL:
+    registers[0] = &instruction->target;
+    for (size_t i = 0; i < instruction->count; i++) {
+      registers[i + 1] = &operands[instruction->operands + i];
+    }
+    return instruction->count + (size_t)1;
+  case OPCODE_BRANCH:
+  case OPCODE_RETURN:
+    registers[0] = &instruction->source;
+    return 1;
+  case OPCODE_JUMP:
+  default:
+    return 0;
+  }
+}
+
+static bool emit(compiler_t *compiler, instruction_t instruction,
+                 size_t *index) {
+  if (compiler->count == INSTRUCTIONS_CAPACITY)
+    return false;
+
+  *index = compiler->count;
+  compiler->instructions[*index] = instruction;
+
+  // Live ranges grow with every instruction using the register
+  uint16_t *registers[CALL_MAX_SIZE + 1];
+  const size_t count = registersOf(
+      compiler->operands, &compiler->instructions[*index], registers);
+  for (size_t i = 0; i < count; i++) {
+    interval_t *interval = &compiler->intervals[*registers[i]];
+    if (interval->start > *index)
+      interval->start = *index;
+    if (interval->end < *index)
+      interval->end = *index;
+  }
+
+  compiler->count++;
+  return true;
+}
+
+static bool compileNode(compiler_t *compiler, node_t *node,
+                        const slot_t *scope, uint16_t *reg);
+
+static bool compileBindings(compiler_t *compiler, node_list_t *couples,
+                            size_t index, node_t *body, const slot_t *scope,
+                            uint16_t *reg) {
+  if (index == couples->count)
+    return compileNode(compiler, body, scope, reg);
+
+  node_t *couple = &couples->data[index];
+  if (couple->type != NODE_TYPE_LIST || couple->value.list.count != 2 ||
+      couple->value.list.data[0].type != NODE_TYPE_SYMBOL)
+    return false;
+
+  // Bindings are immutable: symbols bound to symbols share their register
+  uint16_t value;
+  if (!compileNode(compiler, &couple->value.list.data[1], scope, &value))
+    return false;
+
+  const slot_t slot = {.symbol = couple->value.list.data[0].value.symbol,
+                       .reg = value,
+                       .parent = scope};
+  return compileBindings(compiler, couples, index + 1, body, &slot, reg);
+}
+
+// Clauses test their condition and jump to the next one when it's false, or
+// write their value to the result and jump past the fallback otherwise
+static bool compileCond(compiler_t *compiler, node_list_t *list,
+                        const slot_t *scope, uint16_t *reg) {
+  if (list->count < 2)
+    return false;
+
+  for (size_t i = 1; i < list->count - 1; i++) {
+    const node_t *clause = &list->data[i];
+    if (clause->type != NODE_TYPE_LIST || clause->value.list.count != 2)
+      return false;
+  }
+
+  if (!newRegister(compiler, reg))
+    return false;
+
+  // Exits are chained through their jump, until the end is known
+  size_t exits = SIZE_MAX;
+  for (size_t i = 1; i < list->count - 1; i++) {
+    node_t *clause = &list->data[i];
+    uint16_t test;
+    uint16_t value;
+    size_t branch;
+    size_t done;
+    if (!compileNode(compiler, &clause->value.list.data[0], scope, &test) ||
+        !emit(compiler,
+              (instruction_t){
+                  .opcode = OPCODE_BRANCH, .source = test, .node = clause},
+              &branch) ||
+        !compileNode(compiler, &clause->value.list.data[1], scope, &value) ||
+        !emit(compiler,
+              (instruction_t){.opcode = OPCODE_MOVE,
+                              .target = *reg,
+                              .source = value,
+                              .node = clause},
+              &done) ||
+        !emit(compiler,
+              (instruction_t){.opcode = OPCODE_JUMP,
+                              .immediate.jump = exits,
+                              .node = clause},
+              &done))
+      return false;
+
+    exits = done;
+    compiler->instructions[branch].immediate.jump = compiler->count;
+  }
+
+  node_t *fallback = &list->data[list->count - 1];
+  uint16_t value;
+  size_t index;
+  if (!compileNode(compiler, fallback, scope, &value) ||
+      !emit(compiler,
+            (instruction_t){.opcode = OPCODE_MOVE,
+                            .target = *reg,
+                            .source = value,
+                            .node = fallback},
+            &index))
+    return false;
+
+  while (exits != SIZE_MAX) {
+    instruction_t *jump = &compiler->instructions[exits];
+    exits = jump->immediate.jump;
+    jump->immediate.jump = compiler->count;
+  }
+  return true;
+}
+
+static bool compileCall(compiler_t *compiler, node_t *node,
+                        const slot_t *scope, uint16_t *reg) {
+  node_list_t *list = &node->value.list;
+  if (list->count > CALL_MAX_SIZE)
+    return false;
+
+  uint16_t elements[CALL_MAX_SIZE];
+  for (size_t i = 0; i < list->count; i++) {
+    if (!compileNode(compiler, &list->data[i], scope, &elements[i]))
+      return false;
+  }
+
+  if (compiler->operands_count + list->count > OPERANDS_CAPACITY ||
+      !newRegister(compiler, reg))
+    return false;
+
+  // Builtins are specialized for the current global bindings, and guarded
+  node_quick_t quick = NODE_QUICK_CALL;
+  const node_t *head = &list->data[0];
+  if (list->count == 3 && head->type == NODE_TYPE_SYMBOL &&
+      !lookupSlot(scope, head->value.symbol)) {
+    const value_t *callee =
+        environmentResolveSymbol(compiler->globals, head->value.symbol);
+    if (callee && callee->type == VALUE_TYPE_BUILTIN)
+      quick = quickenBuiltin(callee->value.builtin);
+  }
+
+  const size_t operands = compiler->operands_count;
+  memcpy(&compiler->operands[operands], elements,
+         list->count * sizeof(uint16_t));
+  compiler->operands_count += list->count;
+
+  size_t index;
+  return emit(compiler,
+              (instruction_t){
+                  .opcode = quick == NODE_QUICK_CALL ? OPCODE_CALL
+                                                     : OPCODE_BINARY,
+                  .quick = quick,
+                  .target = *reg,
+                  .count = (uint16_t)list->count,
+                  .operands = operands,
+                  .node = node,
+              },
+              &index);
+}
+
+static bool compileNode(compiler_t *compiler, node_t *node,
+                        const slot_t *scope, uint16_t *reg) {
+  instruction_t instruction = {.target = 0, .node = node};
+  switch (node->type) {
+  case NODE_TYPE_INTEGER:
+    instruction.opcode = OPCODE_INTEGER;
+    instruction.immediate.integer = node->value.integer;
+    break;
+  case NODE_TYPE_BOOLEAN:
+    instruction.opcode = OPCODE_BOOLEAN;
+    instruction.immediate.boolean = node->value.boolean;
+    break;
+  case NODE_TYPE_NIL:
+    instruction.opcode = OPCODE_NIL;
+    break;
+  case NODE_TYPE_SYMBOL: {
+    const slot_t *slot = lookupSlot(scope, node->value.symbol);
+    if (slot) {
+      *reg = slot->reg;
+      return true;
+    }
+    // Globals are resolved through the cache of the node (see quicken.c)
+    if (node->quick == NODE_QUICK_NONE)
+      quickenNode(node);
+    instruction.opcode = OPCODE_GLOBAL;
+    break;
+  }
+  case NODE_TYPE_LIST:
+  default: {
+    node_list_t *list = &node->value.list;
+    if (list->count == 0)
+      return false;
+
+    const node_t *head = &list->data[0];
+    if (head->type == NODE_TYPE_SYMBOL) {
+      const char *symbol = head->value.symbol;
+      if (strcmp(symbol, FUNCTION) == 0 || strcmp(symbol, DEFINE) == 0)
+        return false;
+
+      if (strcmp(symbol, LET) == 0) {
+        if (list->count != 3 || list->data[1].type != NODE_TYPE_LIST)
+          return false;
+        return compileBindings(compiler, &list->data[1].value.list, 0,
+                               &list->data[2], scope, reg);
+      }
+
+      if (strcmp(symbol, COND) == 0)
+        return compileCond(compiler, list, scope, reg);
+    }
+    return compileCall(compiler, node, scope, reg);
+  }
+  }
+
+  size_t index;
+  if (!newRegister(compiler, reg))
+    return false;
+  instruction.target = *reg;
+  return emit(compiler, instruction, &index);
+}
+
+// Linear scan: registers are handed out in order of the start of the live
+// ranges, and taken back once the range is over. Control flow only jumps
+// forward, so the range between the first and last use of a register covers
+// all the instructions it is live in. Arguments and captures keep the first
+// registers for the whole program.
+static bool allocateRegisters(compiler_t *compiler) {
+  uint16_t physical[VIRTUAL_REGISTERS_CAPACITY];
+  uint16_t order[VIRTUAL_REGISTERS_CAPACITY];
+  uint16_t active[REGISTERS_COUNT];
+  size_t active_count = 0;
+  bool used[REGISTERS_COUNT] = {};
+
+  for (size_t i = 0; i < compiler->fixed; i++) {
+    physical[i] = (uint16_t)i;
+    used[i] = true;
+  }
+
+  // Virtual registers are mostly created in order: insertion sort is enough
+  size_t count = 0;
+  for (size_t i = compiler->fixed; i < compiler->registers; i++) {
+    size_t j = count++;
+    for (; j > 0 && compiler->intervals[order[j - 1]].start >
+                        compiler->intervals[i].start;
+         j--) {
+      order[j] = order[j - 1];
+    }
+    order[j] = (uint16_t)i;
+  }
+
+  for (size_t i = 0; i < count; i++) {
+    const interval_t *interval = &compiler->intervals[order[i]];
+
+    for (size_t j = 0; j < active_count;) {
+      if (compiler->intervals[active[j]].end < interval->start) {
+        used[physical[active[j]]] = false;
+        active[j] = active[--active_count];
+      } else {
+        j++;
+      }
+    }
+
+    size_t reg = 0;
+    while (reg < REGISTERS_COUNT && used[reg]) {
+      reg++;
+    }
+    if (reg == REGISTERS_COUNT)
+      return false;
+
+    used[reg] = true;
+    physical[order[i]] = (uint16_t)reg;
+    active[active_count++] = order[i];
+  }
+
+  for (size_t i = 0; i < compiler->count; i++) {
+    uint16_t *registers[CALL_MAX_SIZE + 1];
+    const size_t used_count = registersOf(
+        compiler->operands, &compiler->instructions[i], registers);
+    for (size_t j = 0; j < used_count; j++) {
+      *registers[j] = physical[*registers[j]];
+    }
+  }
+  return true;
+}
+
+// Compiles the body of `closure` on `code`, next to the body itself. The
+// closure is left to the tree walker when it can't be compiled.
+static void vmCompile(arena_t *code, environment_t *environment,
+                      closure_t *closure) {
+  const size_t arguments = closure->arguments->count;
+  const size_t fixed = arguments + closure->captures.count;
+  if (fixed > REGISTERS_COUNT)
+    return;
+
+  compiler_t compiler = {.fixed = fixed};
+  compiler.globals = environment;
+  while (compiler.globals->parent) {
+    compiler.globals = compiler.globals->parent;
+  }
+
+  slot_t slots[REGISTERS_COUNT];
+  const slot_t *scope = nullptr;
+  for (size_t i = 0; i < fixed; i++) {
+    uint16_t reg;
+    newRegister(&compiler, &reg);
+    slots[i] = (slot_t){
+        .symbol = i < arguments
+                      ? closure->arguments->data[i].value.symbol
+                      : closure->captures.data[i - arguments].symbol,
+        .reg = reg,
+        .parent = scope,
+    };
+    scope = &slots[i];
+  }
+
+  uint16_t result;
+  size_t index;
+  if (!compileNode(&compiler, closure->form, scope, &result) ||
+      !emit(&compiler,
+            (instruction_t){.opcode = OPCODE_RETURN,
+                            .source = result,
+                            .node = closure->form},
+            &index) ||
+      !allocateRegisters(&compiler))
+    return;
+
+  const auto allocated = arenaAllocate(code, sizeof(program_t));
+  const auto instructions =
+      arenaAllocate(code, compiler.count * sizeof(instruction_t));
+  const auto operands =
+      arenaAllocate(code, (compiler.operands_count + 1) * sizeof(uint16_t));
+  if (allocated.code != RESULT_OK || instructions.code != RESULT_OK ||
+      operands.code != RESULT_OK)
+    return;
+
+  program_t *program = allocated.value;
+  program->count = compiler.count;
+  program->instructions = instructions.value;
+  program->operands = operands.value;
+  memcpy(program->instructions, compiler.instructions,
+         compiler.count * sizeof(instruction_t));
+  memcpy(program->operands, compiler.operands,
+         compiler.operands_count * sizeof(uint16_t));
+  closure->program = program;
+}
+
+static result_value_ref_t vmRun(arena_t *arena, const closure_t *closure,
+                                value_t registers[static REGISTERS_COUNT],
+                                environment_t *globals, value_t *result);
+
+// Whether the closure runs on the machine, rather than on the tree walker
+static bool vmRunnable(const closure_t *closure) {
+  return closure->program && vm_depth < VM_MAX_DEPTH;
+}
+
+// Calls the value in the first operand register with the others. Closures
+// with a program get their arguments straight into their registers.
+static result_value_ref_t vmCall(arena_t *arena, environment_t *globals,
+                                 value_t *registers, const uint16_t *operands,
+                                 size_t count, const node_t *node,
+                                 value_t *result) {
+  const value_t *callee = &registers[operands[0]];
+  if (callee->type == VALUE_TYPE_CLOSURE &&
+      vmRunnable(&callee->value.closure)) {
+    const closure_t *closure = &callee->value.closure;
+    if (count - 1 != closure->arguments->count) {
+      throw(result_value_ref_t, ERROR_CODE_TYPE_UNEXPECTED_ARITY,
+            callee->position,
+            "Unexpected arity. Expected %zu arguments, got %zu.",
+            closure->arguments->count, count - 1);
+    }
+
+    value_t frame[REGISTERS_COUNT];
+    for (size_t i = 1; i < count; i++) {
+      frame[i - 1] = registers[operands[i]];
+    }
+    return vmRun(arena, closure, frame, globals, result);
+  }
+
+  const size_t start = arena->offset;
+  value_t *call = nullptr;
+  tryWithMeta(result_value_ref_t, valueCreate(arena, VALUE_TYPE_LIST),
+              node->position, call);
+  call->position = node->position;
+  for (size_t i = 0; i < count; i++) {
+    tryWithMeta(result_value_ref_t,
+                listAppend(value_t, &call->value.list, &registers[operands[i]]),
+                node->position);
+  }
+
+  value_t *reduced = nullptr;
+  try(result_value_ref_t, invokeValues(call, arena, globals), reduced);
+  *result = *reduced;
+
+  // Scalars don't reference the memory of the call
+  if (result->type != VALUE_TYPE_LIST && result->type != VALUE_TYPE_CLOSURE)
+    arenaRewind(arena, start);
+  return ok(result_value_ref_t, result);
+}
+
+static result_value_ref_t vmExecute(arena_t *arena, const closure_t *closure,
+                                    value_t registers[static REGISTERS_COUNT],
+                                    environment_t *globals, value_t *result) {
+  const program_t *program = closure->program;
+  const size_t frame = arena->offset;
+
+  const size_t arguments = closure->arguments->count;
+  for (size_t i = 0; i < closure->captures.count; i++) {
+    registers[arguments + i] = closure->captures.data[i].value;
+  }
+
+  size_t counter = 0;
+  while (true) {
+    const instruction_t *instruction = &program->instructions[counter];
+    const uint16_t *operands = &program->operands[instruction->operands];
+    node_t *node = instruction->node;
+    value_t *target = &registers[instruction->target];
+
+    switch (instruction->opcode) {
+    case OPCODE_INTEGER:
+      target->type = VALUE_TYPE_INTEGER;
+      target->value.integer = instruction->immediate.integer;
+      target->position = node->position;
+      break;
+    case OPCODE_BOOLEAN:
+      target->type = VALUE_TYPE_BOOLEAN;
+      target->value.boolean = instruction->immediate.boolean;
+      target->position = node->position;
+      break;
+    case OPCODE_NIL:
+      target->type = VALUE_TYPE_NIL;
+      target->value.nil = nullptr;
+      target->position = node->position;
+      break;
+    case OPCODE_GLOBAL: {
+      const value_t *value = resolveQuickened(node, globals);
+      if (!value) {
+        throw(result_value_ref_t, ERROR_CODE_REFERENCE_SYMBOL_NOT_FOUND,
+              node->position,
+              "Symbol '%s' cannot be found in the current environment",
+              node->value.symbol);
+      }
+      *target = *value;
+      target->position = node->position;
+      break;
+    }
+    case OPCODE_MOVE:
+      *target = registers[instruction->source];
+      break;
+    case OPCODE_BINARY: {
+      const value_t *head = &registers[operands[0]];
+      const value_t *left = &registers[operands[1]];
+      const value_t *right = &registers[operands[2]];
+      if (head->type == VALUE_TYPE_BUILTIN &&
+          head->value.builtin == binaryIntegerBuiltin(instruction->quick) &&
+          left->type == VALUE_TYPE_INTEGER &&
+          right->type == VALUE_TYPE_INTEGER) {
+        computeBinaryInteger(instruction->quick, left->value.integer,
+                             right->value.integer, target);
+        target->position = node->position;
+        break;
+      }
+      try(result_value_ref_t, vmCall(arena, globals, registers, operands,
+                                     instruction->count, node, target));
+      break;
+    }
+    case OPCODE_CALL:
+      try(result_value_ref_t, vmCall(arena, globals, registers, operands,
+                                     instruction->count, node, target));
+      break;
+    case OPCODE_BRANCH: {
+      const value_t *test = &registers[instruction->source];
+      if (test->type != VALUE_TYPE_BOOLEAN) {
+        throw(result_value_ref_t, ERROR_CODE_RUNTIME_ERROR, node->position,
+              "Conditions should resolve to a boolean. %s", LET_EXAMPLE);
+      }
+      if (!test->value.boolean) {
+        counter = instruction->immediate.jump;
+        continue;
+      }
+      break;
+    }
+    case OPCODE_JUMP:
+      counter = instruction->immediate.jump;
+      continue;
+    case OPCODE_RETURN:
+      *result = registers[instruction->source];
+      if (result->type != VALUE_TYPE_LIST &&
+          result->type != VALUE_TYPE_CLOSURE)
+        arenaRewind(arena, frame);
+      return ok(result_value_ref_t, result);
+    default:
+      unreachable();
+    }
+    counter++;
+  }
+}
+
+static result_value_ref_t vmRun(arena_t *arena, const closure_t *closure,
+                                value_t registers[static REGISTERS_COUNT],
+                                environment_t *globals, value_t *result) {
+  vm_depth++;
+  const auto run = vmExecute(arena, closure, registers, globals, result);
+  vm_depth--;
+  return run;
+}
+
+// Runs a closure called by the tree walker, with the values of the call
+static result_value_ref_t vmInvoke(arena_t *arena, const closure_t *closure,
+                                   const value_t *call,
+                                   environment_t *globals) {
+  value_t registers[REGISTERS_COUNT];
+  for (size_t i = 1; i < call->value.list.count; i++) {
+    registers[i - 1] = call->value.list.data[i];
+  }
+
+  value_t reduced;
+  try(result_value_ref_t,
+      vmRun(arena, closure, registers, globals, &reduced));
+
+  value_t *result = nullptr;
+  tryWithMeta(result_value_ref_t, valueCreate(arena, reduced.type),
+              reduced.position, result);
+  *result = reduced;
+  return ok(result_value_ref_t, result);
+}
+
+#endif
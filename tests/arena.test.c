@@ -20,7 +20,25 @@ void basic() {
   
   result_ref_t reallocation = arenaAllocate(arena, 1024);
   expectTrue(reallocation.code == 0, "can reallocate memory after a reset");
-  
+
+  case("rewind");
+  arenaReset(arena);
+  arenaAllocate(arena, 100);
+  const size_t offset = arena->offset;
+  result_ref_t first = arenaAllocate(arena, 200);
+  arenaRewind(arena, offset);
+  expectEqlSize(arena->offset, offset, "rewinds to the offset");
+
+  result_ref_t second = arenaAllocate(arena, 200);
+  expectTrue(second.value == first.value, "reuses rewound memory");
+
+  case("ownership");
+  int outside = 0;
+  expectTrue(arenaOwns(arena, second.value), "owns allocated memory");
+  expectFalse(arenaOwns(arena, &outside), "does not own other memory");
+  arenaRewind(arena, offset);
+  expectFalse(arenaOwns(arena, second.value), "does not own released memory");
+
   arenaDestroy(&arena);
 }
 
@@ -52,9 +70,36 @@ void alignment() {
   arenaDestroy(&arena);
 }
 
+void growth() {
+  result_ref_t creation = arenaCreateGrowable(100);
+  expectTrue(creation.code == 0, "succeeds arena creation");
+
+  arena_t *arena = creation.value;
+  result_ref_t first = arenaAllocate(arena, 64);
+  const size_t offset = arenaOffset(arena);
+  result_ref_t second = arenaAllocate(arena, 64);
+  expectTrue(second.code == 0, "grows instead of failing");
+  expectNotNull(arena->next, "allocates on a new chunk");
+  expectTrue(arenaOwns(arena, first.value), "owns the first chunk");
+  expectTrue(arenaOwns(arena, second.value), "owns the new chunk");
+
+  result_ref_t large = arenaAllocate(arena, 1000);
+  expectTrue(large.code == 0, "grows past oversized allocations");
+  expectTrue(arenaOwns(arena, large.value), "owns oversized allocations");
+
+  case("rewind");
+  arenaRewind(arena, offset);
+  expectEqlSize(arenaOffset(arena), offset, "rewinds to the offset");
+  expectNull(arena->next, "releases the chunks grown since");
+  expectFalse(arenaOwns(arena, second.value), "does not own released chunks");
+
+  arenaDestroy(&arena);
+}
+
 int main() {
   suite(basic);
   suite(overflow);
   suite(alignment);
+  suite(growth);
   return report();
 }
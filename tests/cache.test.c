@@ -0,0 +1,214 @@
+// This is for the CI compiler
+#define _POSIX_C_SOURCE 200809L
+
+#include "../lifp/cache.h"
+#include "../lifp/parse.h"
+
+#include "test.h"
+#include "utils.h"
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static arena_t *test_arena;
+static char path[CACHE_PATH_SIZE];
+
+static bool eqlNode(const node_t *self, const node_t *other) {
+  if (self->type != other->type ||
+      self->position.line != other->position.line ||
+      self->position.column != other->position.column) {
+    return false;
+  }
+
+  switch (self->type) {
+  case NODE_TYPE_NIL:
+    return true;
+  case NODE_TYPE_BOOLEAN:
+    return self->value.boolean == other->value.boolean;
+  case NODE_TYPE_INTEGER:
+    return self->value.integer == other->value.integer;
+  case NODE_TYPE_SYMBOL:
+    return strncmp(self->value.symbol, other->value.symbol, SYMBOL_SIZE) == 0;
+  case NODE_TYPE_LIST: {
+    if (self->value.list.count != other->value.list.count) {
+      return false;
+    }
+
+    for (size_t i = 0; i < self->value.list.count; i++) {
+      if (!eqlNode(&self->value.list.data[i], &other->value.list.data[i])) {
+        return false;
+      }
+    }
+    return true;
+  }
+  default:
+    return false;
+  }
+}
+
+// Writes the cache of `source` to `path`
+static void store(const char *source) {
+  const size_t size = strlen(source);
+  lexer_t lexer;
+  lexerInit(&lexer, size, source);
+
+  cache_writer_t *writer = nullptr;
+  tryAssertAssign(cacheWriterCreate(path, cacheHash(size, source), size),
+                  writer);
+
+  node_t *form = nullptr;
+  tryAssertAssign(parseNext(test_arena, &lexer), form);
+  while (form) {
+    tryAssert(cacheWrite(writer, form));
+    tryAssertAssign(parseNext(test_arena, &lexer), form);
+  }
+  tryAssert(cacheCommit(&writer));
+}
+
+void roundTrip(void) {
+  const char *source = "(def! f (fn (a) (+ a -1)))\n"
+                       "(f 2) true false nil ()\n"
+                       "(list.from (1 2) (1 2))";
+  const size_t size = strlen(source);
+  store(source);
+
+  cache_t *cache = cacheLoad(path, cacheHash(size, source), size);
+  expectNotNull(cache, "loads the cache");
+  if (!cache)
+    return;
+
+  // Forms read back share their lists with the same forms parsed before
+  intern_t *intern = nullptr;
+  tryAssertAssign(internCreate(16), intern);
+
+  lexer_t lexer;
+  lexerInit(&lexer, size, source);
+  bool equal = true;
+  bool shared = true;
+  size_t count = 0;
+  node_t *expected = nullptr;
+  node_t *actual = nullptr;
+  do {
+    tryAssertAssign(parseNextInterned(test_arena, &lexer, intern), expected);
+    tryAssertAssign(cacheNext(cache, test_arena, intern), actual);
+    if (expected && actual) {
+      equal = equal && eqlNode(expected, actual);
+      shared = shared && (expected->type != NODE_TYPE_LIST ||
+                          expected->value.list.data == actual->value.list.data);
+      count++;
+    }
+  } while (expected && actual);
+
+  expectTrue(equal, "reads the forms back");
+  expectEqlSize(count, 7, "reads all the forms");
+  expectNull(actual, "ends with the source");
+  expectTrue(shared, "interns lists");
+
+  internDestroy(&intern);
+  cacheClose(&cache);
+}
+
+void staleness(void) {
+  const char *source = "(+ 1 2)";
+  const size_t size = strlen(source);
+  store(source);
+
+  const char *edited = "(+ 1 3)";
+  expectNull(cacheLoad(path, cacheHash(size, edited), size),
+             "misses edited sources");
+  expectNull(cacheLoad(path, cacheHash(size, source), size + 1),
+             "misses resized sources");
+  expectNull(cacheLoad("/tmp/lifp-missing.lifpc", cacheHash(size, source),
+                       size),
+             "misses missing files");
+
+  // Dropping the last record leaves a list short of elements
+  expectEqlInt(truncate(path, 32 + 32 * 3), 0, "truncates the cache");
+  expectNull(cacheLoad(path, cacheHash(size, source), size),
+             "misses corrupt files");
+}
+
+void formats(void) {
+  const char *source = "(+ 1 2)";
+  const size_t size = strlen(source);
+  store(source);
+
+  // The hash of the format follows the magic
+  FILE *file = fopen(path, "r+b");
+  fseek(file, 8, SEEK_SET);
+  const int byte = fgetc(file);
+  fseek(file, 8, SEEK_SET);
+  fputc(byte ^ 1, file);
+  fclose(file);
+  expectNull(cacheLoad(path, cacheHash(size, source), size),
+             "misses caches of other formats");
+}
+
+void keys(void) {
+  FILE *file = fopen(path, "w");
+  fputs("(+ 1 2)", file);
+  fclose(file);
+  struct stat before;
+  stat(path, &before);
+  expectTrue(cacheKey(&before) == cacheKey(&before), "is stable");
+  expectFalse(cacheSettled(&before), "distrusts fresh files");
+
+  file = fopen(path, "a");
+  fputs(" (+ 1 3)", file);
+  fclose(file);
+  struct stat after;
+  stat(path, &after);
+  expectTrue(cacheKey(&before) != cacheKey(&after), "changes on edits");
+
+  after.st_mtim.tv_sec -= 2 * CACHE_SETTLE_SECONDS;
+  after.st_ctim.tv_sec -= 2 * CACHE_SETTLE_SECONDS;
+  expectTrue(cacheSettled(&after), "trusts settled files");
+}
+
+void paths(void) {
+  char result[CACHE_PATH_SIZE];
+  cachePath(result, 0xff, "/tmp");
+  expectEqlString(result, "/tmp/00000000000000ff.lifpc", CACHE_PATH_SIZE,
+                  "goes in the directory");
+
+  char directory[CACHE_PATH_SIZE];
+  char expected[CACHE_PATH_SIZE];
+  snprintf(expected, sizeof(expected), "/tmp/lifp-cache-home-%d", getpid());
+  setenv("XDG_CACHE_HOME", expected, 1);
+  unsetenv("LIFP_CACHE_DIR");
+  mkdir(expected, 0755);
+  expectTrue(cacheDirectory(directory), "defaults to the cache home");
+  strcat(expected, "/lifp");
+  expectEqlString(directory, expected, CACHE_PATH_SIZE,
+                  "goes in the cache home");
+  expectEqlInt(access(directory, W_OK), 0, "creates the directory");
+  rmdir(expected);
+  expected[strlen(expected) - strlen("/lifp")] = 0;
+  rmdir(expected);
+
+  setenv("LIFP_CACHE_DIR", "/tmp", 1);
+  expectTrue(cacheDirectory(directory), "takes the configured directory");
+  expectEqlString(directory, "/tmp", CACHE_PATH_SIZE,
+                  "goes in the configured directory");
+
+  setenv("LIFP_CACHE_DIR", "", 1);
+  expectFalse(cacheDirectory(directory), "turns off when empty");
+}
+
+int main(void) {
+  tryAssertAssign(arenaCreate((size_t)(1024 * 64)), test_arena);
+  snprintf(path, sizeof(path), "/tmp/lifp-cache-%d.lifpc", getpid());
+
+  suite(roundTrip);
+  suite(staleness);
+  suite(formats);
+  suite(keys);
+  suite(paths);
+
+  remove(path);
+  arenaDestroy(&test_arena);
+  return report();
+}
@@ -0,0 +1,119 @@
+// This is for the CI compiler
+#define _POSIX_C_SOURCE 200809L
+
+#include "../lib/arena.h"
+#include "../lifp/evaluate.h"
+#include "../lifp/parse.h"
+#include "../lifp/tokenize.h"
+#include "utils.h"
+
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+// Evaluator benchmark
+// ---
+//
+// Evaluates the programs of the evaluator tests over and over, and reports the
+// time taken by each evaluation. `make bench` runs it against both the switch
+// and the threaded dispatch (see evaluate.c).
+//
+// ```sh
+// make bench
+// ```
+
+constexpr int ITERATIONS = 5;
+constexpr int EVALUATIONS = 200;
+
+typedef struct {
+  const char *name;
+  // Evaluated once, before measuring
+  const char *setup;
+  const char *form;
+} bench_case_t;
+
+static arena_t *ast_arena;
+static arena_t *temp_arena;
+
+static double now(void) {
+  struct timespec time;
+  clock_gettime(CLOCK_MONOTONIC, &time);
+  return (double)time.tv_sec + ((double)time.tv_nsec / 1e9);
+}
+
+static node_t *prepare(const char *source, environment_t *environment) {
+  lexer_t lexer;
+  lexerInit(&lexer, strlen(source), source);
+
+  node_t *syntax_tree = nullptr;
+  tryAssertAssign(parse(ast_arena, &lexer), syntax_tree);
+  tryAssert(optimize(ast_arena, syntax_tree, environment));
+  escapeAnalyze(syntax_tree);
+  return syntax_tree;
+}
+
+static void run(const bench_case_t *bench_case) {
+  environment_t *environment = nullptr;
+  tryAssertAssign(environmentCreate(nullptr), environment);
+
+  if (bench_case->setup) {
+    node_t *setup = prepare(bench_case->setup, environment);
+    tryAssert(evaluate(temp_arena, setup, environment));
+    arenaReset(temp_arena);
+  }
+  node_t *form = prepare(bench_case->form, environment);
+
+  double best = 0;
+  for (int i = 0; i < ITERATIONS; i++) {
+    const double start = now();
+    for (int j = 0; j < EVALUATIONS; j++) {
+      tryAssert(evaluate(temp_arena, form, environment));
+      arenaReset(temp_arena);
+    }
+    const double elapsed = now() - start;
+
+    if (best == 0 || elapsed < best)
+      best = elapsed;
+  }
+
+  printf("  %-12s %10.2f us/evaluation\n", bench_case->name,
+         best / EVALUATIONS * 1e6);
+  environmentDestroy(&environment);
+  arenaReset(ast_arena);
+}
+
+int main(void) {
+  tryAssertAssign(arenaCreate((size_t)(1024 * 1024)), ast_arena);
+  tryAssertAssign(arenaCreate((size_t)(1024 * 1024)), temp_arena);
+
+  const bench_case_t cases[] = {
+      {"fibonacci",
+       "(def! fibonacci (fn (a) (cond ((< a 1) 0) ((= a 1) 1) ((= a 2) 2) "
+       "(let ((last (fibonacci (- a 1))) (current (fibonacci (- a 2)))) "
+       "(+ last current)))))",
+       "(fibonacci 15)"},
+      {"closures",
+       "(def! counter (fn (n) (cond ((= n 0) 0) "
+       "(+ ((fn (x) (* x 2)) n) (counter (- n 1))))))",
+       "(counter 60)"},
+      {"let",
+       "(def! nested (fn (n) (cond ((< n 1) n) "
+       "(let ((a (+ n 1)) (b (- a n))) (nested (- n b))))))",
+       "(nested 60)"},
+      {"lists",
+       "(def! sizes (fn (n) (cond ((= n 0) 0) "
+       "(+ (list.count (list.from n n n)) (sizes (- n 1))))))",
+       "(sizes 60)"},
+  };
+
+  printf("Evaluation time (best of %d, %d evaluations each)\n", ITERATIONS,
+         EVALUATIONS);
+  for (size_t i = 0; i < arraySize(cases); i++) {
+    run(&cases[i]);
+  }
+
+  arenaDestroy(&temp_arena);
+  arenaDestroy(&ast_arena);
+  return 0;
+}
@@ -248,8 +248,8 @@ void fnSpecialForm() {
   value_t *closure;
   tryAssertAssign(evaluate(test_arena, &fn_node, environment), closure);
   expectEqlUint(closure->type, VALUE_TYPE_CLOSURE, "creates closure");
-  expectEqlSize(closure->value.closure.arguments.count, 2, "with correct argument count");
-  expectEqlUint(closure->value.closure.form.type, NODE_TYPE_LIST, "with correct form type");
+  expectEqlSize(closure->value.closure.arguments->count, 2, "with correct argument count");
+  expectEqlUint(closure->value.closure.form->type, NODE_TYPE_LIST, "with correct form type");
  
   case("not using symbols for arguments");
   node_list_t *fn_no_symbol = nullptr;
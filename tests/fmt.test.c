@@ -58,12 +58,15 @@ void values() {
   symbol->value.symbol[0] = 'a';
   symbol->value.symbol[1] = 0;
 
-  tryAssert(listAppend(node_t, &closure->value.closure.arguments, symbol));
-
-  closure->value.closure.form.type = NODE_TYPE_LIST;
-
-  tryAssert(
-      listAppend(node_t, &closure->value.closure.form.value.list, symbol));
+  node_t *arguments = nullptr;
+  tryAssertAssign(nodeCreate(test_arena, NODE_TYPE_LIST), arguments);
+  tryAssert(listAppend(node_t, &arguments->value.list, symbol));
+  closure->value.closure.arguments = &arguments->value.list;
+
+  node_t *form = nullptr;
+  tryAssertAssign(nodeCreate(test_arena, NODE_TYPE_LIST), form);
+  tryAssert(listAppend(node_t, &form->value.list, symbol));
+  closure->value.closure.form = form;
 
   formatValue(list, size, buffer, &offset);
   expectEqlString(buffer, "(fn (a) (a))", 10, "formats lambdas");
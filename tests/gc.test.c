@@ -0,0 +1,188 @@
+#include "test.h"
+#include "utils.h"
+
+#include "../lib/arena.h"
+#include "../lifp/evaluate.h"
+#include "../lifp/gc.h"
+#include "../lifp/parse.h"
+#include "../lifp/tokenize.h"
+#include <assert.h>
+#include <stddef.h>
+#include <stdio.h>
+
+static arena_t *test_ast_arena;
+static arena_t *test_temp_arena;
+
+static value_t execute(environment_t *environment, const char *input) {
+  return evaluateLines(test_ast_arena, test_temp_arena, environment, input);
+}
+
+void bindings(void) {
+  environment_t *environment = nullptr;
+  tryAssertAssign(environmentCreate(nullptr), environment);
+
+  execute(environment, "(def! a 42)\n"
+                       "(def! l (list.from 1 (list.from 2 3)))\n"
+                       "(def! f (fn (x) (+ (* x 2) (list.nth 0 l))))\n"
+                       "(def! g f)");
+
+  const value_t *f = mapGet(value_t, environment->values, "f");
+  const value_t *g = mapGet(value_t, environment->values, "g");
+  const node_t *body = f->value.closure.form;
+  expectTrue(arenaOwns(environment->code, body), "promotes closure bodies");
+  expectTrue(g->value.closure.form == body, "shares closure bodies");
+
+  execute(environment, "(def! adder (fn (a) (fn (b) (+ a b))))");
+  const value_t *adder = mapGet(value_t, environment->values, "adder");
+  const node_t *inner = adder->value.closure.form;
+  expectTrue(arenaOwns(environment->code, inner->value.function.free),
+             "promotes the free variables of nested forms");
+
+  gc_t gc;
+  gcInit(&gc, 0, 2.0);
+  const arena_t *from_space = environment->arena;
+  tryAssert(gcCollect(&gc, &environment));
+  expectTrue(environment->arena != from_space, "moves the environment");
+  f = mapGet(value_t, environment->values, "f");
+  expectTrue(f->value.closure.form == body, "does not move closure bodies");
+
+  value_t result = execute(environment, "a");
+  expectEqlInt(result.value.integer, 42, "keeps scalars");
+
+  result = execute(environment, "(list.count (list.nth 1 l))");
+  expectEqlInt(result.value.integer, 2, "keeps nested lists");
+
+  result = execute(environment, "(f 20)");
+  expectEqlInt(result.value.integer, 41, "keeps closures");
+
+  result = execute(environment, "(+ 1 2)");
+  expectEqlInt(result.value.integer, 3, "keeps builtins");
+
+  environmentDestroy(&environment);
+}
+
+void reclaim(void) {
+  environment_t *environment = nullptr;
+  tryAssertAssign(environmentCreate(nullptr), environment);
+
+  for (int i = 0; i < 5; i++) {
+    execute(environment, "(def! l (list.from 1 2 3 4 5 6 7 8 9))");
+  }
+  const size_t used = environment->arena->offset;
+
+  gc_t gc;
+  gcInit(&gc, 0, 2.0);
+  tryAssert(gcCollect(&gc, &environment));
+
+  expectTrue(environment->arena->offset < used, "reclaims redefinitions");
+  expectEqlSize(gc.reclaimed, used - environment->arena->offset,
+                "tracks reclaimed memory");
+  expectEqlSize(gc.collections, 1, "tracks collections");
+  expectTrue(gc.max_pause > 0 && gc.total_pause == gc.max_pause,
+             "tracks pauses");
+
+  value_t result = execute(environment, "(list.count l)");
+  expectEqlInt(result.value.integer, 9, "keeps the last definition");
+
+  environmentDestroy(&environment);
+}
+
+void thresholds(void) {
+  environment_t *environment = nullptr;
+  tryAssertAssign(environmentCreate(nullptr), environment);
+
+  gc_t gc;
+  gcInit(&gc, environment->arena->size, 2.0);
+  tryAssert(gcMaybeCollect(&gc, &environment));
+  expectEqlSize(gc.collections, 0, "does not collect below threshold");
+
+  gcInit(&gc, 0, 2.0);
+  tryAssert(gcMaybeCollect(&gc, &environment));
+  expectEqlSize(gc.collections, 1, "collects above threshold");
+  expectEqlSize(gc.threshold, environment->arena->offset * 2,
+                "moves threshold with live data");
+
+  case("heap growth");
+  const size_t size = environment->arena->size;
+  gcInit(&gc, 0, 32.0);
+  tryAssert(gcCollect(&gc, &environment));
+  expectTrue(environment->arena->size > size, "grows the heap");
+  expectTrue((double)environment->arena->offset * 32.0 <=
+                 (double)environment->arena->size,
+             "leaves requested headroom");
+
+  value_t result = execute(environment, "(+ 1 2)");
+  expectEqlInt(result.value.integer, 3, "keeps working");
+
+  environmentDestroy(&environment);
+}
+
+void copies(void) {
+  environment_t *environment = nullptr;
+  tryAssertAssign(environmentCreate(nullptr), environment);
+  execute(environment, "(def! a 1)\n(def! f (fn (x) (+ x a)))");
+
+  environment_t *copy = nullptr;
+  tryAssertAssign(gcCopy(environment), copy);
+  expectTrue(copy->code == environment->code, "shares the code region");
+
+  execute(copy, "(def! a 2)\n(def! g (fn (x) x))");
+  expectEqlInt(execute(copy, "(f 1)").value.integer, 3, "binds in the copy");
+  gcRelease(&copy);
+
+  expectEqlInt(execute(environment, "(f 1)").value.integer, 2,
+               "leaves the source alone");
+  expectNull(mapGet(value_t, environment->values, "g"),
+             "does not leak bindings");
+  expectTrue(environment->code->offset > 0, "keeps the code region");
+
+  environmentDestroy(&environment);
+}
+
+// Closure bodies are never collected: the code region grows to fit them
+void definitions(void) {
+  environment_t *environment = nullptr;
+  tryAssertAssign(environmentCreate(nullptr), environment);
+  gc_t gc;
+  gcInit(&gc, 1024, 2.0);
+
+  char form[128];
+  for (int i = 0; i < 200; i++) {
+    snprintf(form, sizeof(form),
+             "(def! f%d (fn (a b) (cond ((> a b) (- a %d)) (+ b %d))))", i, i,
+             i);
+    execute(environment, form);
+    tryAssert(gcMaybeCollect(&gc, &environment));
+  }
+  expectEqlInt(execute(environment, "(f199 1 2)").value.integer, 201,
+               "defines many functions");
+  expectEqlInt(execute(environment, "(f0 3 2)").value.integer, 3,
+               "keeps the first ones");
+
+  for (int i = 0; i < 200; i++) {
+    snprintf(form, sizeof(form),
+             "(def! g (fn (a b) (cond ((> a b) (- a %d)) (+ b %d))))", i, i);
+    execute(environment, form);
+    tryAssert(gcMaybeCollect(&gc, &environment));
+  }
+  expectEqlInt(execute(environment, "(g 1 2)").value.integer, 201,
+               "redefines functions many times");
+  expectTrue(environment->code->next != nullptr, "grows the code region");
+
+  environmentDestroy(&environment);
+}
+
+int main(void) {
+  tryAssertAssign(arenaCreate((size_t)(1024 * 64)), test_ast_arena);
+  tryAssertAssign(arenaCreate((size_t)(1024 * 64)), test_temp_arena);
+
+  suite(bindings);
+  suite(reclaim);
+  suite(thresholds);
+  suite(copies);
+  suite(definitions);
+
+  arenaDestroy(&test_ast_arena);
+  arenaDestroy(&test_temp_arena);
+  return report();
+}
@@ -0,0 +1,100 @@
+// This is for the CI compiler
+#define _POSIX_C_SOURCE 200809L
+
+#include "test.h"
+#include "utils.h"
+
+#include "../lib/arena.h"
+#include "../lifp/evaluate.h"
+#include "../lifp/gc.h"
+#include "../lifp/image.h"
+#include "../lifp/parse.h"
+#include "../lifp/tokenize.h"
+#include <stddef.h>
+#include <stdio.h>
+#include <unistd.h>
+
+static arena_t *test_ast_arena;
+static arena_t *test_temp_arena;
+static char path[64];
+
+static value_t execute(environment_t *environment, const char *input) {
+  return evaluateLines(test_ast_arena, test_temp_arena, environment, input);
+}
+
+void roundTrip(void) {
+  environment_t *source = nullptr;
+  tryAssertAssign(environmentCreate(nullptr), source);
+  execute(source, "(def! a 42)\n"
+                  "(def! l (list.from true nil (list.from 2 3)))\n"
+                  "(def! make (fn (n) (fn (x) (+ x n))))\n"
+                  "(def! add5 (make 5))\n"
+                  "(def! fib (fn (n) (cond ((< n 2) n) "
+                  "(+ (fib (- n 1)) (fib (- n 2))))))\n"
+                  "(def! plus +)\n"
+                  "(fib 10)");
+  tryAssert(imageDump(source, path));
+  environmentDestroy(&source);
+
+  environment_t *environment = nullptr;
+  tryAssertAssign(environmentCreate(nullptr), environment);
+  gc_t gc;
+  gcInit(&gc, 0, 2.0);
+  tryAssert(imageLoad(path, &gc, &environment));
+
+  expectEqlInt(execute(environment, "a").value.integer, 42,
+               "restores integers");
+  expectEqlInt(execute(environment, "(list.count l)").value.integer, 3,
+               "restores lists");
+  expectEqlInt(execute(environment, "(list.nth 2 l)").value.list.count, 2,
+               "restores nested lists");
+  expectEqlInt(execute(environment, "(add5 1)").value.integer, 6,
+               "restores captures");
+  expectEqlInt(execute(environment, "(fib 15)").value.integer, 610,
+               "restores recursive closures");
+  expectEqlInt(execute(environment, "(plus 1 2)").value.integer, 3,
+               "restores builtins");
+  expectTrue(gc.collections > 0, "collects while loading");
+
+  environmentDestroy(&environment);
+}
+
+void errors(void) {
+  environment_t *environment = nullptr;
+  tryAssertAssign(environmentCreate(nullptr), environment);
+  gc_t gc;
+  gcInit(&gc, 0, 2.0);
+
+  const auto missing = imageLoad("/tmp/lifp-missing.image", &gc, &environment);
+  expectEqlInt((int)missing.code, IMAGE_ERROR_IO, "fails on missing files");
+
+  FILE *file = fopen(path, "wb");
+  fputs("(def! a 1)", file);
+  fclose(file);
+  const auto invalid = imageLoad(path, &gc, &environment);
+  expectEqlInt((int)invalid.code, IMAGE_ERROR_INVALID,
+               "fails on other files");
+
+  execute(environment, "(def! a (list.from 1 2))");
+  tryAssert(imageDump(environment, path));
+  // Records go missing from the end
+  expectEqlInt(truncate(path, 32 + (64 * 3)), 0, "truncates the image");
+  const auto corrupt = imageLoad(path, &gc, &environment);
+  expectEqlInt((int)corrupt.code, IMAGE_ERROR_INVALID, "fails on corruption");
+
+  environmentDestroy(&environment);
+}
+
+int main(void) {
+  tryAssertAssign(arenaCreate((size_t)(1024 * 64)), test_ast_arena);
+  tryAssertAssign(arenaCreate((size_t)(1024 * 64)), test_temp_arena);
+  snprintf(path, sizeof(path), "/tmp/lifp-image-%d.image", getpid());
+
+  suite(roundTrip);
+  suite(errors);
+
+  remove(path);
+  arenaDestroy(&test_ast_arena);
+  arenaDestroy(&test_temp_arena);
+  return report();
+}
@@ -2,7 +2,9 @@
 #include "utils.h"
 
 #include "../lib/arena.h"
+#include "../lifp/error.h"
 #include "../lifp/evaluate.h"
+#include "../lifp/intern.h"
 #include "../lifp/parse.h"
 #include "../lifp/tokenize.h"
 #include <assert.h>
@@ -22,14 +24,13 @@ result_value_ref_t execute(const char *input) {
   tryAssertAssign(environmentCreate(nullptr), env);
 
   while (line != NULL) {
-    token_list_t *tokens = nullptr;
-    tryAssertAssign(tokenize(test_ast_arena, line), tokens);
+    lexer_t lexer;
+    lexerInit(&lexer, strlen(line), line);
 
-    size_t offset = 0;
-    size_t depth = 0;
     node_t *syntax_tree = nullptr;
-    tryAssertAssign(parse(test_ast_arena, tokens, &offset, &depth),
-                    syntax_tree);
+    tryAssertAssign(parse(test_ast_arena, &lexer), syntax_tree);
+    tryAssert(optimize(test_ast_arena, syntax_tree, env));
+    escapeAnalyze(syntax_tree);
 
     result_value_ref_t reduction = evaluate(test_temp_arena, syntax_tree, env);
     assert(reduction.code == RESULT_OK);
@@ -44,6 +45,38 @@ result_value_ref_t execute(const char *input) {
   return last_result;
 }
 
+// Arena memory taken by the evaluation of a single form
+static size_t usedMemory(const char *input, environment_t *env) {
+  lexer_t lexer;
+  lexerInit(&lexer, strlen(input), input);
+
+  node_t *syntax_tree = nullptr;
+  tryAssertAssign(parse(test_ast_arena, &lexer), syntax_tree);
+  escapeAnalyze(syntax_tree);
+
+  arenaReset(test_temp_arena);
+  tryAssert(evaluate(test_temp_arena, syntax_tree, env));
+  const size_t used = test_temp_arena->offset;
+
+  arenaReset(test_temp_arena);
+  arenaReset(test_ast_arena);
+  return used;
+}
+
+// Evaluates a form in `env`, keeping its syntax tree around
+static value_t *evaluateForm(const char *input, environment_t *env) {
+  lexer_t lexer;
+  lexerInit(&lexer, strlen(input), input);
+
+  node_t *syntax_tree = nullptr;
+  tryAssertAssign(parse(test_ast_arena, &lexer), syntax_tree);
+  escapeAnalyze(syntax_tree);
+
+  value_t *value = nullptr;
+  tryAssertAssign(evaluate(test_temp_arena, syntax_tree, env), value);
+  return value;
+}
+
 int main() {
   tryAssertAssign(arenaCreate((size_t)(1024 * 1024)), test_ast_arena);
   tryAssertAssign(arenaCreate((size_t)(1024 * 1024)), test_temp_arena);
@@ -76,6 +109,180 @@ int main() {
   reduction = execute("(def! sum (fn (a b) (+ a b)))\n(sum 1 2)");
   expectEqlInt(reduction.value->value.integer, 3, "returns correct value");
 
+  case("definitions outlive their form");
+  reduction = execute("(def! f (fn (a) (+ (* a 2) (- a 1))))\n"
+                      "(+ (f 5) (+ 0 (+ 0 (+ 0 0))))");
+  expectEqlInt(reduction.value->value.integer, 14, "returns correct value");
+
+  case("closures capture free variables");
+  reduction = execute("(def! add (fn (a) (fn (b) (+ a b))))\n((add 1) 2)");
+  expectEqlInt(reduction.value->value.integer, 3, "returns correct value");
+  reduction = execute("(def! k (let ((n 7)) (fn (x) (+ x n))))\n(k 1)");
+  expectEqlInt(reduction.value->value.integer, 8, "outlive their environment");
+
+  case("recursion reclaims temporaries");
+  // Without reclaiming dead call frames, this takes several times the arena
+  arena_t *small_arena = nullptr;
+  tryAssertAssign(arenaCreate((size_t)(1024 * 64)), small_arena);
+  environment_t *env = nullptr;
+  tryAssertAssign(environmentCreate(nullptr), env);
+
+  const char *lines[] = {
+      "(def! fib (fn (a) (cond ((< a 2) a) (+ (fib (- a 1)) (fib (- a 2))))))",
+      "(fib 7)",
+  };
+  for (size_t i = 0; i < arraySize(lines); i++) {
+    lexer_t lexer;
+    lexerInit(&lexer, strlen(lines[i]), lines[i]);
+    node_t *syntax_tree = nullptr;
+    tryAssertAssign(parse(test_ast_arena, &lexer), syntax_tree);
+    escapeAnalyze(syntax_tree);
+    reduction = evaluate(small_arena, syntax_tree, env);
+  }
+  expectEqlInt(reduction.code, RESULT_OK, "succeeds");
+  expectEqlInt(reduction.value->value.integer, 13, "returns correct value");
+
+  case("escape analysis");
+  const char *definition = "(def! f (fn (x) (cond ((< x 2) x) (f (- x 1)))))";
+  lexer_t lexer;
+  lexerInit(&lexer, strlen(definition), definition);
+  node_t *syntax_tree = nullptr;
+  tryAssertAssign(parse(test_ast_arena, &lexer), syntax_tree);
+  escapeAnalyze(syntax_tree);
+
+  node_t function = syntax_tree->value.list.data[2];
+  node_t body = function.value.list.data[2];
+  node_t clause = body.value.list.data[1];
+  node_t fallback = body.value.list.data[2];
+  expectFalse(syntax_tree->local, "form escapes");
+  expectTrue(function.local, "definitions are local");
+  expectFalse(body.local, "closure bodies escape");
+  expectTrue(clause.value.list.data[0].local, "conditions are local");
+  expectFalse(clause.value.list.data[1].local, "returned branches escape");
+  expectTrue(fallback.value.list.data[1].local, "arguments are local");
+  arenaReset(test_ast_arena);
+
+  case("frame-local values");
+  const size_t flat = usedMemory("(+ 2 4)", env);
+  expectEqlSize(usedMemory("(+ (- 3 1) (* 2 2))", env), flat,
+                "releases nested calls");
+  expectEqlSize(usedMemory("(let ((a (+ 1 1))) (+ a (* 2 2)))", env), flat,
+                "releases bindings");
+  expectEqlSize(usedMemory("(cond ((< 1 (+ 1 1)) (+ 2 4)) 0)", env), flat,
+                "releases conditions");
+
+  case("closures share their body");
+  const char *lambda = "(fn (x) (+ x 1))";
+  lexerInit(&lexer, strlen(lambda), lambda);
+  tryAssertAssign(parse(test_ast_arena, &lexer), syntax_tree);
+  escapeAnalyze(syntax_tree);
+
+  value_t *closure = nullptr;
+  tryAssertAssign(evaluate(test_temp_arena, syntax_tree, env), closure);
+  expectTrue(closure->value.closure.form == &syntax_tree->value.list.data[2],
+             "references the form");
+  expectTrue(closure->value.closure.arguments ==
+                 &syntax_tree->value.list.data[1].value.list,
+             "references the arguments");
+  arenaReset(test_temp_arena);
+  arenaReset(test_ast_arena);
+
+  expectEqlSize(usedMemory("(fn (x) (+ x (* x (- x 1))))", env),
+                usedMemory("(fn (x) x)", env), "does not copy the body");
+
+  case("quickening");
+  evaluateForm("(def! add (fn (a b) (+ a b)))", env);
+  evaluateForm("(add 1 2)", env);
+  const value_t *add = mapGet(value_t, env->values, "add");
+  const node_t *sum = add->value.closure.form;
+  expectEqlInt(sum->quick, NODE_QUICK_ADD_INT_2, "specializes calls");
+  expectEqlInt(sum->value.list.data[0].quick, NODE_QUICK_GLOBAL,
+               "caches globals");
+  expectEqlInt(sum->value.list.data[1].quick, NODE_QUICK_SYMBOL,
+               "does not cache locals");
+  expectEqlInt(evaluateForm("(add 3 4)", env)->value.integer, 7,
+               "returns correct value");
+
+  evaluateForm("(def! same (fn (a b) (= a b)))", env);
+  evaluateForm("(same 1 1)", env);
+  const value_t *same = mapGet(value_t, env->values, "same");
+  const node_t *equal = same->value.closure.form;
+  expectEqlInt(equal->quick, NODE_QUICK_EQ_INT_2, "specializes comparisons");
+  value_t *result = evaluateForm("(same true true)", env);
+  expectTrue(result->value.boolean, "returns correct value");
+  expectEqlInt(equal->quick, NODE_QUICK_CALL, "deoptimizes on types");
+
+  evaluateForm("(def! x 1)", env);
+  evaluateForm("(def! getX (fn () x))", env);
+  expectEqlInt(evaluateForm("(getX)", env)->value.integer, 1, "reads globals");
+  evaluateForm("(def! x 5)", env);
+  expectEqlInt(evaluateForm("(getX)", env)->value.integer, 5,
+               "sees redefinitions");
+
+  reduction = execute("(def! plus (fn (a b) (+ a b)))\n(plus 1 2)\n"
+                      "(def! + (fn (a b) 0))\n(plus 1 2)");
+  expectEqlInt(reduction.value->value.integer, 0, "deoptimizes on bindings");
+
+  reduction = execute("(def! triple (fn () (* 1 3)))\n(triple)\n"
+                      "(def! * (fn (a b) 0))\n(triple)");
+  expectEqlInt(reduction.value->value.integer, 0, "sees rebound builtins");
+
+  intern_t *intern = nullptr;
+  tryAssertAssign(internCreate(16), intern);
+  const char *shared = "(list.from (+ x 1) (let ((x 2)) (+ x 1)))";
+  lexerInit(&lexer, strlen(shared), shared);
+  tryAssertAssign(parseNextInterned(test_ast_arena, &lexer, intern),
+                  syntax_tree);
+  escapeAnalyze(syntax_tree);
+  tryAssertAssign(evaluate(test_temp_arena, syntax_tree, env), result);
+  expectEqlInt(result->value.list.data[0].value.integer, 6, "reads globals");
+  expectEqlInt(result->value.list.data[1].value.integer, 3,
+               "deoptimizes shadowed globals");
+
+  // Only the second occurrence fails, once y is no longer a number
+  internReset(intern);
+  evaluateForm("(def! y 1)", env);
+  const char *failing = "(list.from (+ y 1) (def! y true) (+ y 1))";
+  lexerInit(&lexer, strlen(failing), failing);
+  tryAssertAssign(parseNextInterned(test_ast_arena, &lexer, intern),
+                  syntax_tree);
+  escapeAnalyze(syntax_tree);
+  reduction = evaluate(test_temp_arena, syntax_tree, env);
+  expectEqlInt(reduction.code, ERROR_CODE_RUNTIME_ERROR,
+               "fails on the second occurrence");
+  expectEqlSize(reduction.meta.column, 37, "points at the second occurrence");
+  arenaReset(test_temp_arena);
+  internDestroy(&intern);
+  arenaReset(test_temp_arena);
+  arenaReset(test_ast_arena);
+
+  case("superinstructions");
+  evaluateForm("(def! n 3)", env);
+  const char *branch = "(cond ((< n 1) 0) (- n 1))";
+  lexerInit(&lexer, strlen(branch), branch);
+  tryAssertAssign(parse(test_ast_arena, &lexer), syntax_tree);
+  escapeAnalyze(syntax_tree);
+  tryAssertAssign(evaluate(test_temp_arena, syntax_tree, env), result);
+
+  const size_t start = test_temp_arena->offset;
+  tryAssertAssign(evaluate(test_temp_arena, syntax_tree, env), result);
+  expectEqlInt(result->value.integer, 2, "returns correct value");
+  expectEqlSize(test_temp_arena->offset - start, sizeof(value_t),
+                "only allocates the result");
+
+  evaluateForm("(def! n 0)", env);
+  tryAssertAssign(evaluate(test_temp_arena, syntax_tree, env), result);
+  expectEqlInt(result->value.integer, 0, "sees redefinitions");
+
+  evaluateForm("(def! n (list.from 1))", env);
+  reduction = evaluate(test_temp_arena, syntax_tree, env);
+  expectEqlInt(reduction.code, ERROR_CODE_RUNTIME_ERROR,
+               "falls back on types");
+  arenaReset(test_temp_arena);
+  arenaReset(test_ast_arena);
+
+  environmentDestroy(&env);
+  arenaDestroy(&small_arena);
   arenaDestroy(&test_ast_arena);
   arenaDestroy(&test_temp_arena);
   return report();
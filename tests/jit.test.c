@@ -0,0 +1,170 @@
+#ifdef JIT
+#include "../lib/arena.h"
+#include "../lifp/evaluate.h"
+#include "../lifp/jit.h"
+#include "../lifp/parse.h"
+#include "../lifp/tokenize.h"
+#include "test.h"
+#include "utils.h"
+
+#include <stddef.h>
+#include <unistd.h>
+
+// Without a backend, results are the same but nothing is compiled
+#ifdef JIT_NATIVE
+static constexpr size_t COMPILED = 1;
+#else
+static constexpr size_t COMPILED = 0;
+#endif
+
+static arena_t *test_ast_arena;
+static arena_t *test_temp_arena;
+static environment_t *global;
+
+// Evaluates each line of `input` in the global environment
+result_value_ref_t execute(const char *input) {
+  char input_copy[1024];
+  strcpy(input_copy, input);
+
+  char *line = strtok(input_copy, "\n");
+  result_value_ref_t last_result;
+
+  while (line != NULL) {
+    lexer_t lexer;
+    lexerInit(&lexer, strlen(line), line);
+
+    node_t *syntax_tree = nullptr;
+    tryAssertAssign(parse(test_ast_arena, &lexer), syntax_tree);
+    escapeAnalyze(syntax_tree);
+    last_result = evaluate(test_temp_arena, syntax_tree, global);
+
+    line = strtok(nullptr, "\n");
+    arenaReset(test_ast_arena);
+  }
+
+  return last_result;
+}
+
+// Calls `input` enough times for its closure to be compiled
+static result_value_ref_t warm(const char *input) {
+  for (size_t i = 0; i < 100; i++) {
+    execute(input);
+    arenaReset(test_temp_arena);
+  }
+  return execute(input);
+}
+
+static size_t compiledCount(void) {
+  char path[64];
+  snprintf(path, sizeof(path), "/tmp/perf-%d.map", getpid());
+  FILE *map = fopen(path, "r");
+  if (!map)
+    return 0;
+
+  size_t count = 0;
+  char line[256];
+  while (fgets(line, sizeof(line), map)) {
+    if (strstr(line, "lifp:fn@"))
+      count++;
+  }
+  fclose(map);
+  return count;
+}
+
+void compilation() {
+  const size_t before = compiledCount();
+  result_value_ref_t reduction = execute(
+      "(def! fib (fn (a) (cond ((< a 2) a) (+ (fib (- a 1)) (fib (- a 2))))))\n"
+      "(fib 20)");
+  expectEqlInt(reduction.value->value.integer, 6765, "recurs");
+  expectEqlSize(compiledCount(), before + COMPILED, "lists compiled closures");
+
+  execute("(def! list3 (fn (a) (list.from a a a)))");
+  reduction = warm("(list3 1)");
+  expectEqlSize(reduction.value->value.list.count, 3,
+                "leaves lists to the interpreter");
+  expectEqlSize(compiledCount(), before + COMPILED, "does not compile lists");
+}
+
+void execution() {
+  execute("(def! less (fn (a b) (< a b)))");
+  result_value_ref_t reduction = warm("(less 1 2)");
+  expectTrue(reduction.value->value.boolean, "returns booleans");
+
+  execute("(def! f (fn (a) (let ((b (* a 2)) (c (+ b 1))) (- c a))))");
+  reduction = warm("(f 3)");
+  expectEqlInt(reduction.value->value.integer, 4, "sees previous bindings");
+
+  execute("(def! sign (fn (a) (cond ((< a 0) -1) ((= a 0) 0) 1)))");
+  warm("(sign 5)");
+  expectEqlInt(execute("(sign -5)").value->value.integer, -1,
+               "takes the first clause");
+  expectEqlInt(execute("(sign 0)").value->value.integer, 0,
+               "takes the next clauses");
+  expectEqlInt(execute("(sign 7)").value->value.integer, 1,
+               "takes the fallback");
+}
+
+void fallbacks() {
+  execute("(def! same (fn (a b) (= a b)))");
+  warm("(same 1 1)");
+  result_value_ref_t reduction = execute("(same true true)");
+  expectTrue(reduction.value->value.boolean, "falls back on types");
+
+  execute("(def! plus (fn (a b) (+ a b)))");
+  warm("(plus 1 2)");
+  reduction = execute("(def! + (fn (a b) 0))\n(plus 1 2)");
+  expectEqlInt(reduction.value->value.integer, 0, "sees redefinitions");
+}
+
+void forgetting() {
+  // Like the server does between requests: bodies come and go, at a different
+  // place in the code region each time, and leave no entry behind to fill the
+  // table. The binding is made first, so that only its value comes and goes.
+  execute("(def! hot nil)");
+  const size_t before = compiledCount();
+  const size_t offset = arenaOffset(global->code);
+  const size_t values = global->arena->offset;
+  bool correct = true;
+  for (size_t i = 0; i < 300; i++) {
+    tryAssert(arenaAllocate(global->code, (i + 1) * sizeof(node_t)));
+
+    char hot[64];
+    snprintf(hot, sizeof(hot), "(def! hot (fn (a) (- a %zu)))", i);
+    execute(hot);
+    correct = correct && warm("(hot 0)").value->value.integer == -(int)i;
+
+    arenaReset(test_temp_arena);
+    arenaRewind(global->arena, values);
+    arenaRewind(global->code, offset);
+    jitForget(global->jit, global->code);
+  }
+  expectTrue(correct, "runs the bodies that replace others");
+  expectEqlSize(compiledCount(), before + 300 * COMPILED,
+                "compiles past the size of the table");
+}
+
+int main(void) {
+  tryAssertAssign(arenaCreate((size_t)(1024 * 1024)), test_ast_arena);
+  tryAssertAssign(arenaCreate((size_t)(1024 * 1024)), test_temp_arena);
+  tryAssertAssign(environmentCreate(nullptr), global);
+
+  suite(compilation);
+  suite(execution);
+  suite(forgetting);
+  suite(fallbacks);
+
+  environmentDestroy(&global);
+  arenaDestroy(&test_temp_arena);
+  arenaDestroy(&test_ast_arena);
+  return report();
+}
+#else
+int main(void) {
+  printf("Error: This test can only run with JIT=1\n"
+         "  Run again with:\n"
+         "    make JIT=1 clean tests/jit.test && tests/jit.test\n");
+
+  return 1;
+}
+#endif
@@ -0,0 +1,192 @@
+// This is for the CI compiler
+#define _POSIX_C_SOURCE 200809L
+
+#include "test.h"
+#include "utils.h"
+
+#include "../lifp/lifp.h"
+#include <pthread.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+constexpr size_t THREADS = 4;
+
+static char path[64];
+
+static value_t *eval(lifp_vm_t *vm, const char *source) {
+  value_t *value = nullptr;
+  tryAssertAssign(lifpEvalString(vm, strlen(source), source), value);
+  return value;
+}
+
+static result_void_position_t twice(value_t *result, value_list_t *values) {
+  if (values->count != 1 || values->data[0].type != VALUE_TYPE_INTEGER) {
+    throw(result_void_position_t, ERROR_CODE_RUNTIME_ERROR, result->position,
+          "twice requires an integer");
+  }
+
+  result->type = VALUE_TYPE_INTEGER;
+  result->value.integer = values->data[0].value.integer * 2;
+  return ok(result_void_position_t);
+}
+
+void evaluation(void) {
+  lifp_vm_t *vm = nullptr;
+  tryAssertAssign(lifpCreate(), vm);
+
+  expectEqlInt(eval(vm, "(def! a 1)\n(+ a 2)")->value.integer, 3,
+               "returns the last value");
+  expectEqlInt(eval(vm, "(def! l (list.from 1 2 3)) l")->value.list.count, 3,
+               "keeps the last value in place");
+  expectEqlInt((int)eval(vm, "; nothing but comments\n")->type,
+               VALUE_TYPE_NIL, "returns nil without forms");
+  expectEqlInt(eval(vm, "a")->value.integer, 1, "keeps bindings across calls");
+
+  const char *broken = "(+ a b)";
+  const auto failure = lifpEvalString(vm, strlen(broken), broken);
+  expectEqlInt((int)failure.code, ERROR_CODE_REFERENCE_SYMBOL_NOT_FOUND,
+               "reports errors");
+  expectEqlInt(eval(vm, "(+ a 1)")->value.integer, 2, "recovers from errors");
+
+  lifpDestroy(&vm);
+  expectNull(vm, "nulls destroyed machines");
+}
+
+void isolation(void) {
+  lifp_vm_t *first = nullptr;
+  tryAssertAssign(lifpCreate(), first);
+  lifp_vm_t *second = nullptr;
+  tryAssertAssign(lifpCreate(), second);
+
+  eval(first, "(def! a 1)");
+  eval(second, "(def! a 2)");
+  expectEqlInt(eval(first, "a")->value.integer, 1, "keeps its own bindings");
+  expectEqlInt(eval(second, "a")->value.integer, 2, "keeps others' bindings");
+
+  eval(first, "(def! b 3)");
+  const char *unbound = "b";
+  const auto missing = lifpEvalString(second, strlen(unbound), unbound);
+  expectEqlInt((int)missing.code, ERROR_CODE_REFERENCE_SYMBOL_NOT_FOUND,
+               "does not leak bindings");
+
+  lifpDestroy(&first);
+  lifpDestroy(&second);
+}
+
+void builtins(void) {
+  lifp_vm_t *vm = nullptr;
+  tryAssertAssign(lifpCreate(), vm);
+
+  tryAssert(lifpRegisterBuiltin(vm, "host.twice", twice));
+  expectEqlInt(eval(vm, "(host.twice 21)")->value.integer, 42,
+               "calls host builtins");
+  expectEqlInt(eval(vm, "(host.twice (host.twice 1))")->value.integer, 4,
+               "does not fold host builtins");
+
+  eval(vm, "(def! f (fn (x) (+ x 1))) (f 1)");
+  tryAssert(lifpRegisterBuiltin(vm, "+", twice));
+  expectEqlInt(eval(vm, "(+ 5)")->value.integer, 10, "replaces bindings");
+
+  lifp_vm_t *other = nullptr;
+  tryAssertAssign(lifpCreate(), other);
+  const char *source = "(host.twice 1)";
+  const auto missing = lifpEvalString(other, strlen(source), source);
+  expectEqlInt((int)missing.code, ERROR_CODE_REFERENCE_SYMBOL_NOT_FOUND,
+               "registers per machine");
+
+  lifpDestroy(&other);
+  lifpDestroy(&vm);
+}
+
+void files(void) {
+  lifp_vm_t *vm = nullptr;
+  tryAssertAssign(lifpCreate(), vm);
+
+  FILE *file = fopen(path, "w");
+  fputs("(def! sq (fn (x) (* x x)))\n(sq 7)\n", file);
+  fclose(file);
+
+  value_t *value = nullptr;
+  tryAssertAssign(lifpEvalFile(vm, path), value);
+  expectEqlInt(value->value.integer, 49, "evaluates files");
+  expectEqlInt(eval(vm, "(sq 3)")->value.integer, 9, "binds file globals");
+
+  const auto missing = lifpEvalFile(vm, "/tmp/lifp-missing.lifp");
+  expectEqlInt((int)missing.code, LIFP_ERROR_IO, "fails on missing files");
+
+  lifpDestroy(&vm);
+}
+
+typedef struct {
+  int id;
+  int result;
+  int code;
+} job_t;
+
+// Each thread runs its own machine, with bindings named like the others'
+static void *work(void *argument) {
+  job_t *job = argument;
+  job->code = -1;
+
+  const auto creation = lifpCreate();
+  if (creation.code != RESULT_OK)
+    return nullptr;
+  lifp_vm_t *vm = creation.value;
+
+  char prelude[256];
+  snprintf(prelude, sizeof(prelude),
+           "(def! id %d)\n"
+           "(def! fib (fn (n) (cond ((< n 2) n) "
+           "(+ (fib (- n 1)) (fib (- n 2))))))",
+           job->id);
+  const auto setup = lifpEvalString(vm, strlen(prelude), prelude);
+  job->code = setup.code;
+
+  // Lists are rebound over and over, to have the environment collected
+  const char *source = "(def! l (list.from 1 2 3 4 5 6 7 8))\n"
+                       "(def! l (list.from l l l l))\n"
+                       "(def! l (list.from l l l l))\n"
+                       "(math.random)\n"
+                       "(+ id (fib 18) (list.count l))";
+  for (int i = 0; i < 20 && job->code == RESULT_OK; i++) {
+    const auto result = lifpEvalString(vm, strlen(source), source);
+    job->code = result.code;
+    if (result.code == RESULT_OK)
+      job->result = result.value->value.integer;
+  }
+
+  lifpDestroy(&vm);
+  return nullptr;
+}
+
+void concurrency(void) {
+  pthread_t threads[THREADS];
+  job_t jobs[THREADS];
+  for (size_t i = 0; i < THREADS; i++) {
+    jobs[i] = (job_t){.id = (int)i * 1000};
+    expectEqlInt(pthread_create(&threads[i], nullptr, work, &jobs[i]), 0,
+                 "starts threads");
+  }
+
+  for (size_t i = 0; i < THREADS; i++) {
+    pthread_join(threads[i], nullptr);
+    expectEqlInt(jobs[i].code, RESULT_OK, "evaluates on every thread");
+    expectEqlInt(jobs[i].result, jobs[i].id + 2584 + 4,
+                 "evaluates independently");
+  }
+}
+
+int main(void) {
+  snprintf(path, sizeof(path), "/tmp/lifp-embed-%d.lifp", getpid());
+
+  suite(evaluation);
+  suite(isolation);
+  suite(builtins);
+  suite(files);
+  suite(concurrency);
+
+  remove(path);
+  return report();
+}
@@ -103,6 +103,20 @@ void allocations() {
   result_void_t setting = mapSet(map, "another", &value);
   expectTrue(setting.code == RESULT_OK, "allocates over capacity");
   expectEqlSize(map->capacity, 2, "updates capacity");
+  expectEqlSize(map->count, 2, "counts moved items once");
+
+  char key[8];
+  for (int i = 0; i < 5; i++) {
+    snprintf(key, sizeof(key), "k%d", i);
+    tryAssert(mapSet(map, key, &i));
+  }
+  bool found = true;
+  for (int i = 0; i < 5; i++) {
+    snprintf(key, sizeof(key), "k%d", i);
+    const int *item = mapGet(int, map, key);
+    found = found && item && *item == i;
+  }
+  expectTrue(found && mapGet(int, map, "key"), "finds moved items");
   arenaReset(test_arena);
 }
 
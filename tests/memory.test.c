@@ -4,14 +4,13 @@
 #include "../lib/result.h"
 #include "../lifp/environment.h"
 #include "../lifp/evaluate.h"
+#include "../lifp/lifp.h"
 #include "../lifp/parse.h"
 #include "../lifp/tokenize.h"
 #include "test.h"
 #include "utils.h"
 
 #include <stddef.h>
-allocMetricsInit();
-
 static arena_t *test_ast_arena;
 static arena_t *test_temp_arena;
 static environment_t *global;
@@ -24,14 +23,13 @@ result_value_ref_t execute(const char *input) {
   result_value_ref_t last_result;
 
   while (line != NULL) {
-    token_list_t *tokens = nullptr;
-    tryAssertAssign(tokenize(test_ast_arena, line), tokens);
+    lexer_t lexer;
+    lexerInit(&lexer, strlen(line), line);
 
-    size_t offset = 0;
-    size_t depth = 0;
     node_t *syntax_tree = nullptr;
-    tryAssertAssign(parse(test_ast_arena, tokens, &offset, &depth),
-                    syntax_tree);
+    tryAssertAssign(parse(test_ast_arena, &lexer), syntax_tree);
+    tryAssert(optimize(test_ast_arena, syntax_tree, global));
+    escapeAnalyze(syntax_tree);
 
     result_value_ref_t reduction =
         evaluate(test_temp_arena, syntax_tree, global);
@@ -47,22 +45,64 @@ result_value_ref_t execute(const char *input) {
 
 size_t getUsedArenas(void) {
   size_t freed = 0;
-  for (size_t i = 0; i < arena_metrics.arenas_count; i++) {
-    if (arena_metrics.freed[i])
+  const arena_metrics_t *metrics = arenaMetrics();
+  for (size_t i = 0; i < metrics->arenas_count; i++) {
+    if (metrics->freed[i])
       freed++;
   }
-  return arena_metrics.arenas_count - freed;
+  return metrics->arenas_count - freed;
 }
 
+// AST, transient memory, global environment and its code region
+static constexpr size_t LIVE_ARENAS = 4;
+
 void danglingArenas(void) {
   execute("((fn (a) a) 1 2)");
-  expectEqlSize(getUsedArenas(), 3, "no dangling arena on failure");
+  expectEqlSize(getUsedArenas(), LIVE_ARENAS,
+                "no dangling arena on failure");
 
   execute("(def! rec (fn (a) (cond ((= a 0) 1) (rec (- a 1)))))\n(rec 10)");
-  expectEqlSize(getUsedArenas(), 3, "no dangling arena on recursive calls");
+  expectEqlSize(getUsedArenas(), LIVE_ARENAS,
+                "no dangling arena on recursive calls");
 
   execute("(def! rec (fn (a) (cond ((= a 0) 1) (lol (- a 1)))))\n(rec 10)");
-  expectEqlSize(getUsedArenas(), 3, "no dangling arena on nested errors");
+  expectEqlSize(getUsedArenas(), LIVE_ARENAS,
+                "no dangling arena on nested errors");
+}
+
+void profiles(void) {
+  profile_t profile = {};
+  profile_t *previous = profileUse(&profile);
+  arena_t *arena = nullptr;
+  tryAssertAssign(arenaCreate(64), arena);
+  tryAssert(arenaAllocate(arena, 16));
+  profileUse(previous);
+
+  expectEqlSize(profile.arena.arenas_count, 1, "tracks arenas in the profile");
+  expectEqlSize(profile.arena.allocated, 16, "tracks allocations too");
+  expectEqlSize(getUsedArenas(), LIVE_ARENAS, "leaves the thread's alone");
+
+  previous = profileUse(&profile);
+  arenaDestroy(&arena);
+  profileUse(previous);
+  expectTrue(profile.arena.freed[0], "tracks destroyed arenas");
+
+  case("machines");
+  const size_t allocated = arenaMetrics()->allocated;
+  lifp_vm_t *first = nullptr;
+  tryAssertAssign(lifpCreate(), first);
+  lifp_vm_t *second = nullptr;
+  tryAssertAssign(lifpCreate(), second);
+
+  const char *source = "(def! l (list.from 1 2 3))\n(list.count l)";
+  tryAssert(lifpEvalString(first, strlen(source), source));
+  tryAssert(lifpEvalString(second, strlen(source), source));
+  expectEqlSize(getUsedArenas(), LIVE_ARENAS, "keeps their arenas apart");
+  expectEqlSize(arenaMetrics()->allocated, allocated,
+                "keeps their allocations apart");
+
+  lifpDestroy(&first);
+  lifpDestroy(&second);
 }
 
 int main(void) {
@@ -73,6 +113,7 @@ int main(void) {
   profileInit();
 
   suite(danglingArenas);
+  suite(profiles);
 
   return report();
 }
@@ -0,0 +1,171 @@
+#include "test.h"
+#include "utils.h"
+
+#include "../lib/arena.h"
+#include "../lifp/evaluate.h"
+#include "../lifp/intern.h"
+#include "../lifp/parse.h"
+#include "../lifp/tokenize.h"
+#include <stddef.h>
+
+static arena_t *test_arena;
+static environment_t *environment;
+
+static node_t *optimized(const char *source) {
+  lexer_t lexer;
+  lexerInit(&lexer, strlen(source), source);
+
+  node_t *node = nullptr;
+  tryAssertAssign(parse(test_arena, &lexer), node);
+  tryAssert(optimize(test_arena, node, environment));
+  return node;
+}
+
+void calls() {
+  node_t *node = optimized("(+ 1 2)");
+  expectEqlInt(node->type, NODE_TYPE_INTEGER, "folds arithmetic");
+  expectEqlInt(node->value.integer, 3, "with the right value");
+
+  node = optimized("(< 3 4)");
+  expectEqlInt(node->type, NODE_TYPE_BOOLEAN, "folds comparisons");
+  expectTrue(node->value.boolean, "with the right value");
+
+  node = optimized("(and (= 1 1) (> 2 (* 2 3)))");
+  expectEqlInt(node->type, NODE_TYPE_BOOLEAN, "folds nested calls");
+  expectFalse(node->value.boolean, "with the right value");
+
+  node = optimized("(f (+ 1 2) x)");
+  expectEqlInt(node->type, NODE_TYPE_LIST, "keeps unknown calls");
+  expectEqlInt(node->value.list.data[1].type, NODE_TYPE_INTEGER,
+               "folds their arguments");
+
+  node = optimized("(+ 1 x)");
+  expectEqlInt(node->type, NODE_TYPE_LIST, "keeps unknown arguments");
+
+  case("impure");
+  node = optimized("(io.print! 1)");
+  expectEqlInt(node->type, NODE_TYPE_LIST, "keeps io.print!");
+  node = optimized("(flow.sleep 0)");
+  expectEqlInt(node->type, NODE_TYPE_LIST, "keeps flow.sleep");
+  node = optimized("(math.random 1 10)");
+  expectEqlInt(node->type, NODE_TYPE_LIST, "keeps math.random");
+
+  case("errors");
+  node = optimized("(/ 1 0)");
+  expectEqlInt(node->type, NODE_TYPE_LIST, "leaves them to evaluation");
+}
+
+void bindings() {
+  node_t *node = optimized("(let ((a 1)) (+ a 2))");
+  expectEqlInt(node->type, NODE_TYPE_INTEGER, "folds literal bindings");
+  expectEqlInt(node->value.integer, 3, "with the right value");
+
+  node = optimized("(let ((a 1) (b (+ a 1))) (* a b))");
+  expectEqlInt(node->value.integer, 2, "sees previous bindings");
+
+  node = optimized("(let ((a x)) (+ a 2))");
+  expectEqlInt(node->type, NODE_TYPE_LIST, "keeps unknown bindings");
+
+  case("shadowing");
+  node = optimized("(let ((+ 1)) (+ 1 2))");
+  node_t body = node->value.list.data[2];
+  expectEqlInt(body.type, NODE_TYPE_LIST, "respects let bindings");
+
+  node = optimized("(fn (a +) (+ 1 2))");
+  body = node->value.list.data[2];
+  expectEqlInt(body.type, NODE_TYPE_LIST, "respects arguments");
+
+  node = optimized("(let ((a 1)) (fn (a) (+ a 1)))");
+  body = node->value.list.data[2].value.list.data[2];
+  expectEqlInt(body.type, NODE_TYPE_LIST, "respects nested arguments");
+
+  node = optimized("(fn (a) (+ a (* 2 3)))");
+  body = node->value.list.data[2];
+  expectEqlInt(body.value.list.data[2].type, NODE_TYPE_LIST,
+               "leaves calls in function bodies");
+
+  node = optimized("(fn (a) (let ((b 2)) (cond (false a) b)))");
+  body = node->value.list.data[2];
+  expectEqlInt(body.type, NODE_TYPE_INTEGER, "folds function bodies");
+}
+
+void conditions() {
+  node_t *node = optimized("(cond ((< 1 2) 10) 20)");
+  expectEqlInt(node->type, NODE_TYPE_INTEGER, "takes true clauses");
+  expectEqlInt(node->value.integer, 10, "with the right value");
+
+  node = optimized("(cond ((> 1 2) 10) 20)");
+  expectEqlInt(node->value.integer, 20, "takes the fallback");
+
+  node = optimized("(cond ((> 1 2) 10) (x 20) (true 30) 40)");
+  expectEqlSize(node->value.list.count, 3, "drops false clauses");
+  expectEqlInt(node->value.list.data[1].value.list.data[1].value.integer, 20,
+               "keeps unknown clauses");
+  expectEqlInt(node->value.list.data[2].value.integer, 30,
+               "replaces the fallback");
+
+  node = optimized("(cond (x (io.print! 1)) 2)");
+  expectEqlSize(node->value.list.count, 3, "keeps unknown conditions");
+}
+
+void sharing() {
+  intern_t *intern = nullptr;
+  tryAssertAssign(internCreate(16), intern);
+
+  const char *source = "(f (let ((a 1)) (+ a 1)) (fn (a) (+ a 1)))";
+  lexer_t lexer;
+  lexerInit(&lexer, strlen(source), source);
+  node_t *node = nullptr;
+  tryAssertAssign(parseNextInterned(test_arena, &lexer, intern), node);
+
+  const node_t function = node->value.list.data[2];
+  const node_t *shared = function.value.list.data[2].value.list.data;
+  tryAssert(optimize(test_arena, node, environment));
+  expectEqlInt(node->value.list.data[1].type, NODE_TYPE_INTEGER,
+               "folds shared lists");
+  expectEqlInt(shared[1].type, NODE_TYPE_SYMBOL, "does not modify them");
+
+  case("unchanged");
+  const char *unknown = "(f (g a) (h (i b)))";
+  const size_t start = test_arena->offset;
+  lexerInit(&lexer, strlen(unknown), unknown);
+  tryAssertAssign(parse(test_arena, &lexer), node);
+  const size_t parsed = test_arena->offset - start;
+
+  tryAssert(optimize(test_arena, node, environment));
+  expectEqlSize(test_arena->offset - start, parsed, "does not copy lists");
+
+  internDestroy(&intern);
+}
+
+void captures() {
+  node_t *node = optimized("(fn (a) (+ a b (let ((c a)) (* c d)) b))");
+  const symbol_list_t *variables = node->value.function.free;
+  expectNotNull(variables, "caches free variables");
+  expectEqlSize(variables->count, 4, "once each");
+  expectEqlString(variables->data[1], "b", SYMBOL_SIZE, "in order");
+  expectEqlString(variables->data[3], "d", SYMBOL_SIZE, "past let bindings");
+
+  node = optimized("(fn (a) (fn (b) (+ a b c)))");
+  expectEqlSize(node->value.function.free->count, 2, "on outer forms");
+  const node_t *inner = &node->value.list.data[2];
+  expectEqlSize(inner->value.function.free->count, 3, "on nested forms");
+
+  node = optimized("(fn a b)");
+  expectNull(node->value.function.free, "skips malformed forms");
+}
+
+int main(void) {
+  tryAssertAssign(arenaCreate((size_t)(1024 * 128)), test_arena);
+  tryAssertAssign(environmentCreate(nullptr), environment);
+
+  suite(calls);
+  suite(bindings);
+  suite(conditions);
+  suite(sharing);
+  suite(captures);
+
+  environmentDestroy(&environment);
+  arenaDestroy(&test_arena);
+  return report();
+}
@@ -46,38 +46,37 @@ static bool eqlNode(node_t *self, node_t *other) {
 
 void atoms(void) {
   struct {
-    token_t input;
+    const char *input;
     const char *name;
     node_t expected;
   } cases[] = {{
-                   tInt(1),
+                   "1",
                    "integer",
                    (node_t){.type = NODE_TYPE_INTEGER, .value.integer = 1},
                },
                {
-                   tSym("test"),
+                   "test",
                    "symbol",
                    (node_t){.type = NODE_TYPE_SYMBOL, .value.symbol = "test"},
                },
                {
-                   tSym("true"),
+                   "true",
                    "true",
                    (node_t){.type = NODE_TYPE_BOOLEAN, .value.boolean = true},
                },
-               {tSym("false"), "false",
+               {"false", "false",
                 (node_t){.type = NODE_TYPE_BOOLEAN, .value.boolean = false}},
                {
-                   tSym("nil"),
+                   "nil",
                    "nil",
                    (node_t){.type = NODE_TYPE_NIL, .value.nil = nullptr},
                }};
 
   for (size_t i = 0; i < arraySize(cases); i++) {
-    token_list_t *list = makeTokenList(test_arena, &cases[i].input, 1);
-    size_t depth = 0;
-    size_t offset = 0;
+    lexer_t lexer;
+    lexerInit(&lexer, strlen(cases[i].input), cases[i].input);
     node_t *node = nullptr;
-    tryAssertAssign(parse(test_arena, list, &offset, &depth), node);
+    tryAssertAssign(parse(test_arena, &lexer), node);
     expect(eqlNode(node, &cases[i].expected), cases[i].name,
            "Expected equal nodes");
   }
@@ -89,60 +88,30 @@ void unary(void) {
   node_t boolean_false = nBool(false);
   node_t nil = nNil();
   node_t symbol = nSym("sym");
-
-  token_t lparen = tParen('(');
-  token_t rparen = tParen(')');
-
-  token_t int_token = tInt(1);
-  token_t int_tokens[3] = {lparen, int_token, rparen};
-
-  token_t true_token = tSym("true");
-  token_t true_tokens[3] = {lparen, true_token, rparen};
-
-  token_t false_token = tSym("false");
-  token_t false_tokens[3] = {lparen, false_token, rparen};
-
-  token_t nil_token = tSym("nil");
-  token_t nil_tokens[3] = {lparen, nil_token, rparen};
-
-  token_t sym_token = tSym("sym");
-  token_t sym_tokens[3] = {lparen, sym_token, rparen};
+  node_t prefixed = nSym("truest");
 
   struct {
     const char *name;
-    size_t length;
-    token_t *input;
+    const char *input;
     node_t expected;
-  } cases[] = {{"integer", 3, int_tokens, nList(1, (node_t *){&integer})},
-               {"symbol", 3, sym_tokens, nList(1, (node_t *){&symbol})},
-               {"true", 3, true_tokens, nList(1, (node_t *){&boolean_true})},
-               {"false", 3, false_tokens, nList(1, (node_t *){&boolean_false})},
-               {"nil", 3, nil_tokens, nList(1, (node_t *){&nil})}};
+  } cases[] = {{"integer", "(1)", nList(1, (node_t *){&integer})},
+               {"symbol", "(sym)", nList(1, (node_t *){&symbol})},
+               {"true", "(true)", nList(1, (node_t *){&boolean_true})},
+               {"false", "(false)", nList(1, (node_t *){&boolean_false})},
+               {"keyword prefix", "(truest)", nList(1, (node_t *){&prefixed})},
+               {"nil", "(nil)", nList(1, (node_t *){&nil})}};
 
   for (size_t i = 0; i < arraySize(cases); i++) {
-    token_list_t *list =
-        makeTokenList(test_arena, cases[i].input, cases[i].length);
-    size_t depth = 0;
-    size_t offset = 0;
+    lexer_t lexer;
+    lexerInit(&lexer, strlen(cases[i].input), cases[i].input);
     node_t *node = nullptr;
-    tryAssertAssign(parse(test_arena, list, &offset, &depth), node);
+    tryAssertAssign(parse(test_arena, &lexer), node);
     expect(eqlNode(node, &cases[i].expected), cases[i].name,
            "Expected equal nodes");
   }
 }
 
 void complex(void) {
-  token_t lparen = tParen('(');
-  token_t rparen = tParen(')');
-  token_t add_token = tSym("add");
-  token_t int_token = tInt(1);
-  token_t bool_token = tSym("true");
-
-  token_t empty[2] = {lparen, rparen};
-  token_t mixed[5] = {lparen, add_token, bool_token, int_token, rparen};
-  token_t nested[9] = {lparen,     add_token, int_token, lparen, add_token,
-                       bool_token, int_token, rparen,    rparen};
-
   node_t integer = nInt(1);
   node_t boolean = nBool(true);
   node_t add = nSym("add");
@@ -151,57 +120,151 @@ void complex(void) {
 
   struct {
     const char *name;
-    size_t length;
-    token_t *input;
+    const char *input;
     node_t expected;
-  } cases[] = {{"empty", 2, empty, nList(0, nullptr)},
-               {"mixed", 5, mixed, nList(3, mixed_nodes)},
-               {"nested", 9, nested, nList(3, nested_nodes)}};
+  } cases[] = {{"empty", "()", nList(0, nullptr)},
+               {"mixed", "(add true 1)", nList(3, mixed_nodes)},
+               {"nested", "(add 1 (add true 1))", nList(3, nested_nodes)}};
 
   for (size_t i = 0; i < arraySize(cases); i++) {
-    token_list_t *list =
-        makeTokenList(test_arena, cases[i].input, cases[i].length);
-    size_t depth = 0;
-    size_t offset = 0;
+    lexer_t lexer;
+    lexerInit(&lexer, strlen(cases[i].input), cases[i].input);
     node_t *node = nullptr;
-    tryAssertAssign(parse(test_arena, list, &offset, &depth), node);
+    tryAssertAssign(parse(test_arena, &lexer), node);
     expect(eqlNode(node, &cases[i].expected), cases[i].name,
            "Expected equal nodes");
   }
 }
 
 void errors() {
-  token_t lparen = tParen('(');
-  token_t rparen = tParen(')');
-  token_t integer = tInt(1);
-
-  token_t unbalanced_right[4] = {lparen, lparen, integer, rparen};
-  token_t unbalanced_left[4] = {lparen, integer, rparen, rparen};
-  token_t dangling[4] = {lparen, integer, rparen, integer};
-
   struct {
     const char *name;
-    size_t length;
-    token_t *input;
+    const char *input;
     int expected;
   } cases[] = {
-      {"unbalanced parentheses right", 4, unbalanced_right,
+      {"unbalanced parentheses right", "((1)",
        ERROR_CODE_SYNTAX_UNBALANCED_PARENTHESES},
-      {"unbalanced parentheses left", 4, unbalanced_left,
+      {"unbalanced parentheses left", "(1))",
        ERROR_CODE_SYNTAX_UNBALANCED_PARENTHESES},
-      {"dangling symbols", 4, dangling, ERROR_CODE_SYNTAX_UNEXPECTED_TOKEN},
+      {"dangling symbols", "(1) 1", ERROR_CODE_SYNTAX_UNEXPECTED_TOKEN},
+      {"dangling atoms", "1 1", ERROR_CODE_SYNTAX_UNEXPECTED_TOKEN},
+      {"lexical errors", "(1 \a)", ERROR_CODE_SYNTAX_UNEXPECTED_TOKEN},
+      {"symbol too long", "(symbol_way_too_long)",
+       ERROR_CODE_SYNTAX_UNEXPECTED_TOKEN},
   };
 
   for (size_t i = 0; i < arraySize(cases); i++) {
-    token_list_t *list =
-        makeTokenList(test_arena, cases[i].input, cases[i].length);
-    size_t depth = 0;
-    size_t offset = 0;
-    auto result = parse(test_arena, list, &offset, &depth);
+    lexer_t lexer;
+    lexerInit(&lexer, strlen(cases[i].input), cases[i].input);
+    auto result = parse(test_arena, &lexer);
     expectEqlInt(result.code, cases[i].expected, cases[i].name);
   }
 }
 
+void empty(void) {
+  lexer_t lexer;
+  lexerInit(&lexer, 0, "");
+  node_t *node = nullptr;
+  tryAssertAssign(parse(test_arena, &lexer), node);
+  expectNull(node, "empty input");
+
+  lexerInit(&lexer, 3, "  \n");
+  tryAssertAssign(parse(test_arena, &lexer), node);
+  expectNull(node, "only whitespaces");
+}
+
+void forms(void) {
+  const char *input = "; comment\n"
+                      "(def! a 1) 42 ; trailing\n"
+                      "sym (b\n"
+                      "  (c))";
+  lexer_t lexer;
+  lexerInit(&lexer, strlen(input), input);
+
+  struct {
+    node_type_t type;
+    size_t line;
+    size_t column;
+  } expected[] = {
+      {NODE_TYPE_LIST, 2, 1},
+      {NODE_TYPE_INTEGER, 2, 12},
+      {NODE_TYPE_SYMBOL, 3, 1},
+      {NODE_TYPE_LIST, 3, 5},
+  };
+
+  for (size_t i = 0; i < arraySize(expected); i++) {
+    node_t *node = nullptr;
+    tryAssertAssign(parseNext(test_arena, &lexer), node);
+    expectNotNull(node, "reads a form");
+    expectEqlInt((int)node->type, (int)expected[i].type, "has correct type");
+    expectEqlSize(node->position.line, expected[i].line, "has correct line");
+    expectEqlSize(node->position.column, expected[i].column,
+                  "has correct column");
+  }
+
+  node_t *node = nullptr;
+  tryAssertAssign(parseNext(test_arena, &lexer), node);
+  expectNull(node, "stops at the end of input");
+
+  case("errors");
+  lexerInit(&lexer, 6, "(1) 2)");
+  tryAssertAssign(parseNext(test_arena, &lexer), node);
+  tryAssertAssign(parseNext(test_arena, &lexer), node);
+  auto result = parseNext(test_arena, &lexer);
+  expectEqlInt(result.code, ERROR_CODE_SYNTAX_UNBALANCED_PARENTHESES,
+               "unbalanced parentheses");
+}
+
+void interning() {
+  intern_t *intern = nullptr;
+  tryAssertAssign(internCreate(16), intern);
+
+  const char *source = "(f (- a 1) (g (- a 1)) (- a 2) (- a 1))";
+  lexer_t lexer;
+  lexerInit(&lexer, strlen(source), source);
+  node_t *node = nullptr;
+  tryAssertAssign(parseNextInterned(test_arena, &lexer, intern), node);
+
+  node_t *elements = node->value.list.data;
+  expectFalse(elements[1].value.list.data == elements[4].value.list.data,
+              "keeps repeated lists apart");
+  expectEqlSize(elements[4].value.list.data[1].position.column, 35,
+                "keeps their positions");
+  expectEqlSize(intern->hits, 0, "shares none of them");
+
+  lexerInit(&lexer, strlen(source), source);
+  node_t *again = nullptr;
+  tryAssertAssign(parseNextInterned(test_arena, &lexer, intern), again);
+  node_t *nested = elements[2].value.list.data;
+  node_t *nested_again = again->value.list.data[2].value.list.data;
+  expectTrue(again->value.list.data == elements, "shares equal lists");
+  expectTrue(nested_again == nested, "shares nested lists");
+  expectEqlSize(intern->hits, 6, "counts shared lists");
+  expectTrue(intern->reclaimed > 0, "reclaims memory of shared lists");
+
+  case("memory");
+  const size_t start = test_arena->offset;
+  lexerInit(&lexer, strlen(source), source);
+  tryAssertAssign(parseNext(test_arena, &lexer), node);
+  const size_t plain = test_arena->offset - start;
+
+  const size_t interned_start = test_arena->offset;
+  lexerInit(&lexer, strlen(source), source);
+  tryAssertAssign(parseNextInterned(test_arena, &lexer, intern), node);
+  expectTrue(test_arena->offset - interned_start < plain,
+             "takes less memory");
+
+  case("capacity");
+  internDestroy(&intern);
+  tryAssertAssign(internCreate(1), intern);
+  lexerInit(&lexer, strlen(source), source);
+  tryAssertAssign(parseNextInterned(test_arena, &lexer, intern), node);
+  expectEqlSize(intern->count, 1, "stops interning when full");
+  expectEqlSize(node->value.list.count, 5, "keeps parsing");
+
+  internDestroy(&intern);
+}
+
 int main(void) {
   tryAssertAssign(arenaCreate((size_t)(1024 * 1024)), test_arena);
 
@@ -209,6 +272,9 @@ int main(void) {
   suite(unary);
   suite(complex);
   suite(errors);
+  suite(empty);
+  suite(forms);
+  suite(interning);
   arenaDestroy(&test_arena);
   return report();
 }
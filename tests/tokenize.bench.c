@@ -0,0 +1,101 @@
+// This is for the CI compiler
+#define _POSIX_C_SOURCE 200809L
+
+#include "../lifp/tokenize.h"
+#include "utils.h"
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Tokenizer throughput benchmark
+// ---
+//
+// Lexes large generated sources and reports the throughput in MB/s. `make
+// bench` runs it against both the scalar and the vectorised lexer; NATIVE=1
+// enables the widest SIMD extensions of the host.
+//
+// ```sh
+// make bench
+// make NATIVE=1 bench
+// ```
+
+constexpr size_t SOURCE_SIZE = (size_t)32 * 1024 * 1024;
+constexpr int ITERATIONS = 5;
+
+typedef struct {
+  const char *name;
+  const char *form;
+} bench_case_t;
+
+static double now(void) {
+  struct timespec time;
+  clock_gettime(CLOCK_MONOTONIC, &time);
+  return (double)time.tv_sec + ((double)time.tv_nsec / 1e9);
+}
+
+static char *generate(const char *form, size_t *length) {
+  const size_t form_length = strlen(form);
+  char *source = malloc(SOURCE_SIZE + 1);
+  assert(source);
+
+  size_t offset = 0;
+  while (offset + form_length <= SOURCE_SIZE) {
+    memcpy(&source[offset], form, form_length);
+    offset += form_length;
+  }
+  source[offset] = 0;
+  *length = offset;
+  return source;
+}
+
+static void run(const bench_case_t *bench_case) {
+  size_t length = 0;
+  char *source = generate(bench_case->form, &length);
+
+  size_t tokens = 0;
+  double best = 0;
+  for (int i = 0; i < ITERATIONS; i++) {
+    lexer_t lexer;
+    lexerInit(&lexer, length, source);
+
+    const double start = now();
+    token_t token = {};
+    tokens = 0;
+    do {
+      tryAssertAssign(lexerNext(&lexer), token);
+      tokens++;
+    } while (token.type != TOKEN_TYPE_EOF);
+    const double elapsed = now() - start;
+
+    if (best == 0 || elapsed < best)
+      best = elapsed;
+  }
+
+  printf("  %-12s %8.1f MB/s %8.1f Mtokens/s\n", bench_case->name,
+         (double)length / best / (1024.0 * 1024.0),
+         (double)tokens / best / 1e6);
+  free(source);
+}
+
+int main(void) {
+  const bench_case_t cases[] = {
+      {"forms", "(def! fibonacci\n  (fn (a)\n    (cond\n      ((< a 1) 0)\n"
+                "      ((= a 1) 1)\n      (+ (fibonacci (- a 1)) "
+                "(fibonacci (- a 2))))))\n\n"},
+      {"whitespace", "(io.print!                                          "
+                     "\n\n                         \t      nil)\n"},
+      {"symbols", "(list.from alpha beta gamma delta epsilon zeta eta)\n"},
+      {"integers", "(list.from 1 -22 333 4444 55555 -666666 7777777 "
+                   "88888888 999999999 2147483647 -2147483648 0 +12)\n"},
+  };
+
+  printf("Tokenizer throughput (%zu MB sources, best of %d)\n",
+         SOURCE_SIZE / (1024 * 1024), ITERATIONS);
+  for (size_t i = 0; i < arraySize(cases); i++) {
+    run(&cases[i]);
+  }
+  return 0;
+}
@@ -15,11 +15,13 @@ static bool tokenEql(const token_t *self, const token_t *other) {
   switch (self->type) {
   case TOKEN_TYPE_LPAREN:
   case TOKEN_TYPE_RPAREN:
+  case TOKEN_TYPE_EOF:
     return true;
   case TOKEN_TYPE_INTEGER:
     return self->value.integer == other->value.integer;
   case TOKEN_TYPE_SYMBOL:
-    return strncmp(self->value.symbol, other->value.symbol, SYMBOL_SIZE) == 0;
+    return self->value.symbol.offset == other->value.symbol.offset &&
+           self->value.symbol.length == other->value.symbol.length;
   default:
     return false;
   }
@@ -43,7 +45,7 @@ void atoms() {
   token_t lparen_token = tParen('(');
   token_t rparen_token = tParen(')');
   token_t integer_token = tInt(12);
-  token_t symbol_token = tSym("lol");
+  token_t symbol_token = tSym(0, 3);
 
   struct {
     const char *input;
@@ -74,10 +76,10 @@ void atoms() {
 
 void whitespaces() {
   token_t token = {.type = TOKEN_TYPE_SYMBOL,
-                   .value = {.symbol = {'a'}},
+                   .value.symbol = {.offset = 1, .length = 1},
                    .position = {.column = 2, .line = 1}};
   token_t other_token = {.type = TOKEN_TYPE_SYMBOL,
-                         .value = {.symbol = {'b'}},
+                         .value.symbol = {.offset = 1, .length = 1},
                          .position = {.column = 1, .line = 2}};
 
   struct {
@@ -118,9 +120,7 @@ void errors() {
       {"a\b", 2, ERROR_CODE_SYNTAX_UNEXPECTED_TOKEN,
        "unexpected character with symbol"},
       {"1\b", 2, ERROR_CODE_SYNTAX_UNEXPECTED_TOKEN,
-       "unexpected character with integer"},
-      {"symbol_way_too_long", 1, ERROR_CODE_SYNTAX_UNEXPECTED_TOKEN,
-       "symbol too long"}};
+       "unexpected character with integer"}};
 
   for (size_t i = 0; i < arraySize(cases); i++) {
     auto result = tokenize(test_arena, cases[i].input);
@@ -135,8 +135,8 @@ void complex() {
   token_t rparen_token = tParen(')');
   token_t twelve_token = tInt(12);
   token_t two_token = tInt(2);
-  token_t def_token = tSym("def!");
-  token_t x_token = tSym("x");
+  token_t def_token = tSym(1, 4);
+  token_t x_token = tSym(6, 1);
 
   token_t flat_list[4] = {lparen_token, twelve_token, two_token, rparen_token};
   token_t nested_list[6] = {lparen_token, two_token,    lparen_token,
@@ -161,6 +161,179 @@ void complex() {
   }
 }
 
+void stream() {
+  const char *input = "(+ 1\n  foo)";
+  lexer_t lexer;
+  lexerInit(&lexer, strlen(input), input);
+
+  struct {
+    token_type_t type;
+    size_t line;
+    size_t column;
+  } expected[] = {
+      {TOKEN_TYPE_LPAREN, 1, 1}, {TOKEN_TYPE_SYMBOL, 1, 2},
+      {TOKEN_TYPE_INTEGER, 1, 4}, {TOKEN_TYPE_SYMBOL, 2, 3},
+      {TOKEN_TYPE_RPAREN, 2, 6},  {TOKEN_TYPE_EOF, 2, 6},
+      {TOKEN_TYPE_EOF, 2, 6},
+  };
+
+  for (size_t i = 0; i < arraySize(expected); i++) {
+    token_t token;
+    tryAssertAssign(lexerNext(&lexer), token);
+    expectEqlInt((int)token.type, (int)expected[i].type, "has correct type");
+    expectEqlSize(token.position.line, expected[i].line, "has correct line");
+    expectEqlSize(token.position.column, expected[i].column,
+                  "has correct column");
+  }
+
+  case("non null-terminated input");
+  lexerInit(&lexer, 2, "12345");
+  token_t token;
+  tryAssertAssign(lexerNext(&lexer), token);
+  expectEqlInt(token.value.integer, 12, "reads up to length");
+}
+
+void spans() {
+  const char *input = "(a.very.long.identifier.indeed +1 -2 - +)";
+  token_list_t *tokens = nullptr;
+  tryAssertAssign(tokenize(test_arena, input), tokens);
+  expectEqlSize(tokens->count, 7, "has correct count");
+
+  token_t symbol = listGet(token_t, tokens, 1);
+  expectEqlInt((int)symbol.type, TOKEN_TYPE_SYMBOL, "long symbol");
+  expectEqlSize(symbol.value.symbol.offset, 1, "references the source");
+  expectEqlSize(symbol.value.symbol.length, 29, "has correct length");
+
+  token_t positive = listGet(token_t, tokens, 2);
+  expectEqlInt(positive.value.integer, 1, "signed integer");
+  token_t negative = listGet(token_t, tokens, 3);
+  expectEqlInt(negative.value.integer, -2, "negative integer");
+
+  token_t minus = listGet(token_t, tokens, 4);
+  expectEqlInt((int)minus.type, TOKEN_TYPE_SYMBOL, "lone sign is a symbol");
+  expectEqlSize(minus.value.symbol.length, 1, "has correct length");
+}
+
+void integers() {
+  struct {
+    const char *input;
+    int32_t expected;
+    const char *name;
+  } cases[] = {
+      {"0", 0, "zero"},
+      {"-0", 0, "negative zero"},
+      {"+42", 42, "explicit sign"},
+      {"2147483647", INT32_MAX, "max integer"},
+      {"-2147483648", INT32_MIN, "min integer"},
+      {"000000000000000000000000000000000000000000000000000000000000000000001",
+       1, "leading zeroes"},
+  };
+
+  for (size_t i = 0; i < arraySize(cases); i++) {
+    token_list_t *tokens = nullptr;
+    tryAssertAssign(tokenize(test_arena, cases[i].input), tokens);
+    token_t token = listGet(token_t, tokens, 0);
+    case(cases[i].name);
+    expectEqlInt((int)token.type, TOKEN_TYPE_INTEGER, "is an integer");
+    expectEqlInt(token.value.integer, cases[i].expected, "has correct value");
+  }
+
+  struct {
+    const char *input;
+    const char *name;
+  } overflows[] = {
+      {"2147483648", "above max integer"},
+      {"-2147483649", "below min integer"},
+      {"(+ 1 99999999999999999999999999)", "way above max integer"},
+  };
+
+  for (size_t i = 0; i < arraySize(overflows); i++) {
+    auto result = tokenize(test_arena, overflows[i].input);
+    case(overflows[i].name);
+    expectEqlInt(result.code, ERROR_CODE_SYNTAX_INTEGER_OVERFLOW,
+                 "has correct error code");
+  }
+
+  case("integer-like symbols");
+  token_list_t *tokens = nullptr;
+  tryAssertAssign(tokenize(test_arena, "12a 1-2 --1"), tokens);
+  for (size_t i = 0; i < tokens->count; i++) {
+    token_t token = listGet(token_t, tokens, i);
+    expectEqlInt((int)token.type, TOKEN_TYPE_SYMBOL, "is a symbol");
+  }
+}
+
+void longRuns() {
+  // Runs longer than the scanning width, crossing chunk boundaries
+  const char *input = "                                        \n"
+                      "                    \n\n     abc"
+                      "                                     \t"
+                      "0000000000000000000000000000000000000012)";
+  lexer_t lexer;
+  lexerInit(&lexer, strlen(input), input);
+
+  token_t token;
+  tryAssertAssign(lexerNext(&lexer), token);
+  expectEqlInt((int)token.type, TOKEN_TYPE_SYMBOL, "symbol after newlines");
+  expectEqlSize(token.position.line, 4, "has correct line");
+  expectEqlSize(token.position.column, 6, "has correct column");
+
+  tryAssertAssign(lexerNext(&lexer), token);
+  expectEqlInt((int)token.type, TOKEN_TYPE_INTEGER, "long integer");
+  expectEqlInt(token.value.integer, 12, "has correct value");
+  expectEqlSize(token.position.line, 4, "has correct line");
+  expectEqlSize(token.position.column, 47, "has correct column");
+
+  tryAssertAssign(lexerNext(&lexer), token);
+  expectEqlInt((int)token.type, TOKEN_TYPE_RPAREN, "paren after long atom");
+  expectEqlSize(token.position.column, 87, "has correct column");
+
+  case("non-printable character in long atom");
+  const char *invalid = "(00000000000000000000000000000000000000001\b)";
+  auto result = tokenize(test_arena, invalid);
+  expectEqlInt(result.code, ERROR_CODE_SYNTAX_UNEXPECTED_TOKEN,
+               "has correct error code");
+  expectEqlSize(result.meta.column, 43, "has correct position");
+}
+
+void comments() {
+  const char *input = "; leading comment\n"
+                      "(abc;trailing (comment)\n"
+                      "  12) ; no newline at the end";
+  lexer_t lexer;
+  lexerInit(&lexer, strlen(input), input);
+
+  struct {
+    token_type_t type;
+    size_t line;
+    size_t column;
+  } expected[] = {
+      {TOKEN_TYPE_LPAREN, 2, 1},  {TOKEN_TYPE_SYMBOL, 2, 2},
+      {TOKEN_TYPE_INTEGER, 3, 3}, {TOKEN_TYPE_RPAREN, 3, 5},
+      {TOKEN_TYPE_EOF, 3, 29},
+  };
+
+  for (size_t i = 0; i < arraySize(expected); i++) {
+    token_t token;
+    tryAssertAssign(lexerNext(&lexer), token);
+    expectEqlInt((int)token.type, (int)expected[i].type, "has correct type");
+    expectEqlSize(token.position.line, expected[i].line, "has correct line");
+    expectEqlSize(token.position.column, expected[i].column,
+                  "has correct column");
+  }
+
+  case("comment terminates atoms");
+  token_list_t *tokens = nullptr;
+  tryAssertAssign(tokenize(test_arena, "abc;def"), tokens);
+  expectEqlSize(tokens->count, 1, "has correct count");
+  token_t symbol = listGet(token_t, tokens, 0);
+  expectEqlSize(symbol.value.symbol.length, 3, "has correct length");
+
+  case("comment only");
+  tryAssertAssign(tokenize(test_arena, ";;; (def! a 1)"), tokens);
+  expectEqlSize(tokens->count, 0, "has no tokens");
+}
+
 int main(void) {
   tryAssertAssign(arenaCreate((size_t)(1024 * 1024)), test_arena);
 
@@ -168,6 +341,11 @@ int main(void) {
   suite(complex);
   suite(whitespaces);
   suite(errors);
+  suite(stream);
+  suite(spans);
+  suite(integers);
+  suite(longRuns);
+  suite(comments);
 
   arenaDestroy(&test_arena);
   return report();
@@ -1,5 +1,8 @@
 #pragma once
 
+#include "../lifp/evaluate.h"
+#include "../lifp/parse.h"
+#include "../lifp/tokenize.h"
 #include "../lifp/value.h"
 #include <assert.h>
 #include <stddef.h>
@@ -44,14 +47,10 @@ static inline token_t tInt(int integer) {
   };
 }
 
-static inline token_t tSym(const char symbol[SYMBOL_SIZE]) {
-  const size_t len = strlen(symbol);
-  token_value_t value = {};
-  memcpy(value.symbol, symbol, len);
-
+static inline token_t tSym(size_t offset, size_t length) {
   return (token_t){.position = {.column = 1, .line = 1},
                    .type = TOKEN_TYPE_SYMBOL,
-                   .value = value};
+                   .value.symbol = {.offset = offset, .length = length}};
 }
 
 static inline token_t tParen(char paren) {
@@ -126,3 +125,35 @@ static inline node_t nSym(const char symbol[]) {
       .value.list.capacity = (Count),                                          \
       .value.list.data = (Data),                                               \
   }
+
+// Evaluates one form per line and returns the value of the last one. Both
+// arenas are reset after each form, but unlike `run` the interned constants
+// are kept and the environment is never collected.
+static inline value_t evaluateLines(arena_t *ast_arena, arena_t *temp_arena,
+                                    environment_t *environment,
+                                    const char *input) {
+  char input_copy[1024];
+  strcpy(input_copy, input);
+
+  value_t last_value = {};
+  char *line = strtok(input_copy, "\n");
+  while (line != NULL) {
+    lexer_t lexer;
+    lexerInit(&lexer, strlen(line), line);
+
+    node_t *syntax_tree = nullptr;
+    tryAssertAssign(parse(ast_arena, &lexer), syntax_tree);
+    tryAssert(optimize(ast_arena, syntax_tree, environment));
+    escapeAnalyze(syntax_tree);
+
+    value_t *reduced = nullptr;
+    tryAssertAssign(evaluate(temp_arena, syntax_tree, environment), reduced);
+    last_value = *reduced;
+
+    line = strtok(nullptr, "\n");
+    arenaReset(ast_arena);
+    arenaReset(temp_arena);
+  }
+
+  return last_value;
+}
@@ -0,0 +1,152 @@
+#ifdef REGISTER_VM
+#include "../lib/arena.h"
+#include "../lifp/error.h"
+#include "../lifp/evaluate.h"
+#include "../lifp/parse.h"
+#include "../lifp/tokenize.h"
+#include "test.h"
+#include "utils.h"
+
+#include <stddef.h>
+
+static arena_t *test_ast_arena;
+static arena_t *test_temp_arena;
+static environment_t *global;
+
+// Evaluates each line of `input` in the global environment
+result_value_ref_t execute(const char *input) {
+  char input_copy[1024];
+  strcpy(input_copy, input);
+
+  char *line = strtok(input_copy, "\n");
+  result_value_ref_t last_result;
+
+  while (line != NULL) {
+    lexer_t lexer;
+    lexerInit(&lexer, strlen(line), line);
+
+    node_t *syntax_tree = nullptr;
+    tryAssertAssign(parse(test_ast_arena, &lexer), syntax_tree);
+    escapeAnalyze(syntax_tree);
+    last_result = evaluate(test_temp_arena, syntax_tree, global);
+
+    line = strtok(nullptr, "\n");
+    arenaReset(test_ast_arena);
+  }
+
+  return last_result;
+}
+
+static bool compiled(const char *symbol) {
+  const value_t *value = mapGet(value_t, global->values, symbol);
+  return value && value->type == VALUE_TYPE_CLOSURE &&
+         value->value.closure.program;
+}
+
+void compilation() {
+  execute("(def! add (fn (a b) (+ a b)))");
+  expectTrue(compiled("add"), "compiles closures");
+
+  execute("(def! k (let ((n 7)) (fn (x) (+ x n))))");
+  expectTrue(compiled("k"), "compiles captures");
+
+  execute("(def! make (fn (a) (fn (b) (+ a b))))");
+  expectFalse(compiled("make"), "leaves nested closures to the tree walker");
+
+  execute("(def! bad (fn (a) (let (a) a)))");
+  expectFalse(compiled("bad"), "leaves malformed forms to the tree walker");
+}
+
+void execution() {
+  result_value_ref_t reduction = execute("(add 1 2)");
+  expectEqlInt(reduction.value->value.integer, 3, "returns correct value");
+
+  reduction = execute("(k 1)");
+  expectEqlInt(reduction.value->value.integer, 8, "reads captures");
+
+  reduction = execute("((make 1) 2)");
+  expectEqlInt(reduction.value->value.integer, 3, "calls the tree walker");
+
+  reduction = execute(
+      "(def! fib (fn (a) (cond ((< a 2) a) (+ (fib (- a 1)) (fib (- a 2))))))\n"
+      "(fib 15)");
+  expectEqlInt(reduction.value->value.integer, 610, "recurs");
+
+  reduction = execute("(def! f (fn (a) (let ((b (* a 2)) (c (+ b 1))) "
+                      "(list.from a b c))))\n(f 3)");
+  expectEqlSize(reduction.value->value.list.count, 3, "builds lists");
+  expectEqlInt(reduction.value->value.list.data[2].value.integer, 7,
+               "sees previous bindings");
+
+  reduction = execute("(def! same (fn (a b) (= a b)))\n(same true true)");
+  expectTrue(reduction.value->value.boolean, "falls back on types");
+
+  reduction = execute("(def! plus (fn (a b) (+ a b)))\n(plus 1 2)\n"
+                      "(def! + (fn (a b) 0))\n(plus 1 2)");
+  expectEqlInt(reduction.value->value.integer, 0, "sees redefinitions");
+}
+
+void errors() {
+  result_value_ref_t reduction = execute("(add 1)");
+  expectEqlInt(reduction.code, ERROR_CODE_TYPE_UNEXPECTED_ARITY,
+               "checks arity");
+  expectEqlString(reduction.message,
+                  "Unexpected arity. Expected 2 arguments, got 1.",
+                  sizeof(message_t), "reports arity");
+
+  reduction = execute("(def! short (fn (a) (add a)))\n(short 1)");
+  expectEqlString(reduction.message,
+                  "Unexpected arity. Expected 2 arguments, got 1.",
+                  sizeof(message_t), "reports arity between programs");
+
+  reduction = execute("(def! g (fn (a) (cond (a 1) 2)))\n(g 1)");
+  expectEqlInt(reduction.code, ERROR_CODE_RUNTIME_ERROR, "checks conditions");
+
+  reduction = execute("(def! h (fn (a) (+ a unknown)))\n(h 1)");
+  expectEqlInt(reduction.code, ERROR_CODE_REFERENCE_SYMBOL_NOT_FOUND,
+               "checks globals");
+}
+
+void depth() {
+  // + is rebound by now. The nested closure keeps walk on the tree walker.
+  execute("(def! loop (fn (n) (cond ((= n 0) 0) (- (loop (- n 1)) 1))))");
+  execute("(def! walk (fn (n) (cond ((= n -1) (fn () n)) ((= n 0) 0) "
+          "(- (walk (- n 1)) 1))))");
+  expectTrue(compiled("loop"), "compiles the recursion");
+  expectFalse(compiled("walk"), "walks the other one");
+
+  result_value_ref_t reduction = execute("(loop 500)");
+  expectEqlInt(reduction.value->value.integer, -500, "recurs");
+
+  reduction = execute("(loop 800)");
+  expectEqlInt(reduction.code, RESULT_OK, "recurs past the machine's depth");
+  const int32_t deep = reduction.value->value.integer;
+  reduction = execute("(walk 800)");
+  expectEqlInt(deep, reduction.value->value.integer,
+               "like the tree walker does");
+}
+
+int main(void) {
+  tryAssertAssign(arenaCreate((size_t)(1024 * 1024)), test_ast_arena);
+  tryAssertAssign(arenaCreate((size_t)(16 * 1024 * 1024)), test_temp_arena);
+  tryAssertAssign(environmentCreate(nullptr), global);
+
+  suite(compilation);
+  suite(execution);
+  suite(errors);
+  suite(depth);
+
+  environmentDestroy(&global);
+  arenaDestroy(&test_temp_arena);
+  arenaDestroy(&test_ast_arena);
+  return report();
+}
+#else
+int main(void) {
+  printf("Error: This test can only run with VM=1\n"
+         "  Run again with:\n"
+         "    make VM=1 clean tests/vm.test && tests/vm.test\n");
+
+  return 1;
+}
+#endif